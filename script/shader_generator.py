@@ -52,7 +52,7 @@ g_glsl_c_output_format_map = {
 g_glsl_c_desc_type_map = {
     "ubo": "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER",
     "sampler2D": "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER",
-
+    "buffer": "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER",
 }
 g_glsl_c_stage_map = {
     "vertex": "VK_SHADER_STAGE_VERTEX_BIT",
@@ -78,6 +78,7 @@ class UniformVariable(TypedDict):
     type: str
     binding: int
     stage: List[str]
+    count: int  # 0 for runtime sized arrays
 
 
 
@@ -133,48 +134,59 @@ def parse_shader_structs_uniforms(content: str):
     return values
 
 
+def parse_stage(extra: Optional[str]) -> List[str]:
+    if not extra:
+        return ["vertex", "fragment"]
+    extra = [e.strip() for e in extra.split(",")]
+    stage = []
+    if "v" in extra:
+        stage.append("vertex")
+    if "f" in extra:
+        stage.append("fragment")
+    if len(stage) == 0:
+        stage = ["vertex", "fragment"]
+    return stage
+
+
 def parse_shader_uniforms(content: str) -> List[UniformVariable]:
     values: List[UniformVariable] = []
     variable_pattern = re.compile(
-        r'layout\s*\(\s*binding\s*=\s*(\d+)\s*\)\s+uniform\s+(\w+)\s+(\w+)\s*;(\s*//\s*(.*))?'
+        r'layout\s*\(\s*binding\s*=\s*(\d+)\s*\)\s+uniform\s+(\w+)\s+(\w+)\s*(\[\s*(\d*)\s*\])?\s*;(\s*//\s*(.*))?'
     )
     for match in variable_pattern.finditer(content):
         binding_index = int(match.group(1))
         var_type = match.group(2)
         var_name = match.group(3)
-        extra = match.group(5)
-        stage = []
-        if not extra:
-            stage = ["vertex", "fragment"]
-        else:
-            extra = extra.split(",")
-            if "v" in extra:
-                stage.append("vertex")
-            if "f" in extra:
-                stage.append("fragment")
-            if extra.count == 0:
-                stage = ["vertex", "fragment"]
+        count = 1
+        if match.group(4):
+            count = int(match.group(5)) if match.group(5) else 0
+        extra = match.group(7)
 
         values.append({
             "type": var_type,
             "binding": binding_index,
             "name": var_name,
-            "stage": stage
+            "stage": parse_stage(extra),
+            "count": count
         })
 
-    # storage buffer
+    # storage buffer, named after the instance when it has one
     storage_pattern = re.compile(
-        r'layout\s*\(\s*binding\s*=\s*(\d+).*\)\s+buffer\s+(\w+)\s*{([^}]*)};'
+        r'layout\s*\(([^)]*)\)\s*(?:(?:readonly|writeonly|restrict)\s+)*buffer\s+(\w+)\s*{([^}]*)}\s*(\w*)\s*;(\s*//\s*(.*))?'
     )
     for match in storage_pattern.finditer(content):
-        binding_index = int(match.group(1))
+        binding_match = re.search(r'binding\s*=\s*(\d+)', match.group(1))
+        if not binding_match:
+            continue
+        binding_index = int(binding_match.group(1))
         var_type = "buffer"
-        var_name = match.group(2)
+        var_name = match.group(4) or match.group(2)
         values.append({
             "type": var_type,
             "binding": binding_index,
             "name": var_name,
-            "stage": ["vertex", "fragment"]
+            "stage": parse_stage(match.group(6)),
+            "count": 1
         })
 
     return values
@@ -352,7 +364,8 @@ class ShaderHeaderGenerator:
             code += f"uint32_t binding;\n"
             code += f"VkDescriptorType desc_type;\n"
             code += f"VkShaderStageFlags stages;\n"
-            code += f"}} {uniform['name']} = {{\"{uniform['type']}\", {uniform['binding']}, {g_glsl_c_desc_type_map.get(uniform['type'])}, {stage_str}}};\n\n"
+            code += f"uint32_t count;\n"
+            code += f"}} {uniform['name']} = {{\"{uniform['type']}\", {uniform['binding']}, {g_glsl_c_desc_type_map.get(uniform['type'])}, {stage_str}, {uniform['count']}}};\n\n"
 
 
         for output in self._output_val:
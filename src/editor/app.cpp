@@ -1,31 +1,43 @@
 #include "app.h"
 
+#include <chrono>
+#include <cstddef>
 #include <cstdlib>
+#include <future>
 #include <memory>
 
 #include "GLFW/glfw3.h"
 #include "document.h"
+#include "imgui.h"
+#include "layer_resource.h"
+#include "memory_report.h"
+#include "render_core/gpu_profiler.h"
 #include "render_core/renderer/renderer.h"
+#include "render_core/upload_batcher.h"
 #include "render_core/vulkan_driver.h"
 #include "tools.hpp"
+#include "trace.hpp"
+
+namespace {
+// frames drawn after input so imgui hover and active states settle
+constexpr int kInputSettleFrames = 3;
+// upper bound on waiting for the render thread to take a snapshot
+constexpr double kRenderWaitSeconds = 0.1;
+}  // namespace
 
 namespace editor {
 void App::AppInitContext() {
   if (!glfwInit()) {
     std::abort();
   }
+  WAIFU_TRACE_SCOPE("App::AppInitContext");
   _gui = std::make_unique<Gui>();
+  _gui->TraceDumpSignal.connect([this]() { DumpTrace(); });
   _gui->DocumentLoadPsdSignal.connect([this](const std::string &path) {
-    auto doc = Document::LoadFromLayerConfig(path);
-    if (doc) {
-      this->OpenDocument(std::move(doc));
-    } else {
-      std::cerr << "Failed to load document from path: " << path << "\n";
-    }
+    this->LoadDocumentAsync(DocumentLoadTask::Source::kLayerConfig, path);
   });
   _gui->DocumentOpenSignal.connect([this](const std::string &path) {
-    auto doc = Document::LoadFromPath(path);
-    this->OpenDocument(std::move(doc));
+    this->LoadDocumentAsync(DocumentLoadTask::Source::kProject, path);
   });
   _gui->DocumentSaveSignal.connect([this]() {
     if (!_current_document) {
@@ -48,6 +60,12 @@ void App::AppInitContext() {
     };
   });
 
+  _gui->ProjectFormatSignal.connect([this](ProjectFormat format) {
+    if (_current_document) {
+      _current_document->SetProjectFormat(format);
+    }
+  });
+
   rdc::VulkanDriverConfig config;
   config.initial_height = 600;
   config.initial_width = 800;
@@ -69,76 +87,296 @@ void App::AppInitContext() {
 
   rdc::VulkanDriver::InitSingleton(config);
   _renderer = std::make_unique<rdc::ApplicationRenderer>();
+  // collected only while the profiler window is open
+  auto *gpu_profiler = rdc::VulkanDriver::GetSingleton()->GetGpuProfiler();
+  gpu_profiler->SetEnabled(false);
+  _render_thread = std::make_unique<RenderThread>(_renderer.get());
+  _scene_sync =
+      std::make_unique<SceneSync>(_render_thread.get(), &_frame_pacer);
+
+  _gui->BindlessDrawSignal.connect([this](bool enabled) {
+    _render_thread->Post([enabled](rdc::ApplicationRenderer &renderer) {
+      renderer.GetModelRenderer()->SetDrawMode(
+          enabled ? rdc::ModelRenderer::DrawMode::kBindlessIndirect
+                  : rdc::ModelRenderer::DrawMode::kPerLayer);
+    });
+  });
+  _gui->ParallelRecordSignal.connect([this](bool enabled) {
+    _render_thread->Post([enabled](rdc::ApplicationRenderer &renderer) {
+      renderer.GetModelRenderer()->SetParallelRecording(enabled);
+    });
+  });
+  _gui->RenderGraphDumpSignal.connect([this]() {
+    _render_thread->Post([](rdc::ApplicationRenderer &renderer) {
+      std::cout << renderer.GetRenderGraph()->Dump();
+    });
+  });
+
+  _gui->GpuProfilerSignal.connect([this, gpu_profiler](bool enabled) {
+    _render_thread->Post([gpu_profiler, enabled](rdc::ApplicationRenderer &) {
+      gpu_profiler->SetEnabled(enabled);
+    });
+  });
+  _gui->GpuProfileExportSignal.connect(
+      [this, gpu_profiler](const std::string &path) {
+        _render_thread->Post(
+            [gpu_profiler, path](rdc::ApplicationRenderer &) {
+              if (gpu_profiler->ExportCsv(path)) {
+                std::cout << "GPU profile exported to " << path << "\n";
+              } else {
+                std::cerr << "Failed to export GPU profile to " << path
+                          << "\n";
+              }
+            });
+      });
+
+  _gui->MemoryReportExportSignal.connect([this](const std::string &path) {
+    // the export button lives in the memory window, the status has the
+    // report while it is open
+    auto report = _render_thread->GetStatus().memory_report;
+    AddDocumentMemory(report, _current_document.get());
+    if (WriteMemoryReport(report, path)) {
+      std::cout << "Memory report written to " << path << "\n";
+    } else {
+      std::cerr << "Failed to write memory report to " << path << "\n";
+    }
+  });
+
+  _gui->LayerVisibleSignal.connect([this](Layer *layer, bool visible) {
+    _current_document->SetLayerVisible(layer, visible);
+  });
+  _gui->LayerMoveSignal.connect([this](Layer *layer, int offset) {
+    auto const index = layer->GetIndexInParent();
+    if (offset < 0 && index < static_cast<size_t>(-offset)) {
+      return;
+    }
+    _current_document->MoveLayer(layer, layer->GetParent(), index + offset);
+  });
+
+  EditorConfig *editor_config = EditorConfig::GetInstance();
+  _frame_pacer.SetMaxFps(editor_config->MaxFps());
+  _frame_pacer.SetIdleEnabled(editor_config->IdleThrottle());
+  _gui->IdleThrottleSignal.connect([this](bool enabled) {
+    _frame_pacer.SetIdleEnabled(enabled);
+    EditorConfig::GetInstance()->IdleThrottle = enabled;
+  });
+  _gui->MaxFpsSignal.connect([this](int max_fps) {
+    _frame_pacer.SetMaxFps(max_fps);
+    EditorConfig::GetInstance()->MaxFps = max_fps;
+  });
 }
 
 App::App(int argc, char **argv) {
-  WaifuUnused(argc, argv);
+  WAIFU_TRACE_THREAD_NAME("main");
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+      _trace_path = argv[++i];
+      _dump_trace_on_exit = true;
+    }
+  }
   AppInitContext();
   EditorConfig *config = EditorConfig::GetInstance();
   if (!config->LastTimeDocumentPath().empty()) {
-    auto doc = Document::LoadFromPath(config->LastTimeDocumentPath());
-    if (doc) {
-      OpenDocument(std::move(doc));
-    } else {
-      std::cerr << "Failed to load document from path: "
-                << config->LastTimeDocumentPath() << "\n";
-    }
+    LoadDocumentAsync(DocumentLoadTask::Source::kProject,
+                      config->LastTimeDocumentPath());
+  }
+}
+void App::LoadDocumentAsync(DocumentLoadTask::Source source,
+                            const std::string &path) {
+  if (_load_task) {
+    std::cerr << "A document is already loading: " << _load_task->GetPath()
+              << "\n";
+    return;
   }
+  _load_task = std::make_unique<DocumentLoadTask>(
+      source, path, _frame_pacer.AcquireWakeLock());
+}
+void App::PollDocumentLoad() {
+  if (!_load_task) {
+    return;
+  }
+  if (!_load_task->IsFinished()) {
+    auto const total = _load_task->GetTotalImages();
+    auto const decoded = _load_task->GetDecodedImages();
+    _gui->SetLoadingStatus(
+        "Decoding images " + std::to_string(decoded) + "/" +
+            std::to_string(total),
+        total == 0 ? 0.0f : static_cast<float>(decoded) / total);
+    return;
+  }
+  _gui->ClearLoadingStatus();
+  auto doc = _load_task->TakeDocument();
+  if (doc) {
+    OpenDocument(std::move(doc));
+  } else {
+    std::cerr << "Failed to load document from path: "
+              << _load_task->GetPath() << "\n";
+  }
+  _load_task.reset();
+}
+void App::UploadPendingLayers() {
+  if (_pending_layers.empty()) {
+    return;
+  }
+  // the resources are created in parallel, take the finished ones that are
+  // next in draw order
+  while (_uploaded_layers < _pending_layers.size() &&
+         _pending_layers[_uploaded_layers].resource.wait_for(
+             std::chrono::seconds(0)) == std::future_status::ready) {
+    auto &pending = _pending_layers[_uploaded_layers];
+    _scene_sync->AddResource(pending.layer, pending.resource.get());
+    ++_uploaded_layers;
+  }
+
+  if (_uploaded_layers == _pending_layers.size()) {
+    _pending_layers.clear();
+    _uploaded_layers = 0;
+    _upload_wake_lock.Release();
+    _gui->ClearLoadingStatus();
+  } else {
+    _gui->SetLoadingStatus(
+        "Uploading layers " + std::to_string(_uploaded_layers) + "/" +
+            std::to_string(_pending_layers.size()),
+        static_cast<float>(_uploaded_layers) / _pending_layers.size());
+  }
+}
+void App::FinishPendingLayers() {
+  // a resource may have uploads recorded, it is released like any other
+  // instead of being destroyed here
+  for (; _uploaded_layers < _pending_layers.size(); ++_uploaded_layers) {
+    auto &pending = _pending_layers[_uploaded_layers];
+    _scene_sync->AddResource(pending.layer, pending.resource.get());
+  }
+  _pending_layers.clear();
+  _uploaded_layers = 0;
+  _upload_wake_lock.Release();
 }
 void App::OpenDocument(std::unique_ptr<Document> doc) {
+  WAIFU_TRACE_SCOPE("App::OpenDocument");
+  FinishPendingLayers();
+  // the old layers are released behind the ones finished above, their images
+  // are reused by the layers of the new document
+  _render_thread->Post(
+      [](rdc::ApplicationRenderer &renderer) { renderer.CloseDocument(); });
+  _scene_sync->Clear();
   _current_document = std::move(doc);
 
-  // layers
-  auto *root_layer = _current_document->GetRootLayer();
-  for (auto it = root_layer->BeginFrontIter(); it != root_layer->EndFrontIter();
-       ++it) {
-    auto *layer = (*it).layer;
-    if (layer->GetType() == kImageLayer) {
-      // handle image
-      auto *image_data = layer->GetLayerData<ImageLayerData>();
-
-      // layer resource
-      rdc::Layer2dResource::ImageConfig image_config;
-      image_config.pimage = image_data->image;
-      std::vector<rdc::ModelVertex> vertices;
-
-      {
-        LazyVector<rdc::ModelVertex> lazy_vertices;
-        lazy_vertices.Resize(image_data->points.size())
-            .SetFunc([image_data](int index) {
-              rdc::ModelVertex result;
-              result.position = image_data->points[index];
-              result.uv = image_data->uvs[index];
-              return result;
-            });
-        vertices = lazy_vertices.ToVector();
-      }
-
-      image_config.vertices = vertices;
-      image_config.indices = image_data->indices;
-      auto layer_resource = rdc::Layer2dResource::CreateFromImage(image_config);
-      _renderer->GetModelRenderer()->AddLayer(layer_resource.get());
-      _renderer->GetResourceManager()->AddResource(std::move(layer_resource));
-    }
+  // image upload and texel conversion of all layers run on the workers,
+  // the driver and the upload batcher are safe to use from there
+  auto *pool = ThreadPool::GetGlobal();
+  for (auto *layer : CollectImageLayers(*_current_document)) {
+    _pending_layers.push_back(
+        {.layer = layer,
+         .resource =
+             pool->Submit([layer]() { return CreateLayerResource(layer); })});
   }
-  auto *model_renderer = _renderer->GetModelRenderer();
-  model_renderer->SetCanvasSize(_current_document->GetCanvasSize().x,
-                                _current_document->GetCanvasSize().y);
-  model_renderer->AutoCenterCanvas();
+  if (!_pending_layers.empty()) {
+    _upload_wake_lock = _frame_pacer.AcquireWakeLock();
+  }
+  auto const canvas_size = _current_document->GetCanvasSize();
+  _render_thread->Post([canvas_size](rdc::ApplicationRenderer &renderer) {
+    auto *model_renderer = renderer.GetModelRenderer();
+    model_renderer->SetCanvasSize(canvas_size.x, canvas_size.y);
+    model_renderer->AutoCenterCanvas();
+  });
 
   // add last time config
   EditorConfig *config = EditorConfig::GetInstance();
   config->LastTimeDocumentPath = _current_document->GetFilePath();
 }
+void App::DumpTrace() const {
+#ifdef WAIFU_ENABLE_TRACE
+  if (WAIFU_TRACE_DUMP(_trace_path)) {
+    std::cout << "Trace written to " << _trace_path << "\n";
+  } else {
+    std::cerr << "Failed to write trace to " << _trace_path << "\n";
+  }
+#else
+  std::cerr << "Tracing is disabled, configure with -DWAIFU_ENABLE_TRACE=ON\n";
+#endif
+}
+
+bool App::HasPendingWork() {
+  // posted changes show up here once the render thread ran them
+  const auto &status = _render_thread->GetStatus();
+  if (status.canvas_dirty) {
+    return true;
+  }
+  // released resources are destroyed by the frames that follow
+  if (status.retired_resources > 0) {
+    return true;
+  }
+  // keep drawing until the uploaded data has reached the screen
+  auto *upload_batcher = rdc::VulkanDriver::GetSingleton()->GetUploadBatcher();
+  return !upload_batcher->IsComplete(upload_batcher->GetSubmittedValue());
+}
+
+void App::PublishSnapshot() {
+  auto &snapshot = _render_thread->GetSnapshot();
+  _gui->GetWindowSize(snapshot.window_width, snapshot.window_height);
+  snapshot.ui.Capture(ImGui::GetDrawData());
+  snapshot.collect_memory_report = _gui->IsMemoryReportVisible();
+  _render_thread->PublishSnapshot();
+}
 
 void App::Exec() {
   while (!glfwWindowShouldClose(_gui->GetWindow())) {
-    glfwPollEvents();
+    _frame_pacer.WaitForEvents(HasPendingWork());
+    bool const input = _gui->GetInputSerial() != _last_input_serial;
+    if (input) {
+      _last_input_serial = _gui->GetInputSerial();
+      _frame_pacer.RequestRedraw(kInputSettleFrames);
+    }
+    if (!_frame_pacer.ShouldRender(HasPendingWork())) {
+      continue;
+    }
+    // a new snapshot would only replace the one the render thread has not
+    // taken yet, unless it carries new input. its next frame wakes us
+    if (!input && _render_thread->IsSnapshotPending()) {
+      glfwWaitEventsTimeout(kRenderWaitSeconds);
+      continue;
+    }
+    _frame_pacer.BeginFrame();
+    PollDocumentLoad();
+    UploadPendingLayers();
+    const auto &status = _render_thread->GetStatus();
+    _gui->SetRenderDebugStatus(
+        status.bindless_supported, status.bindless_enabled,
+        status.parallel_recording, status.record_chunks,
+        status.model_record_ms, status.drawn_layers, status.total_layers);
+    _gui->SetFramePacingStatus(_frame_pacer.GetStats(),
+                               _frame_pacer.IsIdleEnabled(),
+                               _frame_pacer.GetMaxFps());
+    _gui->SetGpuProfileStatus(status.gpu_profiler_supported,
+                              status.gpu_history, status.gpu_dropped_scopes);
+    if (_gui->IsMemoryReportVisible()) {
+      auto report = status.memory_report;
+      AddDocumentMemory(report, _current_document.get());
+      _gui->SetMemoryReport(std::move(report));
+    }
+    // the workers read the layers until their resources are created
+    bool const editable = _current_document && _pending_layers.empty();
+    _gui->SetLayerTree(editable ? _current_document->GetRootLayer() : nullptr);
+    if (_current_document) {
+      _gui->SetProjectFormat(_current_document->GetProjectFormat());
+    }
     _gui->TickGui();
-    _renderer->Render();
+    if (editable) {
+      _scene_sync->Sync(*_current_document);
+    }
+    PublishSnapshot();
+    _frame_pacer.EndFrame();
   }
 }
 App::~App() {
+  if (_dump_trace_on_exit) {
+    DumpTrace();
+  }
+  _load_task.reset();
+  FinishPendingLayers();
+  // resources of added layers still being built are released like the rest
+  _scene_sync->Clear();
+  _render_thread.reset();
   _renderer.reset();
   _gui.reset();
 
@@ -1,22 +1,68 @@
 #ifndef EDITOR_APP_H_
 #define EDITOR_APP_H_
+#include <future>
 #include <memory>
+#include <vector>
 #include "document.h"
+#include "document_loader.h"
+#include "frame_pacer.h"
 #include "gui.h"
 #include "render_core/renderer/renderer.h"
+#include "render_thread.h"
+#include "scene_sync.h"
 namespace editor {
 class App {
   void AppInitContext();
 
+  // first, so it outlives the wake locks held by the members below
+  FramePacer _frame_pacer;
   std::unique_ptr<Gui> _gui;
   std::unique_ptr<rdc::ApplicationRenderer> _renderer;
+  // owns the renderer while it runs, reach it through Post
+  std::unique_ptr<RenderThread> _render_thread;
   std::unique_ptr<Document> _current_document;
+  // follows the document's edits with the renderer's layers
+  std::unique_ptr<SceneSync> _scene_sync;
+
+  // document being loaded in the background
+  std::unique_ptr<DocumentLoadTask> _load_task;
+  // gpu resources of the current document's image layers, created on worker
+  // threads and handed to the renderer in draw order
+  struct PendingLayer {
+    Layer* layer;
+    std::future<std::unique_ptr<rdc::Layer2dResource>> resource;
+  };
+  std::vector<PendingLayer> _pending_layers;
+  size_t _uploaded_layers = 0;
+  // held while _pending_layers is not empty
+  FramePacer::WakeLock _upload_wake_lock;
+
+  uint64_t _last_input_serial = 0;
+  // cpu trace destination, written on exit when given with --trace
+  std::string _trace_path = "waifu_trace.json";
+  bool _dump_trace_on_exit = false;
+
+  void LoadDocumentAsync(DocumentLoadTask::Source source,
+                         const std::string& path);
+  void PollDocumentLoad();
+  void UploadPendingLayers();
+  // blocks until every pending resource is created and handed to the
+  // renderer, no worker reads the current document afterwards
+  void FinishPendingLayers();
+  // redraws and uploads on the render thread that need frames to finish.
+  // loading and resource creation hold wake locks instead
+  bool HasPendingWork();
+  // hand the ui built this frame to the render thread
+  void PublishSnapshot();
+  void DumpTrace() const;
 
  public:
   explicit App(int argc, char** argv);
   void OpenDocument(std::unique_ptr<Document> doc);
 
   void Exec();
+  // for animations and simulations that must keep frames coming
+  FramePacer* GetFramePacer() { return &_frame_pacer; }
   ~App();
 };
 }  // namespace editor
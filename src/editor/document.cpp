@@ -1,17 +1,90 @@
 #include "document.h"
 
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <stack>
 
+#include "editor/project_format.h"
 #include "editor/types.hpp"
 #include "layer.h"
+#include "trace.hpp"
+
+namespace {
+// rebuilds the layer tree from layers listed in front iter order with their
+// depth, the root itself sits at depth -1
+class LayerTreeBuilder {
+  std::stack<std::pair<editor::Layer *, int>> _layer_stack;
+  std::pair<editor::Layer *, int> _pre_layer;
+
+ public:
+  explicit LayerTreeBuilder(editor::Layer *root) : _pre_layer{root, -1} {}
+
+  // false when depth does not continue the tree: above the root, more than
+  // one level below the previous layer or under a layer without children.
+  // new_layer is dropped then
+  bool Push(std::unique_ptr<editor::Layer> new_layer, int depth) {
+    if (depth < 0 || depth > _pre_layer.second + 1) {
+      return false;
+    }
+    if (_pre_layer.second < depth) {
+      // deeper
+      if (!_pre_layer.first->HasChild()) {
+        return false;
+      }
+      _layer_stack.push(_pre_layer);
+      auto *new_layer_ptr = new_layer.release();
+      _pre_layer.first->AddChild(new_layer_ptr);
+      _pre_layer = {new_layer_ptr, depth};
+      return true;
+    }
+    // same depth or shallower
+    while (!_layer_stack.empty() && _pre_layer.second > depth) {
+      _pre_layer = _layer_stack.top();
+      _layer_stack.pop();
+    }
+    if (_layer_stack.empty()) {
+      return false;
+    }
+    auto *new_layer_ptr = new_layer.release();
+    _layer_stack.top().first->AddChild(new_layer_ptr);
+    _pre_layer = {new_layer_ptr, depth};
+    return true;
+  }
+};
+
+bool IsBinaryProject(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[sizeof(editor::project_format::kMagic)] = {};
+  if (!file.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return memcmp(magic, editor::project_format::kMagic, sizeof(magic)) == 0;
+}
+
+void WritePadding(std::ostream &stream, uint64_t current, uint64_t target) {
+  static constexpr char zeros[editor::project_format::kProjectBlobAlignment] =
+      {};
+  assert(target >= current && target - current <= sizeof(zeros));
+  stream.write(zeros, static_cast<std::streamsize>(target - current));
+}
+}  // namespace
 
 namespace editor {
-std::unique_ptr<Document> Document::LoadFromPath(const std::string &path) {
+std::unique_ptr<Document> Document::LoadFromPath(
+    const std::string &path, const LoadProgressCallback &progress) {
+  WAIFU_TRACE_SCOPE("Document::LoadFromPath");
+  if (IsBinaryProject(path)) {
+    return LoadFromBinaryPath(path, progress);
+  }
   std::unique_ptr<Document> result = std::make_unique<Document>();
   result->_file_path = path;
+  result->_project_format = ProjectFormat::kJson;
   std::ifstream proj_file(path);
   if (!proj_file.is_open()) {
     return nullptr;
@@ -25,18 +98,14 @@ std::unique_ptr<Document> Document::LoadFromPath(const std::string &path) {
       DocumentImage doc_image;
       doc_image.image_id = image_json.at("id").get<int>();
       doc_image.rel_path = image_json.at("rel_path").get<std::string>();
-      // load image data
-      std::filesystem::path image_path =
-          std::filesystem::path(result->_file_path).parent_path();
-      image_path = image_path / doc_image.rel_path;
-      auto image = std::make_unique<CPUImage>();
-      image->LoadFromFile(image_path.string());
-      if (!image->IsValid()) {
-        return nullptr;  // Failed to load image
-      }
-      doc_image.image = std::move(image);
       result->_images_container.push_back(std::move(doc_image));
     }
+    // load image data
+    if (!result->DecodeImages(
+            std::filesystem::path(result->_file_path).parent_path(),
+            progress)) {
+      return nullptr;  // Failed to load image
+    }
   }
 
   // board
@@ -46,8 +115,7 @@ std::unique_ptr<Document> Document::LoadFromPath(const std::string &path) {
     {
       auto root =
           std::make_unique<Layer>("Root", std::make_unique<DirLayerData>());
-      std::stack<std::pair<Layer *, int>> layer_stack;
-      std::pair<Layer *, int> pre_layer = {root.get(), -1};
+      LayerTreeBuilder builder(root.get());
 
       for (const auto &layer : proj_json.at("board").at("layer")) {
         auto new_layer = std::make_unique<Layer>();
@@ -64,27 +132,8 @@ std::unique_ptr<Document> Document::LoadFromPath(const std::string &path) {
 
         new_layer->SetLayerData(std::move(new_layer_data));
         // add child
-        if (pre_layer.second < depth) {
-          // deeper
-          layer_stack.push(pre_layer);
-          auto *new_layer_ptr = new_layer.release();
-          pre_layer.first->AddChild(new_layer_ptr);
-          pre_layer = {new_layer_ptr, depth};
-
-        } else if (pre_layer.second == depth) {
-          // same depth
-          auto *new_layer_ptr = new_layer.release();
-          layer_stack.top().first->AddChild(new_layer_ptr);
-          pre_layer.first = new_layer_ptr;
-        } else if (pre_layer.second > depth) {
-          // shallower
-          while (!layer_stack.empty() && pre_layer.second > depth) {
-            pre_layer = layer_stack.top();
-            layer_stack.pop();
-          }
-          auto *new_layer_ptr = new_layer.release();
-          layer_stack.top().first->AddChild(new_layer_ptr);
-          pre_layer = {new_layer_ptr, depth};
+        if (!builder.Push(std::move(new_layer), depth)) {
+          return nullptr;
         }
       }
       // set root
@@ -93,8 +142,116 @@ std::unique_ptr<Document> Document::LoadFromPath(const std::string &path) {
   }
   return result;
 }
+std::unique_ptr<Document> Document::LoadFromBinaryPath(
+    const std::string &path, const LoadProgressCallback &progress) {
+  namespace pf = project_format;
+  auto mapped = MappedFile::Open(path);
+  if (!mapped || mapped->Size() < sizeof(pf::ProjectHeader)) {
+    return nullptr;
+  }
+  const auto *base = mapped->Data();
+  const auto file_size = static_cast<uint64_t>(mapped->Size());
+  const auto *header = reinterpret_cast<const pf::ProjectHeader *>(base);
+  if (memcmp(header->magic, pf::kMagic, sizeof(pf::kMagic)) != 0 ||
+      header->version != pf::kVersion || header->file_size != file_size) {
+    return nullptr;
+  }
+  auto in_file = [file_size](uint64_t offset, uint64_t size) {
+    return offset <= file_size && size <= file_size - offset;
+  };
+  if (!in_file(header->image_table_offset,
+               sizeof(pf::ProjectImageEntry) * header->image_count) ||
+      !in_file(header->layer_table_offset,
+               sizeof(pf::ProjectLayerEntry) * header->layer_count) ||
+      !in_file(header->string_table_offset, header->string_table_size)) {
+    return nullptr;
+  }
+  const auto *strings =
+      reinterpret_cast<const char *>(base + header->string_table_offset);
+  auto get_string = [&](const pf::ProjectString &str) -> std::string {
+    if (uint64_t{str.offset} + str.size > header->string_table_size) {
+      return {};
+    }
+    return {strings + str.offset, str.size};
+  };
+
+  auto result = std::make_unique<Document>();
+  result->_file_path = path;
+  result->_project_format = ProjectFormat::kBinary;
+  result->_canvas_size = {static_cast<float>(header->canvas_width),
+                          static_cast<float>(header->canvas_height)};
+
+  // image
+  {
+    const auto *image_table = reinterpret_cast<const pf::ProjectImageEntry *>(
+        base + header->image_table_offset);
+    for (uint32_t i = 0; i < header->image_count; ++i) {
+      DocumentImage doc_image;
+      doc_image.image_id = image_table[i].image_id;
+      doc_image.rel_path = get_string(image_table[i].rel_path);
+      result->_images_container.push_back(std::move(doc_image));
+    }
+    if (!result->DecodeImages(
+            std::filesystem::path(result->_file_path).parent_path(),
+            progress)) {
+      return nullptr;  // Failed to load image
+    }
+  }
+
+  // board
+  {
+    const auto *layer_table = reinterpret_cast<const pf::ProjectLayerEntry *>(
+        base + header->layer_table_offset);
+    auto root =
+        std::make_unique<Layer>("Root", std::make_unique<DirLayerData>());
+    LayerTreeBuilder builder(root.get());
+    for (uint32_t i = 0; i < header->layer_count; ++i) {
+      const auto &entry = layer_table[i];
+      auto new_layer = std::make_unique<Layer>();
+      new_layer->SetLayerName(get_string(entry.name));
+      if (entry.type == kImageLayer) {
+        auto image_data = std::make_unique<ImageLayerData>();
+        if (entry.image_id < 0 ||
+            entry.image_id >=
+                static_cast<int32_t>(result->_images_container.size()) ||
+            !in_file(entry.vertex_offset,
+                     sizeof(MeshVertex) * uint64_t{entry.vertex_count}) ||
+            !in_file(entry.index_offset,
+                     sizeof(uint32_t) * uint64_t{entry.index_count}) ||
+            entry.vertex_offset % pf::kProjectBlobAlignment != 0 ||
+            entry.index_offset % pf::kProjectBlobAlignment != 0) {
+          return nullptr;
+        }
+        image_data->image_id = entry.image_id;
+        image_data->image =
+            result->_images_container[entry.image_id].image.get();
+        image_data->is_visible = entry.is_visible != 0;
+        // zero copy, the spans point into the mapping
+        image_data->mapped_vertices = {
+            reinterpret_cast<const MeshVertex *>(base + entry.vertex_offset),
+            entry.vertex_count};
+        image_data->mapped_indices = {
+            reinterpret_cast<const uint32_t *>(base + entry.index_offset),
+            entry.index_count};
+        new_layer->SetLayerData(std::move(image_data));
+      } else if (entry.type == kDirLayer) {
+        new_layer->SetLayerData(std::make_unique<DirLayerData>());
+      } else {
+        return nullptr;
+      }
+      // a corrupt depth would attach the layer anywhere
+      if (entry.depth > static_cast<uint32_t>(INT_MAX) ||
+          !builder.Push(std::move(new_layer), static_cast<int>(entry.depth))) {
+        return nullptr;
+      }
+    }
+    result->_doc_root_layer = std::move(root);
+  }
+  result->_mapped_project = std::move(mapped);
+  return result;
+}
 std::unique_ptr<Document> Document::LoadFromLayerConfig(
-    const std::string &config_path) {
+    const std::string &config_path, const LoadProgressCallback &progress) {
   try {
     auto config_dir = std::filesystem::path(config_path).parent_path();
     auto result = std::make_unique<Document>();
@@ -114,20 +271,18 @@ std::unique_ptr<Document> Document::LoadFromLayerConfig(
       config_file >> layer_config;
     }
 
+    std::vector<ImageLayerData *> image_layers;
     for (const auto &layer : layer_config["layers"]) {
       std::string file_path = layer["path"];
       file_path = (config_dir / file_path).string();
 
-      std::unique_ptr<CPUImage> image = std::make_unique<CPUImage>();
-      image->LoadFromFile(file_path);
-
       // doc layer build
       std::string layer_name = layer.at("name");
       auto *doc_layer = new Layer();
       doc_layer->SetLayerName(layer_name);
       auto meta_data = std::make_unique<ImageLayerData>();
-      meta_data->image = image.get();
       meta_data->image_id = result->_images_container.size();
+      image_layers.push_back(meta_data.get());
       meta_data->is_visible = true;
 
       auto vertex_struct = layer["vertices"];
@@ -151,12 +306,19 @@ std::unique_ptr<Document> Document::LoadFromLayerConfig(
       // result->_images_container.push_back(std::move(image));
 
       DocumentImage doc_image;
-      doc_image.image = std::move(image);
       doc_image.image_id = result->_images_container.size();
       doc_image.rel_path =
           std::filesystem::relative(file_path, config_dir).string();
       result->_images_container.push_back(std::move(doc_image));
     }
+    if (!result->DecodeImages(config_dir, progress)) {
+      std::cerr << "Failed to load layer image \n";
+      return nullptr;
+    }
+    for (auto *image_layer : image_layers) {
+      image_layer->image =
+          result->_images_container[image_layer->image_id].image.get();
+    }
     {
       result->_canvas_size.x = layer_config["canvas"]["width"].get<int>();
       result->_canvas_size.y = layer_config["canvas"]["height"].get<int>();
@@ -168,12 +330,55 @@ std::unique_ptr<Document> Document::LoadFromLayerConfig(
     return nullptr;
   }
 }
-bool Document::SaveProject() const {
-  // if not create file, create it
-  std::ofstream proj_file(_file_path);
-  if (!proj_file.is_open()) {
-    return false;
+bool Document::DecodeImages(const std::filesystem::path &base_dir,
+                            const LoadProgressCallback &progress) {
+  // stb_image keeps no shared state, so every image decodes on its own
+  // worker and lands in its own slot, keeping the container order
+  std::atomic_bool failed = false;
+  std::atomic_size_t decoded = 0;
+  size_t const total = _images_container.size();
+  ThreadPool::GetGlobal()->ParallelFor(
+      total, [&, this](size_t index) {
+        if (failed.load(std::memory_order_relaxed)) {
+          return;
+        }
+        auto &doc_image = _images_container[index];
+        auto image = std::make_unique<CPUImage>();
+        image->LoadFromFile((base_dir / doc_image.rel_path).string());
+        if (!image->IsValid()) {
+          failed.store(true, std::memory_order_relaxed);
+          return;
+        }
+        doc_image.image = std::move(image);
+        if (progress) {
+          progress(decoded.fetch_add(1) + 1, total);
+        }
+      });
+  return !failed.load();
+}
+std::vector<Document::ImageMemory> Document::GetImageMemory() const {
+  std::vector<ImageMemory> result;
+  result.reserve(_images_container.size());
+  for (const auto &doc_image : _images_container) {
+    result.push_back({
+        .rel_path = doc_image.rel_path,
+        .bytes = doc_image.image ? doc_image.image->GetByteSize() : 0,
+    });
+  }
+  return result;
+}
+bool Document::SaveImages() const {
+  for (const auto &doc_image : _images_container) {
+    std::filesystem::path path =
+        std::filesystem::path(_file_path).parent_path();
+    path = path / doc_image.rel_path;
+    if (!std::filesystem::exists(path)) {
+      doc_image.image->SaveToFile(path.string());
+    }
   }
+  return true;
+}
+bool Document::WriteJsonProject(std::ostream &stream) const {
   nlohmann::json proj_config;
 
   // image part
@@ -182,14 +387,6 @@ bool Document::SaveProject() const {
       nlohmann::json image_json;
       image_json["id"] = doc_image.image_id;
       image_json["rel_path"] = doc_image.rel_path;
-      // save image data
-      std::filesystem::path path =
-          std::filesystem::path(_file_path).parent_path();
-      path = path / doc_image.rel_path;
-      if (!std::filesystem::exists(path)) {
-        doc_image.image->SaveToFile(path.string());
-      }
-
       proj_config["images"].push_back(image_json);
     }
   }
@@ -212,8 +409,232 @@ bool Document::SaveProject() const {
       proj_config["board"]["layer"].push_back(layer_json);
     }
   }
-  proj_file << proj_config.dump(4);
-  return true;
+  stream << proj_config.dump(4);
+  return stream.good();
+}
+bool Document::WriteBinaryProject(std::ostream &stream) const {
+  namespace pf = project_format;
+  std::string string_table;
+  auto add_string = [&string_table](const std::string &str) {
+    pf::ProjectString result = {
+        .offset = static_cast<uint32_t>(string_table.size()),
+        .size = static_cast<uint32_t>(str.size()),
+    };
+    string_table += str;
+    return result;
+  };
+
+  std::vector<pf::ProjectImageEntry> image_table;
+  for (const auto &doc_image : _images_container) {
+    image_table.push_back({
+        .image_id = doc_image.image_id,
+        .rel_path = add_string(doc_image.rel_path),
+        .reserved = 0,
+    });
+  }
+
+  // the document root is implicit, its children are stored from depth 0
+  std::vector<pf::ProjectLayerEntry> layer_table;
+  std::vector<const ImageLayerData *> layer_meshes;
+  for (auto it = _doc_root_layer->BeginFrontIter();
+       it != _doc_root_layer->EndFrontIter(); ++it) {
+    const auto &element = it.get();
+    if (element.layer == _doc_root_layer.get()) {
+      continue;
+    }
+    pf::ProjectLayerEntry entry = {};
+    entry.name = add_string(element.layer->GetLayerName());
+    entry.depth = static_cast<uint32_t>(element.depth - 1);
+    entry.type = element.layer->GetType();
+    entry.image_id = -1;
+    const ImageLayerData *mesh = nullptr;
+    if (element.layer->GetType() == kImageLayer) {
+      mesh = element.layer->GetLayerData<ImageLayerData>();
+      entry.image_id = mesh->image_id;
+      entry.is_visible = mesh->is_visible() ? 1 : 0;
+      entry.vertex_count = static_cast<uint32_t>(mesh->VertexCount());
+      entry.index_count = static_cast<uint32_t>(
+          mesh->HasMappedMesh() ? mesh->mapped_indices.size()
+                                : mesh->indices.size());
+    }
+    layer_table.push_back(entry);
+    layer_meshes.push_back(mesh);
+  }
+
+  // layout
+  pf::ProjectHeader header = {};
+  memcpy(header.magic, pf::kMagic, sizeof(pf::kMagic));
+  header.version = pf::kVersion;
+  header.canvas_width = static_cast<uint32_t>(_canvas_size.x);
+  header.canvas_height = static_cast<uint32_t>(_canvas_size.y);
+  header.image_count = static_cast<uint32_t>(image_table.size());
+  header.layer_count = static_cast<uint32_t>(layer_table.size());
+  header.image_table_offset = sizeof(pf::ProjectHeader);
+  header.layer_table_offset =
+      header.image_table_offset +
+      sizeof(pf::ProjectImageEntry) * image_table.size();
+  header.string_table_offset =
+      header.layer_table_offset +
+      sizeof(pf::ProjectLayerEntry) * layer_table.size();
+  header.string_table_size = string_table.size();
+  uint64_t offset = header.string_table_offset + header.string_table_size;
+  for (auto &entry : layer_table) {
+    offset = pf::AlignBlob(offset);
+    entry.vertex_offset = offset;
+    offset += sizeof(MeshVertex) * uint64_t{entry.vertex_count};
+    offset = pf::AlignBlob(offset);
+    entry.index_offset = offset;
+    offset += sizeof(uint32_t) * uint64_t{entry.index_count};
+  }
+  header.file_size = offset;
+
+  // write
+  stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  stream.write(reinterpret_cast<const char *>(image_table.data()),
+               static_cast<std::streamsize>(sizeof(pf::ProjectImageEntry) *
+                                            image_table.size()));
+  stream.write(reinterpret_cast<const char *>(layer_table.data()),
+               static_cast<std::streamsize>(sizeof(pf::ProjectLayerEntry) *
+                                            layer_table.size()));
+  stream.write(string_table.data(),
+               static_cast<std::streamsize>(string_table.size()));
+  offset = header.string_table_offset + header.string_table_size;
+  std::vector<MeshVertex> vertices;
+  for (size_t i = 0; i < layer_table.size(); ++i) {
+    const auto &entry = layer_table[i];
+    const auto *mesh = layer_meshes[i];
+    WritePadding(stream, offset, entry.vertex_offset);
+    const MeshVertex *vertex_data = nullptr;
+    const uint32_t *index_data = nullptr;
+    if (mesh != nullptr && mesh->HasMappedMesh()) {
+      vertex_data = mesh->mapped_vertices.data();
+      index_data = mesh->mapped_indices.data();
+    } else if (mesh != nullptr) {
+      vertices.resize(mesh->points.size());
+      for (size_t v = 0; v < vertices.size(); ++v) {
+        vertices[v] = {.position = mesh->points[v], .uv = mesh->uvs[v]};
+      }
+      vertex_data = vertices.data();
+      index_data = mesh->indices.data();
+    }
+    stream.write(reinterpret_cast<const char *>(vertex_data),
+                 static_cast<std::streamsize>(sizeof(MeshVertex) *
+                                              entry.vertex_count));
+    offset = entry.vertex_offset + sizeof(MeshVertex) * entry.vertex_count;
+    WritePadding(stream, offset, entry.index_offset);
+    stream.write(
+        reinterpret_cast<const char *>(index_data),
+        static_cast<std::streamsize>(sizeof(uint32_t) * entry.index_count));
+    offset = entry.index_offset + sizeof(uint32_t) * entry.index_count;
+  }
+  return stream.good();
+}
+void Document::DetachMappedProject() {
+  if (!_mapped_project) {
+    return;
+  }
+  for (auto it = _doc_root_layer->BeginFrontIter();
+       it != _doc_root_layer->EndFrontIter(); ++it) {
+    auto *layer = it.get().layer;
+    if (layer->GetType() == kImageLayer) {
+      layer->GetLayerData<ImageLayerData>()->DetachMappedMesh();
+    }
+  }
+  _mapped_project.reset();
+}
+bool Document::SaveProject() {
+  // write next to the target first, the old file may still be mapped
+  std::string const temp_path = _file_path + ".tmp";
+  // a failed save leaves the old project as it was and nothing next to it
+  auto const discard_temp = [&temp_path]() {
+    std::error_code error;
+    std::filesystem::remove(temp_path, error);
+    return false;
+  };
+  {
+    std::ofstream proj_file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!proj_file.is_open()) {
+      return discard_temp();
+    }
+    bool const written = _project_format == ProjectFormat::kBinary
+                             ? WriteBinaryProject(proj_file)
+                             : WriteJsonProject(proj_file);
+    proj_file.close();
+    if (!written || proj_file.fail()) {
+      return discard_temp();
+    }
+  }
+  DetachMappedProject();
+  std::error_code error;
+  std::filesystem::rename(temp_path, _file_path, error);
+  if (error) {
+    return discard_temp();
+  }
+  return SaveImages();
+}
+void Document::RecordSubtree(LayerChange::Type type, Layer *layer) {
+  for (auto it = layer->BeginFrontIter(); it != layer->EndFrontIter(); ++it) {
+    auto *child = it.get().layer;
+    if (child->GetType() == kImageLayer) {
+      _changes.push_back({.type = type, .layer = child});
+    }
+  }
+}
+void Document::SetLayerVisible(Layer *layer, bool visible) {
+  if (layer->GetType() == kImageLayer) {
+    auto *data = layer->GetLayerData<ImageLayerData>();
+    if (data->is_visible() == visible) {
+      return;
+    }
+    data->is_visible = visible;
+    _changes.push_back(
+        {.type = LayerChange::Type::kVisibility, .layer = layer});
+  }
+}
+void Document::SetLayerName(Layer *layer, const std::string &name) {
+  layer->SetLayerName(name);
+  _changes.push_back({.type = LayerChange::Type::kName, .layer = layer});
+}
+void Document::SetLayerPositions(Layer *layer, uint32_t first,
+                                 std::span<const glm::vec2> positions) {
+  auto *data = layer->GetLayerData<ImageLayerData>();
+  // the mapped mesh is read only
+  data->DetachMappedMesh();
+  assert(first + positions.size() <= data->points.size());
+  std::copy(positions.begin(), positions.end(), data->points.begin() + first);
+  _changes.push_back({.type = LayerChange::Type::kVertices,
+                      .layer = layer,
+                      .first = first,
+                      .count = static_cast<uint32_t>(positions.size())});
+}
+void Document::SetLayerMesh(Layer *layer, std::vector<glm::vec2> points,
+                            std::vector<glm::vec2> uvs,
+                            std::vector<uint32_t> indices) {
+  auto *data = layer->GetLayerData<ImageLayerData>();
+  data->mapped_vertices = {};
+  data->mapped_indices = {};
+  data->points = std::move(points);
+  data->uvs = std::move(uvs);
+  data->indices = std::move(indices);
+  _changes.push_back({.type = LayerChange::Type::kMesh, .layer = layer});
+}
+void Document::MoveLayer(Layer *layer, Layer *parent, size_t index) {
+  layer->GetParent()->RemoveChild(layer);
+  parent->InsertChild(index, layer);
+  RecordSubtree(LayerChange::Type::kMoved, layer);
+}
+Layer *Document::InsertLayer(Layer *parent, size_t index,
+                             std::unique_ptr<Layer> layer) {
+  auto *result = layer.release();
+  parent->InsertChild(index, result);
+  RecordSubtree(LayerChange::Type::kAdded, result);
+  return result;
+}
+void Document::RemoveLayer(Layer *layer) {
+  assert(layer != _doc_root_layer.get() && "Cannot remove the root layer");
+  RecordSubtree(LayerChange::Type::kRemoved, layer);
+  layer->GetParent()->RemoveChild(layer);
+  delete layer;
 }
 Document::Document() = default;
 Document::~Document() = default;
@@ -230,6 +651,8 @@ EditorConfig::EditorConfig() {
     SafeGetProperty(config_json, "last_time_win_height", LastTimeWinHeight);
     SafeGetProperty(config_json, "last_time_document_path",
                     LastTimeDocumentPath);
+    SafeGetProperty(config_json, "max_fps", MaxFps);
+    SafeGetProperty(config_json, "idle_throttle", IdleThrottle);
   }
 }
 
@@ -242,6 +665,8 @@ void EditorConfig::SaveConfig() const {
     config_json["last_time_win_width"] = LastTimeWinWidth();
     config_json["last_time_win_height"] = LastTimeWinHeight();
     config_json["last_time_document_path"] = LastTimeDocumentPath();
+    config_json["max_fps"] = MaxFps();
+    config_json["idle_throttle"] = IdleThrottle();
     config_file << config_json.dump(4);
   }
 }
@@ -1,12 +1,46 @@
 #ifndef EDITOR_DOCUMENT_H_
 #define EDITOR_DOCUMENT_H_
+#include <filesystem>
+#include <functional>
 #include <memory>
+#include <span>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "layer.h"
+#include "mapped_file.h"
 #include "tools.hpp"
 namespace editor {
 
+enum class ProjectFormat : uint8_t {
+  kJson,
+  kBinary,
+};
+
+// reports decoded images out of the total, called from worker threads
+using LoadProgressCallback = std::function<void(size_t done, size_t total)>;
+
+// one edit of the layer tree, recorded per image layer it affects. after a
+// kRemoved the layer is deleted and the pointer is only good as a key
+struct LayerChange {
+  enum class Type : uint8_t {
+    kAdded,
+    kRemoved,
+    kMoved,
+    kVisibility,
+    kName,
+    // vertices [first, first + count) moved, topology unchanged
+    kVertices,
+    // points, uvs and indices were replaced
+    kMesh,
+  };
+  Type type;
+  Layer* layer;
+  uint32_t first = 0;
+  uint32_t count = 0;
+};
+
 class Document {
   std::string _file_path;
   std::unique_ptr<Layer> _doc_root_layer = nullptr;
@@ -18,17 +52,66 @@ class Document {
   };
 
   std::vector<DocumentImage> _images_container;
+  // new and imported documents save as json, binary projects stay binary
+  ProjectFormat _project_format = ProjectFormat::kJson;
+  // backing memory of the mapped meshes of a binary project
+  std::unique_ptr<MappedFile> _mapped_project;
+  // edits since the last TakeChanges, in the order they were made
+  std::vector<LayerChange> _changes;
+
+  static std::unique_ptr<Document> LoadFromBinaryPath(
+      const std::string& path, const LoadProgressCallback& progress);
+  // decode every image of the container relative to base_dir on the worker
+  // pool, false if any of them failed
+  bool DecodeImages(const std::filesystem::path& base_dir,
+                    const LoadProgressCallback& progress);
+  // records a change of type for every image layer in the subtree of layer
+  void RecordSubtree(LayerChange::Type type, Layer* layer);
+  bool SaveImages() const;
+  bool WriteJsonProject(std::ostream& stream) const;
+  bool WriteBinaryProject(std::ostream& stream) const;
+  void DetachMappedProject();
 
  public:
-  static std::unique_ptr<Document> LoadFromPath(const std::string& path);
+  // loads either project format, the binary one is detected by its magic
+  static std::unique_ptr<Document> LoadFromPath(
+      const std::string& path, const LoadProgressCallback& progress = nullptr);
   static std::unique_ptr<Document> LoadFromLayerConfig(
-      const std::string& config_path);
+      const std::string& config_path,
+      const LoadProgressCallback& progress = nullptr);
   Layer* GetRootLayer() const { return _doc_root_layer.get(); }
   glm::vec2 GetCanvasSize() const { return _canvas_size; }
   std::string GetFilePath() const { return _file_path; }
   void SetSavePath(const std::string& path) { _file_path = path; }
+  struct ImageMemory {
+    std::string rel_path;
+    size_t bytes = 0;
+  };
+  // decoded pixels held for every image of the document
+  std::vector<ImageMemory> GetImageMemory() const;
+  ProjectFormat GetProjectFormat() const { return _project_format; }
+  void SetProjectFormat(ProjectFormat format) { _project_format = format; }
 
-  bool SaveProject() const;
+  // edits of the layer tree go through the document, which journals them so
+  // the renderer can follow with only the deltas
+  void SetLayerVisible(Layer* layer, bool visible);
+  void SetLayerName(Layer* layer, const std::string& name);
+  // overwrite the positions of vertices [first, first + positions.size())
+  void SetLayerPositions(Layer* layer, uint32_t first,
+                         std::span<const glm::vec2> positions);
+  void SetLayerMesh(Layer* layer, std::vector<glm::vec2> points,
+                    std::vector<glm::vec2> uvs, std::vector<uint32_t> indices);
+  // moves layer with its subtree under parent, index is taken after layer
+  // was detached
+  void MoveLayer(Layer* layer, Layer* parent, size_t index);
+  // the images of its image layers must belong to this document
+  Layer* InsertLayer(Layer* parent, size_t index, std::unique_ptr<Layer> layer);
+  // deletes layer with its subtree, never the root
+  void RemoveLayer(Layer* layer);
+  // the journal since the last call, consumed once per frame by SceneSync
+  std::vector<LayerChange> TakeChanges() { return std::exchange(_changes, {}); }
+
+  bool SaveProject();
   Document();
   ~Document();
 };
@@ -63,6 +146,10 @@ class EditorConfig : public NoCopyable {
 
   Property<std::string> LastTimeDocumentPath{""};
 
+  // 0 means uncapped
+  Property<int> MaxFps{60};
+  Property<bool> IdleThrottle{true};
+
   void SaveConfig() const;
 };
 }  // namespace editor
@@ -0,0 +1,46 @@
+#include "document_loader.h"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+namespace editor {
+DocumentLoadTask::DocumentLoadTask(Source source, const std::string& path,
+                                   FramePacer::WakeLock wake_lock)
+    : _path(path), _wake_lock(std::move(wake_lock)) {
+  _future = ThreadPool::GetGlobal()->Submit([this, source]() {
+    auto progress = [this](size_t done, size_t total) {
+      _total_images.store(total);
+      _decoded_images.store(std::max(done, _decoded_images.load()));
+    };
+    if (source == Source::kLayerConfig) {
+      return Document::LoadFromLayerConfig(_path, progress);
+    }
+    return Document::LoadFromPath(_path, progress);
+  });
+}
+DocumentLoadTask::~DocumentLoadTask() {
+  if (_future.valid()) {
+    _future.wait();
+  }
+}
+bool DocumentLoadTask::IsFinished() const {
+  return _future.valid() && _future.wait_for(std::chrono::seconds(0)) ==
+                                std::future_status::ready;
+}
+void DocumentLoadTask::Wait() const {
+  if (_future.valid()) {
+    _future.wait();
+  }
+}
+std::unique_ptr<Document> DocumentLoadTask::TakeDocument() {
+  assert(IsFinished() && "document is still loading");
+  try {
+    return _future.get();
+  } catch (const std::exception& e) {
+    std::cerr << "Failed to load document: " << e.what() << "\n";
+    return nullptr;
+  }
+}
+}  // namespace editor
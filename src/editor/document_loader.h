@@ -0,0 +1,48 @@
+#ifndef EDITOR_DOCUMENT_LOADER_H_
+#define EDITOR_DOCUMENT_LOADER_H_
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+
+#include "document.h"
+#include "frame_pacer.h"
+#include "tools.hpp"
+
+namespace editor {
+
+// loads a document on the worker pool, the main loop polls it each frame
+class DocumentLoadTask : public NoCopyable {
+ public:
+  enum class Source : uint8_t {
+    kProject,
+    kLayerConfig,
+  };
+
+ private:
+  std::string _path;
+  std::atomic_size_t _decoded_images = 0;
+  std::atomic_size_t _total_images = 0;
+  std::future<std::unique_ptr<Document>> _future;
+  // keeps the progress on screen until the task is dropped
+  FramePacer::WakeLock _wake_lock;
+
+ public:
+  DocumentLoadTask(Source source, const std::string& path,
+                   FramePacer::WakeLock wake_lock);
+  // the worker references this task, wait for it before going away
+  ~DocumentLoadTask() override;
+
+  const std::string& GetPath() const { return _path; }
+  bool IsFinished() const;
+  // block until the worker is done
+  void Wait() const;
+  // only valid once finished, null if the document failed to load
+  std::unique_ptr<Document> TakeDocument();
+  size_t GetDecodedImages() const { return _decoded_images.load(); }
+  size_t GetTotalImages() const { return _total_images.load(); }
+};
+
+}  // namespace editor
+
+#endif  // EDITOR_DOCUMENT_LOADER_H_
@@ -0,0 +1,114 @@
+#include "frame_pacer.h"
+
+#include <GLFW/glfw3.h>
+
+#include <thread>
+
+namespace {
+// upper bound on a blocking wait, keeps imgui timers such as tooltips and
+// the text cursor from stalling forever
+constexpr double kIdleWaitSeconds = 0.5;
+}  // namespace
+
+namespace editor {
+
+FramePacer::WakeLock::WakeLock(FramePacer *pacer) : _pacer(pacer) {
+  _pacer->_wake_locks.fetch_add(1);
+  // the main loop may be blocked waiting for input
+  glfwPostEmptyEvent();
+}
+FramePacer::WakeLock::WakeLock(WakeLock &&other) noexcept
+    : _pacer(other._pacer) {
+  other._pacer = nullptr;
+}
+FramePacer::WakeLock &FramePacer::WakeLock::operator=(
+    WakeLock &&other) noexcept {
+  if (this != &other) {
+    Release();
+    _pacer = other._pacer;
+    other._pacer = nullptr;
+  }
+  return *this;
+}
+FramePacer::WakeLock::~WakeLock() { Release(); }
+void FramePacer::WakeLock::Release() {
+  if (_pacer) {
+    _pacer->_wake_locks.fetch_sub(1);
+    _pacer = nullptr;
+  }
+}
+
+bool FramePacer::IsActive(bool busy) const {
+  return busy || !_idle_enabled || _redraw_frames > 0 ||
+         _wake_locks.load() > 0;
+}
+
+void FramePacer::WaitForEvents(bool busy) {
+  if (!IsActive(busy)) {
+    _waited_idle = true;
+    glfwWaitEventsTimeout(kIdleWaitSeconds);
+    return;
+  }
+  if (_max_fps > 0 && _has_last_frame) {
+    auto const slot = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / _max_fps));
+    std::this_thread::sleep_until(_last_frame_begin + slot);
+  }
+  glfwPollEvents();
+}
+
+bool FramePacer::ShouldRender(bool busy) {
+  bool const render = IsActive(busy);
+  if (!render) {
+    ++_stats.idle_wakeups;
+  }
+  _stats.idle = !render;
+  return render;
+}
+
+void FramePacer::BeginFrame() {
+  _frame_begin = Clock::now();
+  if (_redraw_frames > 0) {
+    --_redraw_frames;
+  }
+}
+
+void FramePacer::EndFrame() {
+  auto const now = Clock::now();
+  float const work_ms =
+      std::chrono::duration<float, std::milli>(now - _frame_begin).count();
+  // the first frame after an idle wait would report the whole gap
+  if (_has_last_frame && !_waited_idle) {
+    float const frame_ms = std::chrono::duration<float, std::milli>(
+                               _frame_begin - _last_frame_begin)
+                               .count();
+    UpdateStats(frame_ms, work_ms);
+  }
+  ++_stats.rendered_frames;
+  _last_frame_begin = _frame_begin;
+  _has_last_frame = true;
+  _waited_idle = false;
+}
+
+void FramePacer::UpdateStats(float frame_ms, float work_ms) {
+  _frame_ms_history[_history_head] = frame_ms;
+  _work_ms_history[_history_head] = work_ms;
+  _history_head = (_history_head + 1) % kHistorySize;
+  _history_count = std::min(_history_count + 1, kHistorySize);
+
+  float frame_sum = 0.0f;
+  float work_sum = 0.0f;
+  float frame_max = 0.0f;
+  for (size_t i = 0; i < _history_count; ++i) {
+    frame_sum += _frame_ms_history[i];
+    work_sum += _work_ms_history[i];
+    frame_max = std::max(frame_max, _frame_ms_history[i]);
+  }
+  auto const count = static_cast<float>(_history_count);
+  _stats.frame_ms = frame_sum / count;
+  _stats.work_ms = work_sum / count;
+  _stats.frame_ms_max = frame_max;
+  _stats.fps = _stats.frame_ms > 0.0f ? 1000.0f / _stats.frame_ms : 0.0f;
+}
+
+}  // namespace editor
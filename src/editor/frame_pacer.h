@@ -0,0 +1,97 @@
+#ifndef EDITOR_FRAME_PACER_H_
+#define EDITOR_FRAME_PACER_H_
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "tools.hpp"
+
+namespace editor {
+
+// decides when the main loop produces a frame. while anything is active
+// frames are paced to the fps cap, otherwise the loop blocks in
+// glfwWaitEventsTimeout until input arrives
+class FramePacer : public NoCopyable {
+  using Clock = std::chrono::steady_clock;
+
+ public:
+  struct Stats {
+    float fps = 0.0f;
+    // interval between consecutive rendered frames, idle gaps excluded
+    float frame_ms = 0.0f;
+    float frame_ms_max = 0.0f;
+    // time spent producing a frame, the rest of the interval is waiting
+    float work_ms = 0.0f;
+    uint64_t rendered_frames = 0;
+    // wakeups that turned out to have nothing to draw
+    uint64_t idle_wakeups = 0;
+    bool idle = false;
+  };
+
+  // keeps frames coming while alive, held by animations, simulations and
+  // background jobs. may be acquired and released from any thread
+  class WakeLock {
+    FramePacer *_pacer = nullptr;
+
+   public:
+    WakeLock() = default;
+    explicit WakeLock(FramePacer *pacer);
+    WakeLock(const WakeLock &) = delete;
+    WakeLock &operator=(const WakeLock &) = delete;
+    WakeLock(WakeLock &&other) noexcept;
+    WakeLock &operator=(WakeLock &&other) noexcept;
+    ~WakeLock();
+    bool IsHeld() const { return _pacer != nullptr; }
+    void Release();
+  };
+
+ private:
+  static constexpr size_t kHistorySize = 120;
+
+  int _max_fps = 60;
+  bool _idle_enabled = true;
+  std::atomic_int _wake_locks = 0;
+  // frames still to render regardless of activity, e.g. for imgui to settle
+  int _redraw_frames = 1;
+  bool _waited_idle = false;
+
+  Clock::time_point _frame_begin;
+  Clock::time_point _last_frame_begin;
+  bool _has_last_frame = false;
+
+  std::array<float, kHistorySize> _frame_ms_history = {};
+  std::array<float, kHistorySize> _work_ms_history = {};
+  size_t _history_head = 0;
+  size_t _history_count = 0;
+  Stats _stats;
+
+  bool IsActive(bool busy) const;
+  void UpdateStats(float frame_ms, float work_ms);
+
+ public:
+  // 0 disables the cap
+  void SetMaxFps(int fps) { _max_fps = std::max(fps, 0); }
+  int GetMaxFps() const { return _max_fps; }
+  // when disabled frames are produced continuously at the cap
+  void SetIdleEnabled(bool enabled) { _idle_enabled = enabled; }
+  bool IsIdleEnabled() const { return _idle_enabled; }
+
+  void RequestRedraw(int frames = 1) {
+    _redraw_frames = std::max(_redraw_frames, frames);
+  }
+  [[nodiscard]] WakeLock AcquireWakeLock() { return WakeLock(this); }
+
+  // busy is true while the caller has work in progress. sleeps until the
+  // next frame slot and polls events, or blocks for input when idle
+  void WaitForEvents(bool busy);
+  // whether a frame should be produced after the last wait
+  bool ShouldRender(bool busy);
+  void BeginFrame();
+  void EndFrame();
+  const Stats &GetStats() const { return _stats; }
+};
+
+}  // namespace editor
+
+#endif  // EDITOR_FRAME_PACER_H_
@@ -6,28 +6,75 @@
 #include <imgui.h>
 #include <portable-file-dialogs.h>
 
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <iostream>
 #include <nlohmann/json.hpp>
+#include <vector>
 
 #include "document.h"
+#include "render_core/gpu_profiler.h"
 #include "render_core/vulkan_driver.h"
 #include "tools.hpp"
+#include "trace.hpp"
+
+namespace {
+// frame time of a top level scope over the profiler history, 0 where a
+// frame did not record it
+std::vector<float> CollectScopeSeries(
+    const std::deque<rdc::GpuFrameTimings> &history, const char *name) {
+  std::vector<float> series;
+  series.reserve(history.size());
+  for (const auto &frame : history) {
+    float ms = 0.0f;
+    for (const auto &scope : frame.scopes) {
+      if (scope.depth == 0 && std::strcmp(scope.name, name) == 0) {
+        ms += scope.ms;
+      }
+    }
+    series.push_back(ms);
+  }
+  return series;
+}
+
+std::string FormatBytes(uint64_t bytes) {
+  char text[32];
+  if (bytes >= (uint64_t{1} << 30)) {
+    std::snprintf(text, sizeof(text), "%.2f GiB",
+                  static_cast<double>(bytes) / (1 << 30));
+  } else if (bytes >= (uint64_t{1} << 20)) {
+    std::snprintf(text, sizeof(text), "%.2f MiB",
+                  static_cast<double>(bytes) / (1 << 20));
+  } else {
+    std::snprintf(text, sizeof(text), "%.1f KiB",
+                  static_cast<double>(bytes) / (1 << 10));
+  }
+  return text;
+}
+}  // namespace
 
 namespace editor {
 
 void Gui::WindowResizeCallback(GLFWwindow *window, int width, int height) {
   auto *gui = static_cast<Gui *>(glfwGetWindowUserPointer(window));
   if (gui) {
+    ++gui->_input_serial;
     gui->WindowResizeSignal(width, height);
   };
-  auto *driver = rdc::VulkanDriver::GetSingleton();
-  if (driver) {
-    driver->MarkSwapchainInvalid();
-  }
+  // the swapchain belongs to the render thread, it sees the new size in the
+  // next snapshot
 }
 void Gui::WindowPosCallback(GLFWwindow *window, int x, int y) {
 
 }
+void Gui::MarkInput(GLFWwindow *window) {
+  auto *gui = static_cast<Gui *>(glfwGetWindowUserPointer(window));
+  if (gui) {
+    ++gui->_input_serial;
+  }
+}
 
 Gui::Gui() {
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -61,6 +108,31 @@ Gui::Gui() {
   // set resize callback
   glfwSetWindowUserPointer(_window, this);
   glfwSetWindowSizeCallback(_window, WindowResizeCallback);
+  // the main loop sleeps while idle and redraws when any of these fire.
+  // imgui installs its callbacks after these and chains to them
+  glfwSetCursorPosCallback(_window, [](GLFWwindow *window, double, double) {
+    MarkInput(window);
+  });
+  glfwSetMouseButtonCallback(_window, [](GLFWwindow *window, int, int, int) {
+    MarkInput(window);
+  });
+  glfwSetScrollCallback(_window, [](GLFWwindow *window, double, double) {
+    MarkInput(window);
+  });
+  glfwSetKeyCallback(_window, [](GLFWwindow *window, int, int, int, int) {
+    MarkInput(window);
+  });
+  glfwSetCharCallback(_window, [](GLFWwindow *window, unsigned int) {
+    MarkInput(window);
+  });
+  glfwSetCursorEnterCallback(_window, [](GLFWwindow *window, int) {
+    MarkInput(window);
+  });
+  glfwSetWindowFocusCallback(_window, [](GLFWwindow *window, int) {
+    MarkInput(window);
+  });
+  glfwSetWindowRefreshCallback(_window,
+                               [](GLFWwindow *window) { MarkInput(window); });
   {
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -102,9 +174,13 @@ Gui::~Gui() {
 }
 
 void Gui::TickGui() {
+  WAIFU_TRACE_SCOPE("Gui::TickGui");
   ImGui_ImplGlfw_NewFrame();
   ImGui_ImplVulkan_NewFrame();
   ImGui::NewFrame();
+  if (ImGui::IsKeyPressed(ImGuiKey_F12, false)) {
+    TraceDumpSignal();
+  }
 
   // main window
   {
@@ -150,6 +226,64 @@ void Gui::TickGui() {
         if (ImGui::MenuItem(WaifuTr("Save"), "Ctrl+S")) {
           DocumentSaveSignal();
         }
+        bool binary = _project_format == ProjectFormat::kBinary;
+        if (ImGui::MenuItem(WaifuTr("Binary Project Format"), nullptr,
+                            &binary)) {
+          ProjectFormatSignal(binary ? ProjectFormat::kBinary
+                                     : ProjectFormat::kJson);
+        }
+        ImGui::EndMenu();
+      }
+      if (ImGui::BeginMenu(WaifuTr("Render"))) {
+        bool bindless = _render_debug_status.bindless_enabled;
+        if (ImGui::MenuItem(WaifuTr("Bindless Indirect Draw"), nullptr,
+                            &bindless,
+                            _render_debug_status.bindless_supported)) {
+          BindlessDrawSignal(bindless);
+        }
+        bool parallel = _render_debug_status.parallel_recording;
+        if (ImGui::MenuItem(WaifuTr("Parallel Recording"), nullptr,
+                            &parallel)) {
+          ParallelRecordSignal(parallel);
+        }
+        ImGui::Text(WaifuTr("Model record: %.3f ms"),
+                    _render_debug_status.model_record_ms);
+        ImGui::Text(WaifuTr("Record chunks: %u"),
+                    _render_debug_status.record_chunks);
+        ImGui::Text(WaifuTr("Drawn layers: %u/%u"),
+                    _render_debug_status.drawn_layers,
+                    _render_debug_status.total_layers);
+        if (ImGui::MenuItem(WaifuTr("Dump Render Graph"))) {
+          RenderGraphDumpSignal();
+        }
+
+        ImGui::Separator();
+        bool idle = _frame_pacing_status.idle_enabled;
+        if (ImGui::MenuItem(WaifuTr("Idle Throttle"), nullptr, &idle)) {
+          IdleThrottleSignal(idle);
+        }
+        int max_fps = _frame_pacing_status.max_fps;
+        if (ImGui::SliderInt(WaifuTr("FPS Cap"), &max_fps, 0, 240,
+                             max_fps == 0 ? WaifuTr("Uncapped") : "%d")) {
+          MaxFpsSignal(max_fps);
+        }
+        const auto &stats = _frame_pacing_status.stats;
+        ImGui::Text(WaifuTr("FPS: %.1f"), stats.fps);
+        ImGui::Text(WaifuTr("Frame: %.2f ms (max %.2f ms)"), stats.frame_ms,
+                    stats.frame_ms_max);
+        ImGui::Text(WaifuTr("Work: %.2f ms"), stats.work_ms);
+        ImGui::Text(WaifuTr("Frames: %llu, idle wakeups: %llu"),
+                    static_cast<unsigned long long>(stats.rendered_frames),
+                    static_cast<unsigned long long>(stats.idle_wakeups));
+
+        ImGui::Separator();
+        if (ImGui::MenuItem(WaifuTr("GPU Profiler"), nullptr,
+                            &_show_gpu_profiler,
+                            _gpu_profile_status.supported)) {
+          GpuProfilerSignal(_show_gpu_profiler);
+        }
+        ImGui::MenuItem(WaifuTr("Memory Report"), nullptr,
+                        &_show_memory_report);
         ImGui::EndMenu();
       }
 
@@ -159,16 +293,251 @@ void Gui::TickGui() {
     ImGuiID dockspace_id = ImGui::GetID(main_window_name);
     ImGui::DockSpace(dockspace_id, ImVec2(0.0f, 0.0f),
                      ImGuiDockNodeFlags_PassthruCentralNode);
+    ImGuiID layer_panel_dock = 0;
     {
       ImGui::Begin("Layer panel");
-
+      layer_panel_dock = ImGui::GetWindowDockID();
+      DrawLayerPanel();
       ImGui::End();
     }
+    if (_show_gpu_profiler) {
+      // opens as a tab next to the layer panel, later moves are kept
+      if (layer_panel_dock != 0) {
+        ImGui::SetNextWindowDockID(layer_panel_dock, ImGuiCond_FirstUseEver);
+      }
+      DrawGpuProfiler();
+    }
+    if (_show_memory_report) {
+      if (layer_panel_dock != 0) {
+        ImGui::SetNextWindowDockID(layer_panel_dock, ImGuiCond_FirstUseEver);
+      }
+      DrawMemoryReport();
+    }
+    ImGui::End();
+  }
+  if (_loading_status.active) {
+    const ImGuiViewport *viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(
+        ImVec2(viewport->WorkPos.x + viewport->WorkSize.x - 10.0f,
+               viewport->WorkPos.y + viewport->WorkSize.y - 10.0f),
+        ImGuiCond_Always, ImVec2(1.0f, 1.0f));
+    ImGui::Begin("##Loading", nullptr,
+                 ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoDocking |
+                     ImGuiWindowFlags_AlwaysAutoResize |
+                     ImGuiWindowFlags_NoSavedSettings |
+                     ImGuiWindowFlags_NoFocusOnAppearing |
+                     ImGuiWindowFlags_NoNav);
+    ImGui::TextUnformatted(_loading_status.text.c_str());
+    ImGui::ProgressBar(_loading_status.progress, ImVec2(300.0f, 0.0f));
     ImGui::End();
   }
   {
     // ImGui::ShowMetricsWindow();
   }
+  ImGui::Render();
+}
+void Gui::DrawLayerPanel() {
+  if (!_layer_root) {
+    ImGui::TextUnformatted(WaifuTr("No document"));
+    return;
+  }
+  DrawLayerTree(_layer_root);
+  if (_layer_move.layer) {
+    LayerMoveSignal(_layer_move.layer, _layer_move.offset);
+    _layer_move = {};
+  }
+}
+void Gui::DrawLayerTree(Layer *layer) {
+  auto children = layer->GetChild();
+  // front most first, the way they stack on the canvas
+  for (size_t i = children.size(); i-- > 0;) {
+    auto *child = children[i];
+    ImGui::PushID(child);
+    ImGui::BeginDisabled(i + 1 == children.size());
+    if (ImGui::ArrowButton("##up", ImGuiDir_Up)) {
+      _layer_move = {.layer = child, .offset = 1};
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::BeginDisabled(i == 0);
+    if (ImGui::ArrowButton("##down", ImGuiDir_Down)) {
+      _layer_move = {.layer = child, .offset = -1};
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    auto const name = child->GetLayerName();
+    if (child->GetType() == kImageLayer) {
+      bool visible = child->GetLayerData<ImageLayerData>()->is_visible();
+      if (ImGui::Checkbox("##visible", &visible)) {
+        LayerVisibleSignal(child, visible);
+      }
+      ImGui::SameLine();
+      ImGui::TreeNodeEx(name.c_str(), ImGuiTreeNodeFlags_Leaf |
+                                          ImGuiTreeNodeFlags_NoTreePushOnOpen);
+    } else if (ImGui::TreeNodeEx(name.c_str(),
+                                 ImGuiTreeNodeFlags_DefaultOpen)) {
+      DrawLayerTree(child);
+      ImGui::TreePop();
+    }
+    ImGui::PopID();
+  }
+}
+void Gui::DrawGpuProfiler() {
+  bool open = true;
+  bool const visible = ImGui::Begin(WaifuTr("GPU Profiler"), &open);
+  if (!open) {
+    _show_gpu_profiler = false;
+    GpuProfilerSignal(false);
+  }
+  if (!visible) {
+    ImGui::End();
+    return;
+  }
+  const auto &history = _gpu_profile_status.history;
+  if (ImGui::Button(WaifuTr("Export CSV"))) {
+    auto file = pfd::save_file(WaifuTr("Export CSV"), "gpu_profile.csv",
+                               {"CSV File", "*.csv"});
+    auto path = file.result();
+    if (!path.empty()) {
+      GpuProfileExportSignal(path);
+    }
+  }
+  if (history.empty()) {
+    ImGui::TextUnformatted(WaifuTr("Waiting for frames..."));
+  } else {
+    std::vector<float> totals;
+    totals.reserve(history.size());
+    float total_sum = 0.0f;
+    for (const auto &frame : history) {
+      totals.push_back(frame.total_ms);
+      total_sum += frame.total_ms;
+    }
+    float const width = ImGui::GetContentRegionAvail().x;
+    char overlay[64];
+    std::snprintf(overlay, sizeof(overlay), "frame %.3f ms (avg %.3f ms)",
+                  totals.back(), total_sum / totals.size());
+    ImGui::PlotLines("##frame", totals.data(),
+                     static_cast<int>(totals.size()), 0, overlay, 0.0f,
+                     FLT_MAX, ImVec2(width, 80.0f));
+    for (const char *pass : {"canvas pass", "canvas composite", "ui"}) {
+      auto const series = CollectScopeSeries(history, pass);
+      std::snprintf(overlay, sizeof(overlay), "%s %.3f ms", pass,
+                    series.back());
+      ImGui::PlotLines(pass, series.data(), static_cast<int>(series.size()),
+                       0, overlay, 0.0f, FLT_MAX, ImVec2(width, 50.0f));
+    }
+
+    // scopes of the latest frame, nested scopes indented
+    const auto &latest = history.back();
+    if (ImGui::BeginTable("##scopes", 2,
+                          ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY)) {
+      ImGui::TableSetupColumn(WaifuTr("Scope"));
+      ImGui::TableSetupColumn(WaifuTr("ms"), ImGuiTableColumnFlags_WidthFixed);
+      ImGui::TableHeadersRow();
+      for (const auto &scope : latest.scopes) {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Indent(scope.depth * 12.0f + 1.0f);
+        if (scope.index >= 0) {
+          ImGui::Text("%s #%d", scope.name, scope.index);
+        } else {
+          ImGui::TextUnformatted(scope.name);
+        }
+        ImGui::Unindent(scope.depth * 12.0f + 1.0f);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", scope.ms);
+      }
+      ImGui::EndTable();
+    }
+  }
+  if (_gpu_profile_status.dropped_scopes > 0) {
+    ImGui::Text(WaifuTr("Dropped scopes: %u"),
+                _gpu_profile_status.dropped_scopes);
+  }
+  ImGui::End();
+}
+void Gui::DrawMemoryReport() {
+  if (!ImGui::Begin(WaifuTr("Memory Report"), &_show_memory_report)) {
+    ImGui::End();
+    return;
+  }
+  const auto &report = _memory_report;
+  if (ImGui::Button(WaifuTr("Export JSON"))) {
+    auto file = pfd::save_file(WaifuTr("Export JSON"), "memory_report.json",
+                               {"JSON File", "*.json"});
+    auto path = file.result();
+    if (!path.empty()) {
+      MemoryReportExportSignal(path);
+    }
+  }
+  ImGui::Text(WaifuTr("Last frame: %s uploaded, %u draw calls"),
+              FormatBytes(report.last_frame.uploaded_bytes).c_str(),
+              report.last_frame.draw_calls);
+
+  ImGui::SeparatorText(report.memory_budget ? WaifuTr("Heaps")
+                                            : WaifuTr("Heaps (estimated)"));
+  for (size_t i = 0; i < report.heaps.size(); ++i) {
+    const auto &heap = report.heaps[i];
+    bool const device_local =
+        (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    std::string const overlay = FormatBytes(heap.usage) + " / " +
+                                FormatBytes(heap.budget);
+    ImGui::Text("%zu %s", i, device_local ? "device" : "host");
+    ImGui::SameLine();
+    ImGui::ProgressBar(
+        heap.budget == 0 ? 0.0f
+                         : static_cast<float>(heap.usage) / heap.budget,
+        ImVec2(-1.0f, 0.0f), overlay.c_str());
+    ImGui::Text(WaifuTr("  vma: %s in %u allocations, %s in %u blocks"),
+                FormatBytes(heap.allocation_bytes).c_str(),
+                heap.allocation_count, FormatBytes(heap.block_bytes).c_str(),
+                heap.block_count);
+  }
+
+  ImGui::SeparatorText(WaifuTr("Layers"));
+  ImGui::Text(WaifuTr("%zu layers, images %s, meshes %s"),
+              report.layers.size(),
+              FormatBytes(report.layer_image_bytes).c_str(),
+              FormatBytes(report.layer_buffer_bytes).c_str());
+  ImGui::Text(WaifuTr("Image pool: %zu images, %s, %llu hits, %llu misses"),
+              report.image_pool.pooled_images,
+              FormatBytes(report.image_pool.pooled_bytes).c_str(),
+              static_cast<unsigned long long>(report.image_pool.hits),
+              static_cast<unsigned long long>(report.image_pool.misses));
+  if (ImGui::TreeNode(WaifuTr("Layer resources"))) {
+    if (ImGui::BeginTable("##layers", 4, ImGuiTableFlags_RowBg)) {
+      ImGui::TableSetupColumn(WaifuTr("Layer"));
+      ImGui::TableSetupColumn(WaifuTr("Image"));
+      ImGui::TableSetupColumn(WaifuTr("Mips"));
+      ImGui::TableSetupColumn(WaifuTr("Mesh"));
+      ImGui::TableHeadersRow();
+      for (const auto &layer : report.layers) {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(layer.name.c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(FormatBytes(layer.image_bytes).c_str());
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", layer.mip_levels);
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(FormatBytes(layer.buffer_bytes).c_str());
+      }
+      ImGui::EndTable();
+    }
+    ImGui::TreePop();
+  }
+
+  ImGui::SeparatorText(WaifuTr("CPU images"));
+  ImGui::Text(WaifuTr("%zu images, %s"), report.cpu_images.size(),
+              FormatBytes(report.cpu_image_bytes).c_str());
+  if (ImGui::TreeNode(WaifuTr("Decoded images"))) {
+    for (const auto &image : report.cpu_images) {
+      ImGui::Text("%s  %s", FormatBytes(image.bytes).c_str(),
+                  image.path.c_str());
+    }
+    ImGui::TreePop();
+  }
+  ImGui::End();
 }
 void Gui::GetWindowSize(int &width, int &height) const {
   if (_window) {
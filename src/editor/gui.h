@@ -1,20 +1,70 @@
 #ifndef EDITOR_GUI_H_
 #define EDITOR_GUI_H_
+#include <deque>
 #include <string>
 #include <GLFW/glfw3.h>
 
 #include <sigslot/signal.hpp>
 
+#include "frame_pacer.h"
+#include "memory_report.h"
+#include "render_core/gpu_profiler.h"
 
 namespace editor {
 class Gui {
   GLFWwindow *_window = nullptr;
+  struct LoadingStatus {
+    bool active = false;
+    std::string text;
+    float progress = 0.0f;
+  } _loading_status;
+  struct RenderDebugStatus {
+    bool bindless_supported = false;
+    bool bindless_enabled = false;
+    bool parallel_recording = false;
+    // secondary command buffers of the last canvas pass, 0 when inline
+    uint32_t record_chunks = 0;
+    float model_record_ms = 0.0f;
+    // hidden layers are not drawn
+    uint32_t drawn_layers = 0;
+    uint32_t total_layers = 0;
+  } _render_debug_status;
+  struct FramePacingStatus {
+    FramePacer::Stats stats;
+    bool idle_enabled = true;
+    int max_fps = 0;
+  } _frame_pacing_status;
+  // bumped by every window and input event
+  uint64_t _input_serial = 0;
+  struct GpuProfileStatus {
+    bool supported = false;
+    std::deque<rdc::GpuFrameTimings> history;
+    uint32_t dropped_scopes = 0;
+  } _gpu_profile_status;
+  bool _show_gpu_profiler = false;
+  MemoryReport _memory_report;
+  bool _show_memory_report = false;
+  // tree of the layer panel, null while there is nothing to edit
+  Layer *_layer_root = nullptr;
+  // format the open document is saved in, checked in the file menu
+  ProjectFormat _project_format = ProjectFormat::kJson;
+  // a move reshapes the tree, it is signaled once the tree was drawn
+  struct LayerMove {
+    Layer *layer = nullptr;
+    int offset = 0;
+  } _layer_move;
   static void WindowResizeCallback(GLFWwindow *window, int width, int height);
   static void WindowPosCallback(GLFWwindow *window, int x, int y);
+  static void MarkInput(GLFWwindow *window);
+  void DrawGpuProfiler();
+  void DrawMemoryReport();
+  void DrawLayerPanel();
+  void DrawLayerTree(Layer *layer);
 
  public:
   Gui();
   ~Gui();
+  // builds the frame up to ImGui::Render, ImGui::GetDrawData holds it after
   void TickGui();
 
   GLFWwindow *GetWindow() const { return _window; }
@@ -22,12 +72,74 @@ class Gui {
   VkResult CreateVulkanSurface(VkInstance instance,
                                VkSurfaceKHR &surface) const;
   static std::string OpenSaveDialog();
+  // progress bar shown while a document loads, progress in [0, 1]
+  void SetLoadingStatus(const std::string &text, float progress) {
+    _loading_status = {.active = true, .text = text, .progress = progress};
+  }
+  void ClearLoadingStatus() { _loading_status.active = false; }
+  // shown in the render menu for comparing draw paths
+  void SetRenderDebugStatus(bool bindless_supported, bool bindless_enabled,
+                            bool parallel_recording, uint32_t record_chunks,
+                            float model_record_ms, uint32_t drawn_layers,
+                            uint32_t total_layers) {
+    _render_debug_status = {.bindless_supported = bindless_supported,
+                            .bindless_enabled = bindless_enabled,
+                            .parallel_recording = parallel_recording,
+                            .record_chunks = record_chunks,
+                            .model_record_ms = model_record_ms,
+                            .drawn_layers = drawn_layers,
+                            .total_layers = total_layers};
+  }
+  void SetFramePacingStatus(const FramePacer::Stats &stats, bool idle_enabled,
+                            int max_fps) {
+    _frame_pacing_status = {
+        .stats = stats, .idle_enabled = idle_enabled, .max_fps = max_fps};
+  }
+  // source of the gpu profiler window, the history is only needed while it
+  // is open
+  void SetGpuProfileStatus(bool supported,
+                           const std::deque<rdc::GpuFrameTimings> &history,
+                           uint32_t dropped_scopes) {
+    _gpu_profile_status.supported = supported;
+    _gpu_profile_status.history = history;
+    _gpu_profile_status.dropped_scopes = dropped_scopes;
+  }
+  bool IsGpuProfilerVisible() const { return _show_gpu_profiler; }
+  // shown in the memory window, only needed while it is open
+  bool IsMemoryReportVisible() const { return _show_memory_report; }
+  void SetMemoryReport(MemoryReport report) {
+    _memory_report = std::move(report);
+  }
+  // the layers shown in the layer panel, only read during TickGui
+  void SetLayerTree(Layer *root) { _layer_root = root; }
+  void SetProjectFormat(ProjectFormat format) { _project_format = format; }
+  // changes whenever input arrived since the last call
+  uint64_t GetInputSerial() const { return _input_serial; }
 
   // signals
   sigslot::signal<int, int> WindowResizeSignal;
   sigslot::signal<const std::string&> DocumentOpenSignal;
   sigslot::signal<const std::string&> DocumentLoadPsdSignal;
   sigslot::signal<> DocumentSaveSignal;
+  // the format the next save writes, binary projects load without a copy
+  sigslot::signal<ProjectFormat> ProjectFormatSignal;
+  sigslot::signal<bool> BindlessDrawSignal;
+  sigslot::signal<bool> ParallelRecordSignal;
+  // print the passes and barriers of the last frame's render graph
+  sigslot::signal<> RenderGraphDumpSignal;
+  sigslot::signal<bool> IdleThrottleSignal;
+  // 0 means uncapped
+  sigslot::signal<int> MaxFpsSignal;
+  // the profiler window was shown or hidden
+  sigslot::signal<bool> GpuProfilerSignal;
+  sigslot::signal<const std::string &> GpuProfileExportSignal;
+  sigslot::signal<const std::string &> MemoryReportExportSignal;
+  // edits from the layer panel, offset moves a layer among its siblings,
+  // positive toward the front
+  sigslot::signal<Layer *, bool> LayerVisibleSignal;
+  sigslot::signal<Layer *, int> LayerMoveSignal;
+  // F12, write the cpu trace
+  sigslot::signal<> TraceDumpSignal;
 };
 }  // namespace editor
 
@@ -1,5 +1,6 @@
 #include "layer.h"
 
+#include <algorithm>
 #include <any>
 #include <memory>
 #include <vector>
@@ -48,6 +49,40 @@ std::span<Layer*> Layer::GetChild() {
   assert(HasChild() && "Layer does not have child");
   return _child;
 }
+void Layer::InsertChild(size_t index, Layer* child) {
+  assert(HasChild() && "Layer does not support child");
+  child->_parent = this;
+  index = std::min(index, _child.size());
+  _child.insert(_child.begin() + index, child);
+  RenumberChildren(index);
+}
+void Layer::RemoveChild(Layer* child) {
+  assert(child->_parent == this && "Layer is not a child");
+  auto const index = child->_index_in_parent;
+  _child.erase(_child.begin() + index);
+  RenumberChildren(index);
+  child->_parent = nullptr;
+  child->_index_in_parent = 0;
+}
+void Layer::RenumberChildren(size_t first) {
+  for (size_t i = first; i < _child.size(); ++i) {
+    _child[i]->_index_in_parent = i;
+  }
+}
+Layer* Layer::GetNextLayer(bool skip_children) const {
+  if (!skip_children && HasChild() && !_child.empty()) {
+    return _child.front();
+  }
+  // the next sibling of the closest ancestor that has one
+  for (const auto* layer = this; layer->_parent; layer = layer->_parent) {
+    auto siblings = layer->_parent->GetChild();
+    auto const index = layer->GetIndexInParent();
+    if (index + 1 < siblings.size()) {
+      return siblings[index + 1];
+    }
+  }
+  return nullptr;
+}
 void Layer::SetLayerData(std::unique_ptr<LayerData> meta_data) {
   _meta_data = std::move(meta_data);
 }
@@ -103,6 +138,22 @@ namespace editor {
 void ImageLayerData::Serialize(nlohmann::json& json) const {
   json["image_id"] = image_id;
   json["is_visible"] = is_visible();
+  if (HasMappedMesh()) {
+    std::vector<float> tmp_pos;
+    std::vector<float> tmp_uv;
+    tmp_pos.reserve(mapped_vertices.size() * 2);
+    tmp_uv.reserve(mapped_vertices.size() * 2);
+    for (const auto& vertex : mapped_vertices) {
+      tmp_pos.push_back(vertex.position.x);
+      tmp_pos.push_back(vertex.position.y);
+      tmp_uv.push_back(vertex.uv.x);
+      tmp_uv.push_back(vertex.uv.y);
+    }
+    json["points"] = tmp_pos;
+    json["uv"] = tmp_uv;
+    json["indices"] = mapped_indices;
+    return;
+  }
   std::vector<float> tmp_pos(points.size() * 2);
   std::vector<float> tmp_uv(points.size() * 2);
   memcpy(tmp_pos.data(), points.data(), points.size() * 2 * sizeof(float));
@@ -123,4 +174,18 @@ void ImageLayerData::Deserialize(const nlohmann::json& json) {
   memcpy(uvs.data(), uvs_array.data(), uvs_array.size() * sizeof(float));
   indices = json["indices"].get<std::vector<uint32_t>>();
 }
-}  // namespace editor
\ No newline at end of file
+void ImageLayerData::DetachMappedMesh() {
+  if (!HasMappedMesh()) {
+    return;
+  }
+  points.resize(mapped_vertices.size());
+  uvs.resize(mapped_vertices.size());
+  for (size_t i = 0; i < mapped_vertices.size(); ++i) {
+    points[i] = mapped_vertices[i].position;
+    uvs[i] = mapped_vertices[i].uv;
+  }
+  indices.assign(mapped_indices.begin(), mapped_indices.end());
+  mapped_vertices = {};
+  mapped_indices = {};
+}
+}  // namespace editor
@@ -34,9 +34,15 @@ class LayerData {
 
 class Layer {
   std::vector<Layer*> _child;
+  Layer* _parent = nullptr;
+  // kept by the parent's AddChild, InsertChild and RemoveChild
+  size_t _index_in_parent = 0;
   std::unique_ptr<LayerData> _meta_data = nullptr;
   std::string _layer_name;
 
+  // refresh the stored index of the children from first on
+  void RenumberChildren(size_t first);
+
  public:
   Layer();
   Layer(const std::string& layer_name, std::unique_ptr<LayerData> meta_data);
@@ -47,8 +53,21 @@ class Layer {
   std::span<Layer*> GetChild();
   void AddChild(Layer* child) {
     assert(HasChild() && "Layer does not support child");
+    child->_parent = this;
+    child->_index_in_parent = _child.size();
     _child.push_back(child);
   }
+  // index is clamped to the child count, takes the ownership of child
+  void InsertChild(size_t index, Layer* child);
+  // detaches child with its subtree, the caller owns it afterwards
+  void RemoveChild(Layer* child);
+  // null for the root
+  Layer* GetParent() const { return _parent; }
+  // position among the parent's children, 0 is drawn first
+  size_t GetIndexInParent() const { return _index_in_parent; }
+  // the layer after this one in a front iteration, so the next one drawn.
+  // skip_children jumps over this layer's subtree
+  Layer* GetNextLayer(bool skip_children = false) const;
   LayerData* GetLayerData() const { return _meta_data.get(); }
   template <typename T>
   T* GetLayerData() const { return static_cast<T*>(_meta_data.get()); }
@@ -95,6 +114,12 @@ struct DirLayerData : public LayerData{
   void Deserialize(const nlohmann::json& json) override{}
 };
 
+// interleaved mesh vertex, same layout as rdc::ModelVertex
+struct MeshVertex {
+  glm::vec2 position;
+  glm::vec2 uv;
+};
+
 struct ImageLayerData : public LayerData {
   // the relative path to the project file
   int image_id = -1;
@@ -105,6 +130,19 @@ struct ImageLayerData : public LayerData {
   std::vector<glm::vec2> uvs;
   std::vector<uint32_t> indices;
 
+  // mesh read straight from a mapped binary project, used instead of
+  // points/uvs/indices while set. the memory is owned by the document
+  std::span<const MeshVertex> mapped_vertices;
+  std::span<const uint32_t> mapped_indices;
+
+  bool HasMappedMesh() const { return mapped_vertices.data() != nullptr; }
+  size_t VertexCount() const {
+    return HasMappedMesh() ? mapped_vertices.size() : points.size();
+  }
+  // copy the mapped mesh into points/uvs/indices so it can be edited or
+  // outlive the mapping
+  void DetachMappedMesh();
+
   LayerDataType Type() const override { return kImageLayer; }
   void Serialize(nlohmann::json& json) const override;
   void Deserialize(const nlohmann::json& json) override;
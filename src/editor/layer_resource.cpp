@@ -0,0 +1,72 @@
+#include "layer_resource.h"
+
+#include <cstddef>
+
+#include "tools.hpp"
+
+namespace editor {
+static_assert(sizeof(MeshVertex) == sizeof(rdc::ModelVertex) &&
+                  offsetof(MeshVertex, uv) == offsetof(rdc::ModelVertex, uv),
+              "mapped meshes are handed to the renderer without conversion");
+
+std::vector<Layer *> CollectImageLayers(const Document &doc) {
+  std::vector<Layer *> result;
+  auto *root_layer = doc.GetRootLayer();
+  for (auto it = root_layer->BeginFrontIter(); it != root_layer->EndFrontIter();
+       ++it) {
+    auto *layer = (*it).layer;
+    if (layer->GetType() == kImageLayer) {
+      result.push_back(layer);
+    }
+  }
+  return result;
+}
+
+std::vector<rdc::ModelVertex> CollectLayerVertices(const ImageLayerData &data,
+                                                   uint32_t first,
+                                                   uint32_t count) {
+  std::vector<rdc::ModelVertex> result(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (data.HasMappedMesh()) {
+      auto const &vertex = data.mapped_vertices[first + i];
+      result[i] = {.position = vertex.position, .uv = vertex.uv};
+    } else {
+      result[i] = {.position = data.points[first + i],
+                   .uv = data.uvs[first + i]};
+    }
+  }
+  return result;
+}
+
+std::unique_ptr<rdc::Layer2dResource> CreateLayerResource(Layer *layer) {
+  // handle image
+  auto *image_data = layer->GetLayerData<ImageLayerData>();
+
+  // layer resource
+  rdc::Layer2dResource::ImageConfig image_config;
+  image_config.pimage = image_data->image;
+  std::vector<rdc::ModelVertex> vertices;
+
+  if (image_data->HasMappedMesh()) {
+    // binary projects already store the renderer's vertex layout
+    image_config.vertices = {
+        reinterpret_cast<const rdc::ModelVertex *>(
+            image_data->mapped_vertices.data()),
+        image_data->mapped_vertices.size()};
+    image_config.indices = image_data->mapped_indices;
+  } else {
+    LazyVector<rdc::ModelVertex> lazy_vertices;
+    lazy_vertices.Resize(image_data->points.size())
+        .SetFunc([image_data](int index) {
+          rdc::ModelVertex result;
+          result.position = image_data->points[index];
+          result.uv = image_data->uvs[index];
+          return result;
+        });
+    vertices = lazy_vertices.ToVector();
+    image_config.vertices = vertices;
+    image_config.indices = image_data->indices;
+  }
+  return rdc::Layer2dResource::CreateFromImage(image_config);
+}
+}  // namespace editor
@@ -0,0 +1,20 @@
+#ifndef EDITOR_LAYER_RESOURCE_H_
+#define EDITOR_LAYER_RESOURCE_H_
+#include <memory>
+#include <vector>
+
+#include "document.h"
+#include "render_core/renderer/model_renderer.h"
+
+namespace editor {
+// image layers of doc in draw order, back to front
+std::vector<Layer*> CollectImageLayers(const Document& doc);
+// vertices [first, first + count) of an image layer in the renderer's layout
+std::vector<rdc::ModelVertex> CollectLayerVertices(const ImageLayerData& data,
+                                                   uint32_t first,
+                                                   uint32_t count);
+// texture and mesh of an image layer, shared by the editor and the exporter
+std::unique_ptr<rdc::Layer2dResource> CreateLayerResource(Layer* layer);
+}  // namespace editor
+
+#endif  // EDITOR_LAYER_RESOURCE_H_
@@ -0,0 +1,92 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#include <filesystem>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace editor {
+#ifdef _WIN32
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path) {
+  auto result = std::unique_ptr<MappedFile>(new MappedFile());
+  auto wide_path = std::filesystem::path(path).wstring();
+  HANDLE file = CreateFileW(wide_path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  result->_file_handle = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    return nullptr;
+  }
+  result->_size = static_cast<size_t>(size.QuadPart);
+  HANDLE mapping =
+      CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    return nullptr;
+  }
+  result->_mapping_handle = mapping;
+  result->_data = static_cast<const uint8_t*>(
+      MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (result->_data == nullptr) {
+    return nullptr;
+  }
+  return result;
+}
+
+MappedFile::~MappedFile() {
+  if (_data) {
+    UnmapViewOfFile(_data);
+  }
+  if (_mapping_handle) {
+    CloseHandle(_mapping_handle);
+  }
+  if (_file_handle) {
+    CloseHandle(_file_handle);
+  }
+}
+#else
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path) {
+  auto result = std::unique_ptr<MappedFile>(new MappedFile());
+  result->_fd = open(path.c_str(), O_RDONLY);
+  if (result->_fd < 0) {
+    return nullptr;
+  }
+  struct stat file_stat = {};
+  if (fstat(result->_fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    return nullptr;
+  }
+  result->_size = static_cast<size_t>(file_stat.st_size);
+  void* data =
+      mmap(nullptr, result->_size, PROT_READ, MAP_PRIVATE, result->_fd, 0);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  result->_data = static_cast<const uint8_t*>(data);
+  return result;
+}
+
+MappedFile::~MappedFile() {
+  if (_data) {
+    munmap(const_cast<uint8_t*>(_data), _size);
+  }
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+#endif
+}  // namespace editor
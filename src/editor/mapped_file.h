@@ -0,0 +1,37 @@
+#ifndef EDITOR_MAPPED_FILE_H_
+#define EDITOR_MAPPED_FILE_H_
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "tools.hpp"
+
+namespace editor {
+
+// read only memory mapping of a whole file, unmapped on destruction
+class MappedFile : public NoCopyable {
+  const uint8_t* _data = nullptr;
+  size_t _size = 0;
+#ifdef _WIN32
+  void* _file_handle = nullptr;
+  void* _mapping_handle = nullptr;
+#else
+  int _fd = -1;
+#endif
+  MappedFile() = default;
+
+ public:
+  static std::unique_ptr<MappedFile> Open(const std::string& path);
+
+  const uint8_t* Data() const { return _data; }
+  size_t Size() const { return _size; }
+  std::span<const uint8_t> Bytes() const { return {_data, _size}; }
+
+  ~MappedFile() override;
+};
+
+}  // namespace editor
+
+#endif  // EDITOR_MAPPED_FILE_H_
@@ -0,0 +1,111 @@
+#include "memory_report.h"
+
+#include <fstream>
+
+#include "layer_resource.h"
+
+namespace editor {
+
+MemoryReport CollectMemoryReport(
+    const std::list<rdc::Layer2dResource *> &layers) {
+  const auto *driver = rdc::VulkanDriver::GetSingleton();
+  MemoryReport report;
+  report.memory_budget = driver->SupportsMemoryBudget();
+  report.heaps = driver->QueryMemoryHeaps();
+  report.last_frame = driver->GetLastFrameCounters();
+  report.image_pool = driver->GetImagePool()->GetStats();
+  report.layers.reserve(layers.size());
+  for (const auto *layer : layers) {
+    MemoryReport::LayerResource resource = {
+        .name = "layer " + std::to_string(report.layers.size()),
+        .image_bytes = layer->GetImageBytes(),
+        .buffer_bytes = layer->GetBufferBytes(),
+        .mip_levels = layer->GetMipLevels(),
+    };
+    report.layer_image_bytes += resource.image_bytes;
+    report.layer_buffer_bytes += resource.buffer_bytes;
+    report.layers.push_back(std::move(resource));
+  }
+  return report;
+}
+
+void AddDocumentMemory(MemoryReport &report, const Document *document) {
+  if (!document) {
+    return;
+  }
+  // the renderer gets its layers in document order, a partial upload or an
+  // edited document no longer lines up
+  auto const image_layers = CollectImageLayers(*document);
+  if (image_layers.size() == report.layers.size()) {
+    for (size_t i = 0; i < image_layers.size(); ++i) {
+      report.layers[i].name = image_layers[i]->GetLayerName();
+    }
+  }
+  for (auto &image : document->GetImageMemory()) {
+    report.cpu_image_bytes += image.bytes;
+    report.cpu_images.push_back(
+        {.path = std::move(image.rel_path), .bytes = image.bytes});
+  }
+}
+
+nlohmann::json MemoryReportToJson(const MemoryReport &report) {
+  nlohmann::json result;
+  result["memory_budget_extension"] = report.memory_budget;
+  auto &heaps = result["heaps"];
+  heaps = nlohmann::json::array();
+  for (const auto &heap : report.heaps) {
+    heaps.push_back({
+        {"device_local",
+         (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0},
+        {"size", heap.size},
+        {"budget", heap.budget},
+        {"usage", heap.usage},
+        {"block_bytes", heap.block_bytes},
+        {"allocation_bytes", heap.allocation_bytes},
+        {"block_count", heap.block_count},
+        {"allocation_count", heap.allocation_count},
+    });
+  }
+  auto &layers = result["layers"];
+  layers = nlohmann::json::array();
+  for (const auto &layer : report.layers) {
+    layers.push_back({
+        {"name", layer.name},
+        {"image_bytes", layer.image_bytes},
+        {"buffer_bytes", layer.buffer_bytes},
+        {"mip_levels", layer.mip_levels},
+    });
+  }
+  auto &cpu_images = result["cpu_images"];
+  cpu_images = nlohmann::json::array();
+  for (const auto &image : report.cpu_images) {
+    cpu_images.push_back({{"path", image.path}, {"bytes", image.bytes}});
+  }
+  result["totals"] = {
+      {"layer_image_bytes", report.layer_image_bytes},
+      {"layer_buffer_bytes", report.layer_buffer_bytes},
+      {"cpu_image_bytes", report.cpu_image_bytes},
+  };
+  result["image_pool"] = {
+      {"pooled_images", report.image_pool.pooled_images},
+      {"pooled_bytes", report.image_pool.pooled_bytes},
+      {"hits", report.image_pool.hits},
+      {"misses", report.image_pool.misses},
+  };
+  result["last_frame"] = {
+      {"uploaded_bytes", report.last_frame.uploaded_bytes},
+      {"draw_calls", report.last_frame.draw_calls},
+  };
+  return result;
+}
+
+bool WriteMemoryReport(const MemoryReport &report, const std::string &path) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  file << MemoryReportToJson(report).dump(2) << '\n';
+  return static_cast<bool>(file);
+}
+
+}  // namespace editor
@@ -0,0 +1,53 @@
+#ifndef EDITOR_MEMORY_REPORT_H_
+#define EDITOR_MEMORY_REPORT_H_
+#include <cstdint>
+#include <list>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "render_core/image_pool.h"
+#include "render_core/renderer/model_renderer.h"
+#include "render_core/vulkan_driver.h"
+
+namespace editor {
+
+// where the memory of the editor goes, gpu heaps, layer resources and the
+// decoded images a document keeps on the cpu
+struct MemoryReport {
+  struct LayerResource {
+    std::string name;
+    uint64_t image_bytes = 0;
+    uint64_t buffer_bytes = 0;
+    uint32_t mip_levels = 0;
+  };
+  struct CpuImage {
+    std::string path;
+    uint64_t bytes = 0;
+  };
+  bool memory_budget = false;
+  std::vector<rdc::MemoryHeapStats> heaps;
+  std::vector<LayerResource> layers;
+  std::vector<CpuImage> cpu_images;
+  uint64_t layer_image_bytes = 0;
+  uint64_t layer_buffer_bytes = 0;
+  uint64_t cpu_image_bytes = 0;
+  // released layer images kept for reuse
+  rdc::ImagePool::Stats image_pool;
+  rdc::FrameCounters last_frame;
+};
+
+// gpu heaps and the layer resources in draw order, on the thread that
+// renders them. layers are named by index
+MemoryReport CollectMemoryReport(
+    const std::list<rdc::Layer2dResource *> &layers);
+// names the layers after the document's image layers when they still match
+// them and adds the images the document keeps decoded. document may be null
+void AddDocumentMemory(MemoryReport &report, const Document *document);
+nlohmann::json MemoryReportToJson(const MemoryReport &report);
+bool WriteMemoryReport(const MemoryReport &report, const std::string &path);
+
+}  // namespace editor
+
+#endif  // EDITOR_MEMORY_REPORT_H_
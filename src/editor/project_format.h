@@ -0,0 +1,70 @@
+#ifndef EDITOR_PROJECT_FORMAT_H_
+#define EDITOR_PROJECT_FORMAT_H_
+#include <cstdint>
+
+// binary .wf layout, every offset is from the start of the file:
+//
+//   ProjectHeader
+//   ProjectImageEntry[image_count]
+//   ProjectLayerEntry[layer_count]    layers in front iter order with depth
+//   string table                      utf-8, not null terminated
+//   vertex / index blobs              kProjectBlobAlignment aligned
+//
+// vertex blobs are interleaved {x, y, u, v} floats, the same layout as
+// rdc::ModelVertex, so a mapped blob can be handed to the renderer as is.
+namespace editor::project_format {
+
+constexpr char kMagic[4] = {'W', 'F', 'P', 'B'};
+constexpr uint32_t kVersion = 1;
+constexpr uint64_t kProjectBlobAlignment = 16;
+
+struct ProjectHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t canvas_width;
+  uint32_t canvas_height;
+  uint32_t image_count;
+  uint32_t layer_count;
+  uint64_t image_table_offset;
+  uint64_t layer_table_offset;
+  uint64_t string_table_offset;
+  uint64_t string_table_size;
+  uint64_t file_size;
+};
+
+struct ProjectString {
+  uint32_t offset;  // into the string table
+  uint32_t size;
+};
+
+struct ProjectImageEntry {
+  int32_t image_id;
+  ProjectString rel_path;
+  uint32_t reserved;
+};
+
+struct ProjectLayerEntry {
+  ProjectString name;
+  uint32_t depth;
+  uint8_t type;  // LayerDataType
+  uint8_t is_visible;
+  uint16_t reserved;
+  int32_t image_id;
+  uint32_t vertex_count;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint32_t index_count;
+  uint32_t reserved2;
+};
+
+static_assert(sizeof(ProjectHeader) == 64);
+static_assert(sizeof(ProjectImageEntry) == 16);
+static_assert(sizeof(ProjectLayerEntry) == 48);
+
+constexpr uint64_t AlignBlob(uint64_t offset) {
+  return (offset + kProjectBlobAlignment - 1) & ~(kProjectBlobAlignment - 1);
+}
+
+}  // namespace editor::project_format
+
+#endif  // EDITOR_PROJECT_FORMAT_H_
@@ -0,0 +1,113 @@
+#include "render_thread.h"
+
+#include <GLFW/glfw3.h>
+
+#include "render_core/vulkan_driver.h"
+#include "trace.hpp"
+
+namespace editor {
+
+RenderThread::RenderThread(rdc::ApplicationRenderer *renderer)
+    : _renderer(renderer) {
+  _thread = std::thread([this]() { Loop(); });
+}
+
+RenderThread::~RenderThread() {
+  _stopping = true;
+  Wake();
+  _thread.join();
+}
+
+void RenderThread::Wake() {
+  _serial.fetch_add(1, std::memory_order_release);
+  _serial.notify_one();
+}
+
+void RenderThread::PublishSnapshot() {
+  _snapshots.Publish();
+  Wake();
+}
+
+void RenderThread::Post(Command command) {
+  {
+    std::lock_guard lock(_commands_mutex);
+    _commands.push_back(std::move(command));
+  }
+  Wake();
+}
+
+const RenderStatus &RenderThread::GetStatus() {
+  _status.Acquire();
+  return _status.GetReadSlot();
+}
+
+void RenderThread::RunCommands() {
+  std::vector<Command> commands;
+  {
+    std::lock_guard lock(_commands_mutex);
+    commands.swap(_commands);
+  }
+  for (auto &command : commands) {
+    command(*_renderer);
+  }
+}
+
+void RenderThread::PublishStatus() {
+  auto &status = _status.GetWriteSlot();
+  auto *model_renderer = _renderer->GetModelRenderer();
+  status.bindless_supported = model_renderer->IsBindlessSupported();
+  status.bindless_enabled = model_renderer->GetDrawMode() ==
+                            rdc::ModelRenderer::DrawMode::kBindlessIndirect;
+  status.parallel_recording = model_renderer->IsParallelRecording();
+  status.record_chunks = model_renderer->GetRecordChunkCount();
+  status.model_record_ms = model_renderer->GetRecordCpuTime();
+  status.drawn_layers = model_renderer->GetDrawnLayerCount();
+  status.total_layers =
+      static_cast<uint32_t>(model_renderer->GetLayers().size());
+  status.canvas_dirty = model_renderer->IsCanvasDirty();
+  status.retired_resources = _renderer->GetResourceManager()->GetRetiredCount();
+
+  const auto *profiler = rdc::VulkanDriver::GetSingleton()->GetGpuProfiler();
+  status.gpu_profiler_supported = profiler->IsSupported();
+  if (profiler->IsEnabled()) {
+    status.gpu_history = profiler->GetHistory();
+  } else {
+    status.gpu_history.clear();
+  }
+  status.gpu_dropped_scopes = profiler->GetDroppedScopes();
+
+  // the last snapshot stays in the read slot until the next one is taken
+  if (_snapshots.GetReadSlot().collect_memory_report) {
+    status.memory_report = CollectMemoryReport(model_renderer->GetLayers());
+  } else {
+    status.memory_report = {};
+  }
+  _status.Publish();
+}
+
+void RenderThread::Loop() {
+  WAIFU_TRACE_THREAD_NAME("render");
+  uint64_t serial = 0;
+  while (true) {
+    _serial.wait(serial, std::memory_order_acquire);
+    serial = _serial.load(std::memory_order_acquire);
+    RunCommands();
+    if (_stopping) {
+      return;
+    }
+    if (_snapshots.Acquire()) {
+      auto &snapshot = _snapshots.GetReadSlot();
+      // minimized, there is no swapchain to draw into
+      if (snapshot.window_width > 0 && snapshot.window_height > 0) {
+        _renderer->SetWindowSize(snapshot.window_width,
+                                 snapshot.window_height);
+        _renderer->Render(snapshot.ui.GetDrawData());
+      }
+    }
+    PublishStatus();
+    // the main thread may be waiting for the status or for a free snapshot
+    glfwPostEmptyEvent();
+  }
+}
+
+}  // namespace editor
@@ -0,0 +1,90 @@
+#ifndef EDITOR_RENDER_THREAD_H_
+#define EDITOR_RENDER_THREAD_H_
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "memory_report.h"
+#include "render_core/gpu_profiler.h"
+#include "render_core/renderer/renderer.h"
+#include "tools.hpp"
+
+namespace editor {
+
+// what the main thread hands over for one frame
+struct FrameSnapshot {
+  int window_width = 0;
+  int window_height = 0;
+  rdc::UiDrawSnapshot ui;
+  // fill RenderStatus::memory_report, only while the memory window is open
+  bool collect_memory_report = false;
+};
+
+// what the render thread reports back after every frame and command batch
+struct RenderStatus {
+  bool bindless_supported = false;
+  bool bindless_enabled = false;
+  bool parallel_recording = false;
+  uint32_t record_chunks = 0;
+  float model_record_ms = 0.0f;
+  uint32_t drawn_layers = 0;
+  uint32_t total_layers = 0;
+  // work that needs more frames
+  bool canvas_dirty = false;
+  size_t retired_resources = 0;
+  bool gpu_profiler_supported = false;
+  // empty while the profiler is disabled
+  std::deque<rdc::GpuFrameTimings> gpu_history;
+  uint32_t gpu_dropped_scopes = 0;
+  // layers named by index, see AddDocumentMemory
+  MemoryReport memory_report;
+};
+
+// records and submits frames on its own thread, so a slow frame no longer
+// holds up input and ui. the main thread publishes a snapshot per frame and
+// only the latest one is rendered. everything that changes the renderer is
+// posted as a command, while the thread runs nothing else may touch it
+class RenderThread : public NoCopyable {
+ public:
+  using Command = std::function<void(rdc::ApplicationRenderer &renderer)>;
+
+ private:
+  rdc::ApplicationRenderer *_renderer;
+  TripleBuffer<FrameSnapshot> _snapshots;
+  TripleBuffer<RenderStatus> _status;
+  std::mutex _commands_mutex;
+  std::vector<Command> _commands;
+  // bumped by every publish and post, the thread sleeps on it
+  std::atomic_uint64_t _serial = 0;
+  std::atomic_bool _stopping = false;
+  std::thread _thread;
+
+  void Loop();
+  void RunCommands();
+  void PublishStatus();
+  void Wake();
+
+ public:
+  explicit RenderThread(rdc::ApplicationRenderer *renderer);
+  // runs the commands still posted, then stops
+  ~RenderThread() override;
+
+  // main thread only
+  FrameSnapshot &GetSnapshot() { return _snapshots.GetWriteSlot(); }
+  void PublishSnapshot();
+  // the thread has not started on the last published snapshot yet
+  bool IsSnapshotPending() const { return _snapshots.IsPending(); }
+  // runs on the render thread before its next frame, in posting order. may
+  // be called from any thread
+  void Post(Command command);
+  // latest status, valid until the next call
+  const RenderStatus &GetStatus();
+};
+
+}  // namespace editor
+
+#endif  // EDITOR_RENDER_THREAD_H_
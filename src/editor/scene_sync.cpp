@@ -0,0 +1,316 @@
+#include "scene_sync.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "layer_resource.h"
+#include "trace.hpp"
+
+namespace {
+// child indices from the root down to layer, ordered like the draws
+std::vector<size_t> DrawPath(const editor::Layer *layer) {
+  std::vector<size_t> path;
+  for (; layer->GetParent(); layer = layer->GetParent()) {
+    path.push_back(layer->GetIndexInParent());
+  }
+  std::ranges::reverse(path);
+  return path;
+}
+bool IsLayerVisible(const editor::Layer *layer) {
+  return layer->GetLayerData<editor::ImageLayerData>()->is_visible();
+}
+template <typename T>
+bool IsReady(const std::future<T> &future) {
+  return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+// builds the resource on a worker from a copy of the mesh, so the layer can
+// be edited meanwhile. the image belongs to the document and is not edited
+std::future<std::unique_ptr<rdc::Layer2dResource>> SubmitLayerResource(
+    const editor::Layer *layer) {
+  const auto &data = *layer->GetLayerData<editor::ImageLayerData>();
+  auto vertices = editor::CollectLayerVertices(
+      data, 0, static_cast<uint32_t>(data.VertexCount()));
+  auto indices = data.HasMappedMesh()
+                     ? std::vector<uint32_t>(data.mapped_indices.begin(),
+                                             data.mapped_indices.end())
+                     : data.indices;
+  return ThreadPool::GetGlobal()->Submit(
+      [image = data.image, vertices = std::move(vertices),
+       indices = std::move(indices)]() {
+        rdc::Layer2dResource::ImageConfig image_config;
+        image_config.pimage = image;
+        image_config.vertices = vertices;
+        image_config.indices = indices;
+        return rdc::Layer2dResource::CreateFromImage(image_config);
+      });
+}
+}  // namespace
+
+namespace editor {
+SceneSync::SceneSync(RenderThread *render_thread, FramePacer *frame_pacer)
+    : _render_thread(render_thread), _frame_pacer(frame_pacer) {}
+
+rdc::Layer2dResource *SceneSync::FindListedSuccessor(
+    const Layer *layer) const {
+  for (auto *next = layer->GetNextLayer(true); next;
+       next = next->GetNextLayer()) {
+    auto it = _entries.find(next);
+    if (it != _entries.end() && it->second.listed) {
+      return it->second.resource;
+    }
+  }
+  return nullptr;
+}
+
+void SceneSync::AddResource(Layer *layer,
+                            std::unique_ptr<rdc::Layer2dResource> resource) {
+  bool const visible = IsLayerVisible(layer);
+  _entries[layer] = {.resource = resource.get(), .listed = true};
+  // std::function needs a copyable capture, the resource manager takes the
+  // ownership back on the render thread
+  _render_thread->Post([resource = resource.release(),
+                        visible](rdc::ApplicationRenderer &renderer) {
+    auto *model_renderer = renderer.GetModelRenderer();
+    model_renderer->SetLayerVisible(resource, visible);
+    model_renderer->AddLayer(resource);
+    renderer.GetResourceManager()->AddResource(resource);
+  });
+}
+
+void SceneSync::PostRelease(std::unique_ptr<rdc::Layer2dResource> resource) {
+  // it may have uploads recorded, so it goes through the resource manager
+  // like any other
+  _render_thread->Post(
+      [resource = resource.release()](rdc::ApplicationRenderer &renderer) {
+        auto *resource_manager = renderer.GetResourceManager();
+        resource_manager->AddResource(resource);
+        resource_manager->ReleaseResource(resource->GetHandle());
+      });
+}
+
+void SceneSync::UpdateWakeLock() {
+  bool const pending = !_pending.empty() || !_orphans.empty();
+  if (pending && !_wake_lock.IsHeld()) {
+    _wake_lock = _frame_pacer->AcquireWakeLock();
+  } else if (!pending) {
+    _wake_lock.Release();
+  }
+}
+
+void SceneSync::Clear() {
+  for (auto &[layer, pending] : _pending) {
+    _orphans.push_back(std::move(pending.resource));
+  }
+  _pending.clear();
+  for (auto &orphan : _orphans) {
+    PostRelease(orphan.get());
+  }
+  _orphans.clear();
+  _entries.clear();
+  _wake_lock.Release();
+}
+
+void SceneSync::Sync(Document &document) {
+  std::erase_if(_orphans, [this](ResourceFuture &orphan) {
+    if (!IsReady(orphan)) {
+      return false;
+    }
+    PostRelease(orphan.get());
+    return true;
+  });
+  auto changes = document.TakeChanges();
+  if (changes.empty() && _pending.empty()) {
+    UpdateWakeLock();
+    return;
+  }
+  WAIFU_TRACE_SCOPE("SceneSync::Sync");
+  // a layer removed later in the batch may already be deleted, whatever
+  // happened to it before is moot
+  std::vector<bool> stale(changes.size(), false);
+  {
+    std::unordered_set<Layer *> removed;
+    for (size_t i = changes.size(); i-- > 0;) {
+      if (changes[i].type == LayerChange::Type::kRemoved) {
+        removed.insert(changes[i].layer);
+      } else {
+        stale[i] = removed.contains(changes[i].layer);
+      }
+    }
+  }
+
+  // run in one command, so no frame shows half of the batch
+  std::vector<RenderThread::Command> commands;
+  // taken out of the layer list, put back once the tree has settled
+  std::unordered_set<Layer *> to_insert;
+  // the renderer keeps hidden layers in place, only the flag changes
+  std::unordered_set<Layer *> visibility;
+  struct MeshPatch {
+    uint32_t begin = UINT32_MAX;
+    uint32_t end = 0;
+    bool whole = false;
+  };
+  std::unordered_map<Layer *, MeshPatch> patches;
+  auto take_out = [&commands](Entry &entry) {
+    if (entry.listed) {
+      commands.push_back(
+          [resource = entry.resource](rdc::ApplicationRenderer &renderer) {
+            renderer.GetModelRenderer()->RemoveLayer(resource);
+          });
+      entry.listed = false;
+    }
+  };
+  for (size_t i = 0; i < changes.size(); ++i) {
+    if (stale[i]) {
+      continue;
+    }
+    auto *layer = changes[i].layer;
+    auto it = _entries.find(layer);
+    switch (changes[i].type) {
+      case LayerChange::Type::kAdded:
+        // listed once the worker is done, see below
+        if (it == _entries.end() && !_pending.contains(layer)) {
+          _pending[layer] = {.resource = SubmitLayerResource(layer)};
+        }
+        break;
+      case LayerChange::Type::kRemoved: {
+        if (auto pending = _pending.find(layer); pending != _pending.end()) {
+          _orphans.push_back(std::move(pending->second.resource));
+          _pending.erase(pending);
+          patches.erase(layer);
+          break;
+        }
+        if (it == _entries.end()) {
+          break;
+        }
+        take_out(it->second);
+        commands.push_back([resource = it->second.resource](
+                               rdc::ApplicationRenderer &renderer) {
+          renderer.GetResourceManager()->ReleaseResource(
+              resource->GetHandle());
+        });
+        _entries.erase(it);
+        to_insert.erase(layer);
+        visibility.erase(layer);
+        patches.erase(layer);
+        break;
+      }
+      case LayerChange::Type::kMoved:
+        if (it != _entries.end()) {
+          take_out(it->second);
+          to_insert.insert(layer);
+        }
+        break;
+      case LayerChange::Type::kVisibility:
+        if (it != _entries.end()) {
+          visibility.insert(layer);
+        }
+        break;
+      case LayerChange::Type::kName:
+        // the renderer has no use for names
+        break;
+      case LayerChange::Type::kVertices: {
+        if (auto pending = _pending.find(layer); pending != _pending.end()) {
+          pending->second.mesh_dirty = true;
+        }
+        auto &patch = patches[layer];
+        patch.begin = std::min(patch.begin, changes[i].first);
+        patch.end = std::max(patch.end, changes[i].first + changes[i].count);
+        break;
+      }
+      case LayerChange::Type::kMesh:
+        if (auto pending = _pending.find(layer); pending != _pending.end()) {
+          pending->second.mesh_dirty = true;
+        }
+        patches[layer].whole = true;
+        break;
+    }
+  }
+
+  // finished resources are listed where their layer is now, moves and
+  // visibility changes made meanwhile need nothing more
+  for (auto pending = _pending.begin(); pending != _pending.end();) {
+    if (!IsReady(pending->second.resource)) {
+      ++pending;
+      continue;
+    }
+    auto *layer = pending->first;
+    auto *resource = pending->second.resource.get().release();
+    _entries[layer] = {.resource = resource};
+    commands.push_back([resource](rdc::ApplicationRenderer &renderer) {
+      renderer.GetResourceManager()->AddResource(resource);
+    });
+    to_insert.insert(layer);
+    visibility.insert(layer);
+    if (pending->second.mesh_dirty) {
+      patches[layer].whole = true;
+    }
+    pending = _pending.erase(pending);
+  }
+  UpdateWakeLock();
+
+  // the flags go first, a layer that is inserted hidden is never drawn
+  for (auto *layer : visibility) {
+    commands.push_back([resource = _entries[layer].resource,
+                        visible = IsLayerVisible(layer)](
+                           rdc::ApplicationRenderer &renderer) {
+      renderer.GetModelRenderer()->SetLayerVisible(resource, visible);
+    });
+  }
+  // last drawn first, so the successor of each is already in place
+  std::vector<std::pair<std::vector<size_t>, Layer *>> inserts;
+  for (auto *layer : to_insert) {
+    inserts.emplace_back(DrawPath(layer), layer);
+  }
+  std::ranges::sort(inserts, std::greater{});
+  for (const auto &[path, layer] : inserts) {
+    auto &entry = _entries[layer];
+    commands.push_back([resource = entry.resource,
+                        before = FindListedSuccessor(layer)](
+                           rdc::ApplicationRenderer &renderer) {
+      renderer.GetModelRenderer()->InsertLayer(resource, before);
+    });
+    entry.listed = true;
+  }
+
+  for (const auto &[layer, patch] : patches) {
+    auto it = _entries.find(layer);
+    if (it == _entries.end()) {
+      continue;
+    }
+    auto *resource = it->second.resource;
+    const auto &data = *layer->GetLayerData<ImageLayerData>();
+    if (patch.whole) {
+      auto vertices = CollectLayerVertices(
+          data, 0, static_cast<uint32_t>(data.VertexCount()));
+      commands.push_back([resource, vertices = std::move(vertices),
+                          indices = data.indices](rdc::ApplicationRenderer &) {
+        resource->SetVertex(vertices, indices);
+      });
+    } else {
+      auto vertices =
+          CollectLayerVertices(data, patch.begin, patch.end - patch.begin);
+      commands.push_back([resource, first = patch.begin,
+                          vertices = std::move(vertices)](
+                             rdc::ApplicationRenderer &) {
+        resource->UpdateVertices(first, vertices);
+      });
+    }
+  }
+
+  if (commands.empty()) {
+    // only resources still being built
+    return;
+  }
+  _render_thread->Post(
+      [commands = std::move(commands)](rdc::ApplicationRenderer &renderer) {
+        for (const auto &command : commands) {
+          command(renderer);
+        }
+      });
+}
+}  // namespace editor
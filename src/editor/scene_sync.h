@@ -0,0 +1,63 @@
+#ifndef EDITOR_SCENE_SYNC_H_
+#define EDITOR_SCENE_SYNC_H_
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "frame_pacer.h"
+#include "render_core/renderer/model_renderer.h"
+#include "render_thread.h"
+#include "tools.hpp"
+
+namespace editor {
+
+// keeps the renderer's layers in step with the open document. the resources
+// of a freshly opened document come in through AddResource, every later edit
+// through the document's journal, so a frame only pays for what changed.
+// lives on the main thread and reaches the renderer through posted commands
+class SceneSync : public NoCopyable {
+  struct Entry {
+    rdc::Layer2dResource *resource = nullptr;
+    // in the model renderer's layer list, hidden layers included
+    bool listed = false;
+  };
+  using ResourceFuture = std::future<std::unique_ptr<rdc::Layer2dResource>>;
+  // an added layer whose resource is still built on a worker
+  struct PendingResource {
+    ResourceFuture resource;
+    // edited after its mesh was copied for the worker
+    bool mesh_dirty = false;
+  };
+  RenderThread *_render_thread;
+  FramePacer *_frame_pacer;
+  // held while resources are built, Sync has to run to list them
+  FramePacer::WakeLock _wake_lock;
+  std::unordered_map<Layer *, Entry> _entries;
+  std::unordered_map<Layer *, PendingResource> _pending;
+  // resources of layers removed while they were built, released once done
+  std::vector<ResourceFuture> _orphans;
+
+  // the next layer in draw order that is in the layer list, null if none
+  rdc::Layer2dResource *FindListedSuccessor(const Layer *layer) const;
+  // hand a resource that is never drawn to the renderer to be released
+  void PostRelease(std::unique_ptr<rdc::Layer2dResource> resource);
+  void UpdateWakeLock();
+
+ public:
+  SceneSync(RenderThread *render_thread, FramePacer *frame_pacer);
+  // resources created outside of Sync, handed over in draw order
+  void AddResource(Layer *layer,
+                   std::unique_ptr<rdc::Layer2dResource> resource);
+  // apply the document's journal since the last call and list the added
+  // layers whose resource is done, once per frame
+  void Sync(Document &document);
+  // forget every layer, the renderer drops them with CloseDocument. waits
+  // for the resources still being built, they read the document's images
+  void Clear();
+};
+
+}  // namespace editor
+
+#endif  // EDITOR_SCENE_SYNC_H_
@@ -43,6 +43,10 @@ class CPUImage {
   }
 
   bool IsValid() const { return data != nullptr; }
+  // decoded pixels are rgba8 whatever the source had in channels
+  size_t GetByteSize() const {
+    return data ? static_cast<size_t>(width) * height * 4 : 0;
+  }
 
   void LoadFromFile(const std::string& file_path) {
     data = stbi_load(file_path.c_str(), reinterpret_cast<int*>(&width),
@@ -0,0 +1,192 @@
+// renders .wf documents to png files without opening a window
+//
+//   waifu_export [--scale <factor>] [--out <dir>] [--validate]
+//                [--trace <file.json>] <doc.wf>...
+
+#include <stb_image_write.h>
+
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "editor/document_loader.h"
+#include "editor/layer_resource.h"
+#include "render_core/renderer/offscreen_renderer.h"
+#include "render_core/vulkan_driver.h"
+#include "tools.hpp"
+#include "trace.hpp"
+
+namespace {
+
+struct ExportOptions {
+  float scale = 1.0f;
+  std::filesystem::path out_dir = ".";
+  bool validate = false;
+  // chrome trace written on exit, needs a WAIFU_ENABLE_TRACE build
+  std::string trace_path;
+  std::vector<std::string> documents;
+};
+
+// a document and the gpu resources its frame draws, released with the
+// readback callback once the frame has finished
+struct ExportJob {
+  std::unique_ptr<editor::Document> document;
+  std::vector<std::unique_ptr<rdc::Layer2dResource>> layers;
+  std::filesystem::path output;
+};
+
+void PrintUsage() {
+  std::cerr << "usage: waifu_export [--scale <factor>] [--out <dir>] "
+               "[--validate] [--trace <file.json>] <doc.wf>...\n";
+}
+
+bool ParseOptions(int argc, char **argv, ExportOptions &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string const arg = argv[i];
+    if (arg == "--scale" && i + 1 < argc) {
+      std::string_view const value = argv[++i];
+      auto const [end, error] = std::from_chars(
+          value.data(), value.data() + value.size(), options.scale);
+      if (error != std::errc() || end != value.data() + value.size() ||
+          !std::isfinite(options.scale)) {
+        return false;
+      }
+    } else if (arg == "--out" && i + 1 < argc) {
+      options.out_dir = argv[++i];
+    } else if (arg == "--trace" && i + 1 < argc) {
+      options.trace_path = argv[++i];
+    } else if (arg == "--validate") {
+      options.validate = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      return false;
+    } else {
+      options.documents.push_back(arg);
+    }
+  }
+  return !options.documents.empty() && options.scale > 0.0f;
+}
+
+// the renderer produces premultiplied alpha, png stores straight alpha
+std::vector<uint8_t> Unpremultiply(const rdc::OffscreenRenderer::Readback &rb) {
+  size_t const size = static_cast<size_t>(rb.width) * rb.height * 4;
+  std::vector<uint8_t> result(rb.pixels, rb.pixels + size);
+  for (size_t i = 0; i < size; i += 4) {
+    uint32_t const alpha = result[i + 3];
+    if (alpha == 0 || alpha == 255) {
+      continue;
+    }
+    for (size_t c = 0; c < 3; ++c) {
+      result[i + c] = static_cast<uint8_t>(
+          std::min<uint32_t>((result[i + c] * 255 + alpha / 2) / alpha, 255));
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ExportOptions options;
+  if (!ParseOptions(argc, argv, options)) {
+    PrintUsage();
+    return 1;
+  }
+  WAIFU_TRACE_THREAD_NAME("main");
+  std::filesystem::create_directories(options.out_dir);
+
+  rdc::VulkanDriverConfig config;
+  config.headless = true;
+  config.initial_width = 0;
+  config.initial_height = 0;
+  if (options.validate) {
+    config.instance_layers.emplace_back("VK_LAYER_KHRONOS_validation");
+  }
+  rdc::VulkanDriver::InitSingleton(config);
+
+  int failures = 0;
+  std::vector<std::future<bool>> writes;
+  {
+    rdc::OffscreenRenderer offscreen;
+    auto *model_renderer = offscreen.GetModelRenderer();
+
+    // decode the next document on the workers while this one renders
+    auto load = [](const std::string &path) {
+      return std::make_unique<editor::DocumentLoadTask>(
+          editor::DocumentLoadTask::Source::kProject, path);
+    };
+    auto next_task = load(options.documents.front());
+    for (size_t i = 0; i < options.documents.size(); ++i) {
+      auto task = std::move(next_task);
+      if (i + 1 < options.documents.size()) {
+        next_task = load(options.documents[i + 1]);
+      }
+      task->Wait();
+      auto job = std::make_shared<ExportJob>();
+      job->document = task->TakeDocument();
+      if (!job->document) {
+        std::cerr << "Failed to load document: " << task->GetPath() << "\n";
+        ++failures;
+        continue;
+      }
+      job->output = options.out_dir /
+                    std::filesystem::path(task->GetPath()).stem();
+      job->output += ".png";
+
+      // the previous document's layers stay alive in its own job
+      model_renderer->ClearLayers();
+      for (auto *layer : editor::CollectImageLayers(*job->document)) {
+        job->layers.push_back(editor::CreateLayerResource(layer));
+        auto *resource = job->layers.back().get();
+        model_renderer->SetLayerVisible(
+            resource,
+            layer->GetLayerData<editor::ImageLayerData>()->is_visible());
+        model_renderer->AddLayer(resource);
+      }
+      auto const canvas_size = job->document->GetCanvasSize();
+      model_renderer->SetCanvasSize(static_cast<uint32_t>(canvas_size.x),
+                                    static_cast<uint32_t>(canvas_size.y));
+      auto const width = static_cast<uint32_t>(
+          std::max(1.0f, std::round(canvas_size.x * options.scale)));
+      auto const height = static_cast<uint32_t>(
+          std::max(1.0f, std::round(canvas_size.y * options.scale)));
+
+      // runs while a later frame renders, the png is encoded on the workers
+      offscreen.Render(
+          width, height,
+          [job, &writes](const rdc::OffscreenRenderer::Readback &readback) {
+            auto pixels = std::make_shared<std::vector<uint8_t>>(
+                Unpremultiply(readback));
+            writes.push_back(ThreadPool::GetGlobal()->Submit(
+                [output = job->output, pixels, width = readback.width,
+                 height = readback.height]() {
+                  bool const ok =
+                      stbi_write_png(output.string().c_str(), width, height, 4,
+                                     pixels->data(), 0) != 0;
+                  std::cout << (ok ? "Exported " : "Failed to write ")
+                            << output.string() << "\n";
+                  return ok;
+                }));
+          });
+    }
+    // the last callback frees the last job's layers
+    model_renderer->ClearLayers();
+    offscreen.Finish();
+  }
+  for (auto &write : writes) {
+    if (!write.get()) {
+      ++failures;
+    }
+  }
+  rdc::VulkanDriver::CleanupSingleton();
+  if (!options.trace_path.empty() && !WAIFU_TRACE_DUMP(options.trace_path)) {
+    std::cerr << "Failed to write trace to " << options.trace_path << "\n";
+  }
+  return failures == 0 ? 0 : 1;
+}
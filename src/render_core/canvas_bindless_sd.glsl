@@ -0,0 +1,65 @@
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(binding = 0, std140) uniform UniformBufferObject{
+    vec2 region_offset;
+    vec2 screen_size;
+    float region_scale;
+} ubo; // v
+
+// one entry per layer, indexed by gl_InstanceIndex (the draw's firstInstance)
+struct DrawData {
+    vec4 transform; // xy scale, zw offset in canvas space
+    uint texture_index;
+    float opacity;
+    vec2 padding;
+};
+
+layout(binding = 1, std430) readonly buffer DrawBuffer{
+    DrawData draws[];
+} draw_buffer; // v
+
+layout(binding = 2) uniform sampler2D layer_textures[]; // f
+
+#ifdef VERTEX
+layout(location = 0) in vec2 in_pos;
+layout(location = 1) in vec2 in_uv;
+
+layout(location = 0) out vec2 out_uv;
+layout(location = 1) flat out uint out_texture_index;
+layout(location = 2) flat out float out_opacity;
+
+void main(){
+    DrawData draw = draw_buffer.draws[gl_InstanceIndex];
+    vec2 pos = in_pos * draw.transform.xy + draw.transform.zw;
+    pos = pos * ubo.region_scale + ubo.region_offset;
+    pos.x = pos.x * 2.0 / ubo.screen_size.x - 1.0;
+    pos.y = pos.y * 2.0 / ubo.screen_size.y - 1.0;
+    gl_Position = vec4(pos.xy, 0.0, 1.0);
+    out_uv = in_uv;
+    out_texture_index = draw.texture_index;
+    out_opacity = draw.opacity;
+}
+#endif
+
+#ifdef FRAGMENT
+layout(location = 0) in vec2 in_uv;
+layout(location = 1) flat in uint in_texture_index;
+layout(location = 2) flat in float in_opacity;
+
+layout(location = 0) out vec4 out_color; /*
+{
+    "format": "srgba32",
+}
+*/
+
+void main(){
+    vec4 result_color = texture(layer_textures[nonuniformEXT(in_texture_index)], in_uv);
+    // textures are premultiplied, opacity scales color and alpha alike
+    result_color *= in_opacity;
+    if (result_color.a < 0.01) {
+        discard;
+    }
+    out_color = result_color;
+}
+
+#endif
@@ -6,6 +6,10 @@ layout(binding = 0, std140) uniform UniformBufferObject{
 
 layout(binding = 1) uniform sampler2D main_tex; // f
 
+layout(push_constant) uniform LayerConstants{
+    float opacity;
+} layer_constants;
+
 #ifdef VERTEX
 layout(location = 0) in vec2 in_pos;
 layout(location = 1) in vec2 in_uv;
@@ -32,6 +36,8 @@ layout(location = 0) out vec4 out_color; /*
 
 void main(){
     vec4 result_color = texture(main_tex, in_uv);
+    // textures are premultiplied, opacity scales color and alpha alike
+    result_color *= layer_constants.opacity;
     if (result_color.a < 0.01) {
         discard; // 丢弃透明像素
     }
@@ -0,0 +1,114 @@
+#include "frame_ring.h"
+
+#include <algorithm>
+
+#include "render_core/vulkan_driver.h"
+
+namespace {
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+}  // namespace
+
+namespace rdc {
+FrameRing::FrameRing(VmaAllocator allocator, uint32_t frames_in_flight,
+                     VkDeviceSize segment_size,
+                     VkDeviceSize uniform_alignment,
+                     VkDeviceSize storage_alignment)
+    : _allocator(allocator),
+      _uniform_alignment(std::max<VkDeviceSize>(uniform_alignment, 1)),
+      _storage_alignment(std::max<VkDeviceSize>(storage_alignment, 1)) {
+  // offset alignments are powers of two no larger than 256, keeping every
+  // segment start on that boundary keeps ring offsets aligned too
+  _segment_size = AlignUp(
+      segment_size, std::max({_uniform_alignment, _storage_alignment,
+                              VkDeviceSize{256}}));
+  _ring = CreateBuffer(_segment_size * frames_in_flight);
+  _segments.resize(frames_in_flight);
+  for (uint32_t i = 0; i < frames_in_flight; ++i) {
+    _segments[i].offset = _segment_size * i;
+  }
+}
+
+FrameRing::~FrameRing() {
+  for (auto &segment : _segments) {
+    for (auto &overflow : segment.overflow) {
+      vmaDestroyBuffer(_allocator, overflow.buffer, overflow.allocation);
+    }
+  }
+  vmaDestroyBuffer(_allocator, _ring.buffer, _ring.allocation);
+}
+
+FrameRing::Buffer FrameRing::CreateBuffer(VkDeviceSize capacity) const {
+  // coherent so writes need no flush, device local when the heap allows it
+  VmaAllocationCreateInfo const alloc_info = {
+      .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+  };
+  VkBufferCreateInfo const buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .size = capacity,
+      .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+               VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+               VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+               VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  Buffer buffer;
+  VmaAllocationInfo allocation_info;
+  AssertVkResult(vmaCreateBuffer(_allocator, &buffer_info, &alloc_info,
+                                 &buffer.buffer, &buffer.allocation,
+                                 &allocation_info),
+                 "Failed to create frame ring buffer");
+  buffer.data = static_cast<uint8_t *>(allocation_info.pMappedData);
+  buffer.capacity = capacity;
+  return buffer;
+}
+
+void FrameRing::BeginFrame(uint32_t frame_index) {
+  _current_segment = frame_index;
+  auto &segment = _segments[frame_index];
+  segment.head = 0;
+  for (auto &overflow : segment.overflow) {
+    vmaDestroyBuffer(_allocator, overflow.buffer, overflow.allocation);
+  }
+  segment.overflow.clear();
+}
+
+FrameAllocation FrameRing::Allocate(VkDeviceSize size,
+                                    VkDeviceSize alignment) {
+  auto &segment = _segments[_current_segment];
+  VkDeviceSize const aligned = AlignUp(segment.head, alignment);
+  if (aligned + size <= _segment_size) {
+    segment.head = aligned + size;
+    return {
+        .buffer = _ring.buffer,
+        .offset = segment.offset + aligned,
+        .size = size,
+        .data = _ring.data + segment.offset + aligned,
+    };
+  }
+
+  // the segment is full, spill into a buffer released with the segment
+  if (segment.overflow.empty() ||
+      AlignUp(segment.overflow.back().head, alignment) + size >
+          segment.overflow.back().capacity) {
+    segment.overflow.push_back(CreateBuffer(std::max(size, _segment_size)));
+  }
+  auto &overflow = segment.overflow.back();
+  VkDeviceSize const overflow_offset = AlignUp(overflow.head, alignment);
+  overflow.head = overflow_offset + size;
+  return {
+      .buffer = overflow.buffer,
+      .offset = overflow_offset,
+      .size = size,
+      .data = overflow.data + overflow_offset,
+  };
+}
+}  // namespace rdc
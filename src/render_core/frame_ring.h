@@ -0,0 +1,76 @@
+#ifndef RENDER_CORE_FRAME_RING_H_
+#define RENDER_CORE_FRAME_RING_H_
+
+#include <vk_mem_alloc.h>
+#include <volk.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "tools.hpp"
+
+namespace rdc {
+
+struct FrameAllocation {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  void *data = nullptr;
+};
+
+// persistently mapped buffer split into one segment per frame in flight.
+// memory handed out is reused only when the same frame slot comes round
+// again, after its fence, so writing it never races the gpu. allocate only
+// between BeginFrame and that frame's submit
+class FrameRing : public NoCopyable {
+  struct Buffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    uint8_t *data = nullptr;
+    VkDeviceSize capacity = 0;
+    VkDeviceSize head = 0;
+  };
+  struct Segment {
+    VkDeviceSize offset = 0;
+    VkDeviceSize head = 0;
+    // extra buffers when a frame outgrows its segment
+    std::vector<Buffer> overflow;
+  };
+
+  VmaAllocator _allocator = VK_NULL_HANDLE;
+  Buffer _ring;
+  VkDeviceSize _segment_size = 0;
+  std::vector<Segment> _segments;
+  uint32_t _current_segment = 0;
+  VkDeviceSize _uniform_alignment = 256;
+  VkDeviceSize _storage_alignment = 256;
+
+  Buffer CreateBuffer(VkDeviceSize capacity) const;
+
+ public:
+  FrameRing(VmaAllocator allocator, uint32_t frames_in_flight,
+            VkDeviceSize segment_size, VkDeviceSize uniform_alignment,
+            VkDeviceSize storage_alignment);
+  ~FrameRing() override;
+
+  // the frame's fence must have signaled
+  void BeginFrame(uint32_t frame_index);
+  FrameAllocation Allocate(VkDeviceSize size, VkDeviceSize alignment);
+  FrameAllocation AllocateUniform(VkDeviceSize size) {
+    return Allocate(size, _uniform_alignment);
+  }
+  FrameAllocation AllocateStorage(VkDeviceSize size) {
+    return Allocate(size, _storage_alignment);
+  }
+  template <typename T>
+  FrameAllocation PushUniform(const T &value) {
+    auto allocation = AllocateUniform(sizeof(T));
+    memcpy(allocation.data, &value, sizeof(T));
+    return allocation;
+  }
+};
+
+}  // namespace rdc
+
+#endif  // RENDER_CORE_FRAME_RING_H_
@@ -0,0 +1,301 @@
+#include "geometry_arena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+
+#include "render_core/frame_ring.h"
+#include "render_core/vulkan_driver.h"
+
+namespace {
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+}  // namespace
+
+namespace rdc {
+RangeAllocator::RangeAllocator(VkDeviceSize capacity) : _capacity(capacity) {
+  if (capacity > 0) {
+    _free_ranges.emplace(0, capacity);
+  }
+}
+
+bool RangeAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment,
+                              VkDeviceSize &offset) {
+  for (auto it = _free_ranges.begin(); it != _free_ranges.end(); ++it) {
+    VkDeviceSize const range_offset = it->first;
+    VkDeviceSize const range_end = it->first + it->second;
+    VkDeviceSize const aligned = AlignUp(range_offset, alignment);
+    if (aligned + size > range_end) {
+      continue;
+    }
+    _free_ranges.erase(it);
+    if (aligned > range_offset) {
+      _free_ranges.emplace(range_offset, aligned - range_offset);
+    }
+    if (aligned + size < range_end) {
+      _free_ranges.emplace(aligned + size, range_end - aligned - size);
+    }
+    offset = aligned;
+    return true;
+  }
+  return false;
+}
+
+void RangeAllocator::Free(VkDeviceSize offset, VkDeviceSize size) {
+  if (size == 0) {
+    return;
+  }
+  auto next = _free_ranges.lower_bound(offset);
+  if (next != _free_ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      _free_ranges.erase(prev);
+    }
+  }
+  if (next != _free_ranges.end() && offset + size == next->first) {
+    size += next->second;
+    _free_ranges.erase(next);
+  }
+  _free_ranges.emplace(offset, size);
+}
+
+void RangeAllocator::Grow(VkDeviceSize new_capacity) {
+  if (new_capacity <= _capacity) {
+    return;
+  }
+  VkDeviceSize const old_capacity = _capacity;
+  _capacity = new_capacity;
+  Free(old_capacity, new_capacity - old_capacity);
+}
+
+GeometryArena::GeometryArena(VmaAllocator allocator, FrameRing *frame_ring,
+                             uint32_t frames_in_flight,
+                             VkDeviceSize vertex_capacity,
+                             VkDeviceSize index_capacity)
+    : _allocator(allocator),
+      _frame_ring(frame_ring),
+      _frames_in_flight(frames_in_flight) {
+  _vertex_pool.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  _index_pool.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                      VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  CreatePoolBuffer(_vertex_pool, vertex_capacity);
+  _vertex_pool.ranges = RangeAllocator(vertex_capacity);
+  CreatePoolBuffer(_index_pool, index_capacity);
+  _index_pool.ranges = RangeAllocator(index_capacity);
+}
+
+GeometryArena::~GeometryArena() {
+  for (auto &retired : _retired_buffers) {
+    vmaDestroyBuffer(_allocator, retired.buffer, retired.allocation);
+  }
+  vmaDestroyBuffer(_allocator, _vertex_pool.buffer, _vertex_pool.allocation);
+  vmaDestroyBuffer(_allocator, _index_pool.buffer, _index_pool.allocation);
+}
+
+void GeometryArena::CreatePoolBuffer(Pool &pool, VkDeviceSize capacity) {
+  VmaAllocationCreateInfo const alloc_info = {
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+  };
+  VkBufferCreateInfo const buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .size = capacity,
+      .usage = pool.usage,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  AssertVkResult(vmaCreateBuffer(_allocator, &buffer_info, &alloc_info,
+                                 &pool.buffer, &pool.allocation, nullptr),
+                 "Failed to create geometry arena buffer");
+}
+
+bool GeometryArena::AllocateFrom(Pool &pool, VkDeviceSize size,
+                                 VkDeviceSize alignment, VkDeviceSize &offset) {
+  if (pool.ranges.Allocate(size, alignment, offset)) {
+    return true;
+  }
+  // move everything into a larger buffer, the contents are copied on the gpu
+  // with this frame's other copies. recorded frames keep reading the old
+  // buffer until they retire
+  VkDeviceSize const old_capacity = pool.ranges.GetCapacity();
+  VkDeviceSize const new_capacity =
+      std::max(old_capacity * 2, old_capacity + size + alignment);
+  _retired_buffers.push_back({
+      .buffer = pool.buffer,
+      .allocation = pool.allocation,
+      .frame_number = _frame_number,
+  });
+  // a second growth in the same frame still copies from the original, the
+  // intermediate buffer never received anything
+  if (pool.grow_source == VK_NULL_HANDLE) {
+    pool.grow_source = pool.buffer;
+    pool.grow_size = old_capacity;
+  }
+  CreatePoolBuffer(pool, new_capacity);
+  pool.ranges.Grow(new_capacity);
+  return pool.ranges.Allocate(size, alignment, offset);
+}
+
+void GeometryArena::Stage(Pool &pool, VkDeviceSize dst_offset,
+                          const void *data, VkDeviceSize size) {
+  auto staging = _frame_ring->Allocate(size, sizeof(uint32_t));
+  memcpy(staging.data, data, size);
+  _staged_bytes += size;
+  pool.pending.push_back({
+      .src = staging.buffer,
+      .region =
+          {
+              .srcOffset = staging.offset,
+              .dstOffset = dst_offset,
+              .size = size,
+          },
+  });
+}
+
+GeometryAllocation GeometryArena::Allocate(VkDeviceSize vertex_size,
+                                           VkDeviceSize vertex_stride,
+                                           VkDeviceSize index_size) {
+  GeometryAllocation allocation;
+  if (vertex_size > 0 &&
+      AllocateFrom(_vertex_pool, vertex_size, vertex_stride,
+                   allocation.vertex_offset)) {
+    allocation.vertex_size = vertex_size;
+  }
+  if (index_size > 0 &&
+      AllocateFrom(_index_pool, index_size, sizeof(uint32_t),
+                   allocation.index_offset)) {
+    allocation.index_size = index_size;
+  }
+  return allocation;
+}
+
+void GeometryArena::Free(const GeometryAllocation &allocation) {
+  if (allocation.IsEmpty()) {
+    return;
+  }
+  _retired_ranges.push_back({
+      .allocation = allocation,
+      .frame_number = _frame_number,
+  });
+}
+
+void GeometryArena::Write(const GeometryAllocation &allocation,
+                          const void *vertices, const void *indices) {
+  WriteVertices(allocation, 0, vertices, allocation.vertex_size);
+  WriteIndices(allocation, 0, indices, allocation.index_size);
+}
+
+void GeometryArena::WriteVertices(const GeometryAllocation &allocation,
+                                  VkDeviceSize offset, const void *data,
+                                  VkDeviceSize size) {
+  assert(offset + size <= allocation.vertex_size);
+  if (size > 0) {
+    Stage(_vertex_pool, allocation.vertex_offset + offset, data, size);
+  }
+}
+
+void GeometryArena::WriteIndices(const GeometryAllocation &allocation,
+                                 VkDeviceSize offset, const void *data,
+                                 VkDeviceSize size) {
+  assert(offset + size <= allocation.index_size);
+  if (size > 0) {
+    Stage(_index_pool, allocation.index_offset + offset, data, size);
+  }
+}
+
+void GeometryArena::RecordPoolCopies(VkCommandBuffer command_buffer,
+                                     Pool &pool) {
+  // one copy command per run of regions sharing a staging buffer
+  std::vector<VkBufferCopy> regions;
+  for (size_t i = 0; i < pool.pending.size(); ++i) {
+    regions.push_back(pool.pending[i].region);
+    if (i + 1 == pool.pending.size() ||
+        pool.pending[i + 1].src != pool.pending[i].src) {
+      vkCmdCopyBuffer(command_buffer, pool.pending[i].src, pool.buffer,
+                      static_cast<uint32_t>(regions.size()), regions.data());
+      regions.clear();
+    }
+  }
+  pool.pending.clear();
+}
+
+void GeometryArena::RecordPendingCopies(VkCommandBuffer command_buffer) {
+  bool const has_grow = _vertex_pool.grow_source != VK_NULL_HANDLE ||
+                        _index_pool.grow_source != VK_NULL_HANDLE;
+  if (!has_grow && _vertex_pool.pending.empty() &&
+      _index_pool.pending.empty()) {
+    return;
+  }
+  auto const barrier = [command_buffer](VkAccessFlags src_access,
+                                        VkAccessFlags dst_access,
+                                        VkPipelineStageFlags src_stage,
+                                        VkPipelineStageFlags dst_stage) {
+    VkMemoryBarrier const memory_barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = src_access,
+        .dstAccessMask = dst_access,
+    };
+    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 1,
+                         &memory_barrier, 0, nullptr, 0, nullptr);
+  };
+  // earlier frames may still read ranges that are about to be overwritten
+  barrier(0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+          VK_PIPELINE_STAGE_TRANSFER_BIT);
+  if (has_grow) {
+    for (auto *pool : {&_vertex_pool, &_index_pool}) {
+      if (pool->grow_source == VK_NULL_HANDLE) {
+        continue;
+      }
+      VkBufferCopy const region = {
+          .srcOffset = 0,
+          .dstOffset = 0,
+          .size = pool->grow_size,
+      };
+      vkCmdCopyBuffer(command_buffer, pool->grow_source, pool->buffer, 1,
+                      &region);
+      pool->grow_source = VK_NULL_HANDLE;
+      pool->grow_size = 0;
+    }
+    barrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+  }
+  RecordPoolCopies(command_buffer, _vertex_pool);
+  RecordPoolCopies(command_buffer, _index_pool);
+  barrier(VK_ACCESS_TRANSFER_WRITE_BIT,
+          VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+}
+
+void GeometryArena::BeginFrame(uint64_t frame_number) {
+  _frame_number = frame_number;
+  auto const is_finished = [&](uint64_t retired_frame) {
+    return retired_frame + _frames_in_flight <= frame_number;
+  };
+  std::erase_if(_retired_ranges, [&](const RetiredRange &retired) {
+    if (!is_finished(retired.frame_number)) {
+      return false;
+    }
+    _vertex_pool.ranges.Free(retired.allocation.vertex_offset,
+                             retired.allocation.vertex_size);
+    _index_pool.ranges.Free(retired.allocation.index_offset,
+                            retired.allocation.index_size);
+    return true;
+  });
+  std::erase_if(_retired_buffers, [&](const RetiredBuffer &retired) {
+    if (!is_finished(retired.frame_number)) {
+      return false;
+    }
+    vmaDestroyBuffer(_allocator, retired.buffer, retired.allocation);
+    return true;
+  });
+}
+}  // namespace rdc
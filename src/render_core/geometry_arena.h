@@ -0,0 +1,133 @@
+#ifndef RENDER_CORE_GEOMETRY_ARENA_H_
+#define RENDER_CORE_GEOMETRY_ARENA_H_
+
+#include <vk_mem_alloc.h>
+#include <volk.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "tools.hpp"
+
+namespace rdc {
+class FrameRing;
+
+// first fit allocator over [0, capacity), freed ranges are merged with their
+// neighbours
+class RangeAllocator {
+  // offset -> size
+  std::map<VkDeviceSize, VkDeviceSize> _free_ranges;
+  VkDeviceSize _capacity = 0;
+
+ public:
+  explicit RangeAllocator(VkDeviceSize capacity = 0);
+  bool Allocate(VkDeviceSize size, VkDeviceSize alignment,
+                VkDeviceSize &offset);
+  void Free(VkDeviceSize offset, VkDeviceSize size);
+  // append [capacity, new_capacity) to the free space
+  void Grow(VkDeviceSize new_capacity);
+  VkDeviceSize GetCapacity() const { return _capacity; }
+};
+
+// a sub-range of the shared vertex and index buffers, offsets in bytes
+struct GeometryAllocation {
+  VkDeviceSize vertex_offset = 0;
+  VkDeviceSize vertex_size = 0;
+  VkDeviceSize index_offset = 0;
+  VkDeviceSize index_size = 0;
+  bool IsEmpty() const { return vertex_size == 0 && index_size == 0; }
+};
+
+// one device local vertex buffer and one index buffer shared by every mesh,
+// so a whole model draws with a single bind and per-draw offsets. writes are
+// staged in the frame ring and copied at the start of the frame's command
+// buffer, ordered after earlier frames' reads. freed ranges and buffers
+// replaced by growth are kept alive until the frames that may still read
+// them have finished
+class GeometryArena : public NoCopyable {
+  struct PendingCopy {
+    VkBuffer src = VK_NULL_HANDLE;
+    VkBufferCopy region = {};
+  };
+  struct Pool {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    VkBufferUsageFlags usage = 0;
+    RangeAllocator ranges;
+    // contents to carry over from the buffer replaced by growth this frame
+    VkBuffer grow_source = VK_NULL_HANDLE;
+    VkDeviceSize grow_size = 0;
+    std::vector<PendingCopy> pending;
+  };
+  struct RetiredBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    uint64_t frame_number = 0;
+  };
+  struct RetiredRange {
+    GeometryAllocation allocation;
+    uint64_t frame_number = 0;
+  };
+
+  VmaAllocator _allocator = VK_NULL_HANDLE;
+  FrameRing *_frame_ring = nullptr;
+  uint32_t _frames_in_flight = 1;
+  uint64_t _frame_number = 0;
+  Pool _vertex_pool;
+  Pool _index_pool;
+  std::vector<RetiredBuffer> _retired_buffers;
+  std::vector<RetiredRange> _retired_ranges;
+  VkDeviceSize _staged_bytes = 0;
+
+  void CreatePoolBuffer(Pool &pool, VkDeviceSize capacity);
+  bool AllocateFrom(Pool &pool, VkDeviceSize size, VkDeviceSize alignment,
+                    VkDeviceSize &offset);
+  void Stage(Pool &pool, VkDeviceSize dst_offset, const void *data,
+             VkDeviceSize size);
+  static void RecordPoolCopies(VkCommandBuffer command_buffer, Pool &pool);
+
+ public:
+  GeometryArena(VmaAllocator allocator, FrameRing *frame_ring,
+                uint32_t frames_in_flight, VkDeviceSize vertex_capacity,
+                VkDeviceSize index_capacity);
+  ~GeometryArena() override;
+
+  // vertex ranges are aligned to vertex_stride so they can be addressed by
+  // vertex index. the buffers grow when the request does not fit
+  GeometryAllocation Allocate(VkDeviceSize vertex_size,
+                              VkDeviceSize vertex_stride,
+                              VkDeviceSize index_size);
+  // the range becomes reusable once the current frame has finished
+  void Free(const GeometryAllocation &allocation);
+  // stages the data in the frame ring, only valid between
+  // VulkanDriver::BeginFrame and the frame's recording
+  void Write(const GeometryAllocation &allocation, const void *vertices,
+             const void *indices);
+  // partial writes, offset and size in bytes relative to the allocation
+  void WriteVertices(const GeometryAllocation &allocation, VkDeviceSize offset,
+                     const void *data, VkDeviceSize size);
+  void WriteIndices(const GeometryAllocation &allocation, VkDeviceSize offset,
+                    const void *data, VkDeviceSize size);
+  // copies staged this frame, must be recorded outside of rendering and
+  // before any draw that reads the arena
+  void RecordPendingCopies(VkCommandBuffer command_buffer);
+
+  // releases what frames before frame_number - frames_in_flight retired
+  void BeginFrame(uint64_t frame_number);
+
+  // bytes written since startup
+  VkDeviceSize GetStagedBytes() const { return _staged_bytes; }
+  VkBuffer GetVertexBuffer() const { return _vertex_pool.buffer; }
+  VkBuffer GetIndexBuffer() const { return _index_pool.buffer; }
+  VkDeviceSize GetVertexCapacity() const {
+    return _vertex_pool.ranges.GetCapacity();
+  }
+  VkDeviceSize GetIndexCapacity() const {
+    return _index_pool.ranges.GetCapacity();
+  }
+};
+
+}  // namespace rdc
+
+#endif  // RENDER_CORE_GEOMETRY_ARENA_H_
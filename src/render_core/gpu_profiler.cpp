@@ -0,0 +1,156 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include "vulkan_driver.h"
+
+namespace rdc {
+
+GpuProfiler::GpuProfiler(VkDevice device, uint32_t frames_in_flight,
+                         float timestamp_period, uint32_t timestamp_valid_bits)
+    : _device(device), _timestamp_period(timestamp_period) {
+  _slots.resize(frames_in_flight);
+  if (timestamp_valid_bits == 0) {
+    return;
+  }
+  if (timestamp_valid_bits < 64) {
+    _timestamp_mask = (uint64_t{1} << timestamp_valid_bits) - 1;
+  }
+  VkQueryPoolCreateInfo const pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = frames_in_flight * kMaxScopesPerFrame * 2,
+      .pipelineStatistics = 0,
+  };
+  AssertVkResult(vkCreateQueryPool(_device, &pool_info, nullptr, &_query_pool),
+                 "Failed to create timestamp query pool");
+}
+
+GpuProfiler::~GpuProfiler() {
+  vkDestroyQueryPool(_device, _query_pool, nullptr);
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer command_buffer,
+                             uint32_t frame_index, uint64_t frame_number) {
+  if (!IsSupported()) {
+    return;
+  }
+  auto &slot = _slots[frame_index];
+  uint32_t const query_base = frame_index * kMaxScopesPerFrame * 2;
+  if (slot.pending) {
+    Collect(slot, query_base);
+  }
+  slot.scopes.clear();
+  slot.pending = false;
+  if (!_enabled) {
+    return;
+  }
+  vkCmdResetQueryPool(command_buffer, _query_pool, query_base,
+                      kMaxScopesPerFrame * 2);
+  slot.frame_number = frame_number;
+  _recording = &slot;
+  _query_base = query_base;
+  _depth = 0;
+}
+
+void GpuProfiler::EndFrame() {
+  if (_recording) {
+    _recording->pending = !_recording->scopes.empty();
+    _recording = nullptr;
+  }
+}
+
+uint32_t GpuProfiler::BeginScope(VkCommandBuffer command_buffer,
+                                 const char *name, int32_t index) {
+  if (!_recording) {
+    return UINT32_MAX;
+  }
+  if (_recording->scopes.size() >= kMaxScopesPerFrame) {
+    ++_dropped_scopes;
+    return UINT32_MAX;
+  }
+  auto const scope = static_cast<uint32_t>(_recording->scopes.size());
+  _recording->scopes.push_back({name, index, _depth++});
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      _query_pool, _query_base + scope * 2);
+  return scope;
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer command_buffer, uint32_t scope) {
+  if (!_recording || scope == UINT32_MAX) {
+    return;
+  }
+  --_depth;
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      _query_pool, _query_base + scope * 2 + 1);
+}
+
+void GpuProfiler::Collect(FrameSlot &slot, uint32_t query_base) {
+  auto const query_count = static_cast<uint32_t>(slot.scopes.size() * 2);
+  // value and availability per query, never waits
+  _results.resize(static_cast<size_t>(query_count) * 2);
+  VkResult const result = vkGetQueryPoolResults(
+      _device, _query_pool, query_base, query_count,
+      _results.size() * sizeof(uint64_t), _results.data(),
+      sizeof(uint64_t) * 2,
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if (result != VK_SUCCESS && result != VK_NOT_READY) {
+    return;
+  }
+
+  GpuFrameTimings frame = {.frame_number = slot.frame_number};
+  frame.scopes.reserve(slot.scopes.size());
+  uint64_t first_begin = UINT64_MAX;
+  uint64_t last_end = 0;
+  for (size_t i = 0; i < slot.scopes.size(); ++i) {
+    const uint64_t *begin = &_results[i * 4];
+    const uint64_t *end = &_results[i * 4 + 2];
+    if (begin[1] == 0 || end[1] == 0) {
+      continue;
+    }
+    uint64_t const ticks = (end[0] - begin[0]) & _timestamp_mask;
+    const auto &pending = slot.scopes[i];
+    frame.scopes.push_back({
+        .name = pending.name,
+        .index = pending.index,
+        .depth = pending.depth,
+        .ms = static_cast<float>(ticks) * _timestamp_period * 1e-6f,
+    });
+    first_begin = std::min(first_begin, begin[0]);
+    last_end = std::max(last_end, end[0]);
+  }
+  if (frame.scopes.empty()) {
+    return;
+  }
+  frame.total_ms = static_cast<float>((last_end - first_begin) &
+                                      _timestamp_mask) *
+                   _timestamp_period * 1e-6f;
+  if (_history.size() == kHistorySize) {
+    _history.pop_front();
+  }
+  _history.push_back(std::move(frame));
+}
+
+bool GpuProfiler::ExportCsv(const std::string &path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  file << "frame,scope,index,depth,ms\n";
+  for (const auto &frame : _history) {
+    file << frame.frame_number << ",frame,,0," << frame.total_ms << '\n';
+    for (const auto &scope : frame.scopes) {
+      file << frame.frame_number << ',' << scope.name << ',';
+      if (scope.index >= 0) {
+        file << scope.index;
+      }
+      file << ',' << scope.depth + 1 << ',' << scope.ms << '\n';
+    }
+  }
+  return static_cast<bool>(file);
+}
+
+}  // namespace rdc
@@ -0,0 +1,119 @@
+#ifndef RENDER_CORE_GPU_PROFILER_H_
+#define RENDER_CORE_GPU_PROFILER_H_
+
+#include <volk.h>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "tools.hpp"
+
+namespace rdc {
+
+struct GpuScopeTiming {
+  // a string literal, scopes never own their names
+  const char *name = nullptr;
+  // distinguishes repeated scopes such as layer batches, -1 when unused
+  int32_t index = -1;
+  uint32_t depth = 0;
+  float ms = 0.0f;
+};
+
+struct GpuFrameTimings {
+  uint64_t frame_number = 0;
+  // first scope begin to last scope end
+  float total_ms = 0.0f;
+  std::vector<GpuScopeTiming> scopes;
+};
+
+// timestamp queries around scopes of a frame's command buffer. every frame
+// in flight owns a range of the query pool, its results are read once the
+// slot comes round again, by then its fence has signaled so the read never
+// waits on the gpu
+class GpuProfiler : public NoCopyable {
+  static constexpr uint32_t kMaxScopesPerFrame = 256;
+  static constexpr size_t kHistorySize = 240;
+
+  struct PendingScope {
+    const char *name;
+    int32_t index;
+    uint32_t depth;
+  };
+  struct FrameSlot {
+    uint64_t frame_number = 0;
+    // scopes recorded by the frame last submitted from this slot, the
+    // queries of scope i are 2 * i and 2 * i + 1 past the slot's base
+    std::vector<PendingScope> scopes;
+    bool pending = false;
+  };
+
+  VkDevice _device = VK_NULL_HANDLE;
+  VkQueryPool _query_pool = VK_NULL_HANDLE;
+  // nanoseconds per timestamp tick
+  float _timestamp_period = 1.0f;
+  uint64_t _timestamp_mask = ~uint64_t{0};
+  bool _enabled = true;
+
+  std::vector<FrameSlot> _slots;
+  FrameSlot *_recording = nullptr;
+  uint32_t _query_base = 0;
+  uint32_t _depth = 0;
+  uint32_t _dropped_scopes = 0;
+
+  std::deque<GpuFrameTimings> _history;
+  std::vector<uint64_t> _results;
+
+  void Collect(FrameSlot &slot, uint32_t query_base);
+
+ public:
+  // timestamp_valid_bits of the graphics queue family, 0 disables profiling
+  GpuProfiler(VkDevice device, uint32_t frames_in_flight,
+              float timestamp_period, uint32_t timestamp_valid_bits);
+  ~GpuProfiler() override;
+
+  bool IsSupported() const { return _query_pool != VK_NULL_HANDLE; }
+  bool IsEnabled() const { return IsSupported() && _enabled; }
+  // takes effect on the next BeginFrame
+  void SetEnabled(bool enabled) { _enabled = enabled; }
+
+  // right after the frame's command buffer began, the slot's fence must
+  // have signaled. collects the slot's previous results and resets its
+  // queries
+  void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_index,
+                  uint64_t frame_number);
+  // before the command buffer ends, scopes outside a frame are ignored
+  void EndFrame();
+
+  // returns the scope id for EndScope, UINT32_MAX when it is not recorded
+  uint32_t BeginScope(VkCommandBuffer command_buffer, const char *name,
+                      int32_t index = -1);
+  void EndScope(VkCommandBuffer command_buffer, uint32_t scope);
+
+  // oldest first
+  const std::deque<GpuFrameTimings> &GetHistory() const { return _history; }
+  // scopes over the per frame budget since startup
+  uint32_t GetDroppedScopes() const { return _dropped_scopes; }
+  // one row per scope of every frame in the history
+  bool ExportCsv(const std::string &path) const;
+};
+
+// records a scope for the lifetime of the object
+class GpuScope : public NoCopyable {
+  GpuProfiler *_profiler;
+  VkCommandBuffer _command_buffer;
+  uint32_t _scope;
+
+ public:
+  GpuScope(GpuProfiler *profiler, VkCommandBuffer command_buffer,
+           const char *name, int32_t index = -1)
+      : _profiler(profiler),
+        _command_buffer(command_buffer),
+        _scope(profiler->BeginScope(command_buffer, name, index)) {}
+  ~GpuScope() override { _profiler->EndScope(_command_buffer, _scope); }
+};
+
+}  // namespace rdc
+
+#endif  // RENDER_CORE_GPU_PROFILER_H_
@@ -0,0 +1,126 @@
+#include "image_pool.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "render_core/vulkan_driver.h"
+
+namespace rdc {
+
+ImagePool::ImagePool(VkDevice device, VmaAllocator allocator)
+    : _device(device), _allocator(allocator) {}
+
+ImagePool::~ImagePool() { Clear(); }
+
+void ImagePool::Destroy(const Image &image) const {
+  vkDestroyImageView(_device, image.view, nullptr);
+  vmaDestroyImage(_allocator, image.image, image.allocation);
+}
+
+ImagePool::Image ImagePool::Acquire(const VkImageCreateInfo &info) {
+  Desc const desc = {
+      .format = info.format,
+      .extent = {info.extent.width, info.extent.height},
+      .mip_levels = info.mipLevels,
+      .usage = info.usage,
+      .sharing_mode = info.sharingMode,
+  };
+  {
+    std::lock_guard lock(_mutex);
+    // the most recently released match, its memory is the likeliest to be
+    // resident
+    auto const it = std::find_if(
+        _pooled.rbegin(), _pooled.rend(),
+        [&desc](const Image &image) { return image.desc == desc; });
+    if (it != _pooled.rend()) {
+      Image const image = *it;
+      _pooled.erase(std::next(it).base());
+      _stats.pooled_bytes -= image.bytes;
+      ++_stats.hits;
+      return image;
+    }
+    ++_stats.misses;
+  }
+
+  Image image = {.desc = desc};
+  VmaAllocationCreateInfo const alloc_info = {
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+  };
+  VmaAllocationInfo allocation_info;
+  AssertVkResult(vmaCreateImage(_allocator, &info, &alloc_info, &image.image,
+                                &image.allocation, &allocation_info),
+                 "Failed to create image");
+  image.bytes = allocation_info.size;
+  VkImageViewCreateInfo const image_view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .image = image.image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = info.format,
+      .components =
+          {
+              .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+          },
+      .subresourceRange =
+          {
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .baseMipLevel = 0,
+              .levelCount = info.mipLevels,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+          },
+  };
+  AssertVkResult(
+      vkCreateImageView(_device, &image_view_info, nullptr, &image.view),
+      "Failed to create image view");
+  return image;
+}
+
+void ImagePool::Release(const Image &image) {
+  if (image.image == VK_NULL_HANDLE) {
+    return;
+  }
+  std::lock_guard lock(_mutex);
+  _pooled.push_back(image);
+  _stats.pooled_bytes += image.bytes;
+  TrimLocked();
+}
+
+void ImagePool::TrimLocked() {
+  size_t evicted = 0;
+  while (evicted < _pooled.size() && _stats.pooled_bytes > _budget) {
+    _stats.pooled_bytes -= _pooled[evicted].bytes;
+    Destroy(_pooled[evicted]);
+    ++evicted;
+  }
+  _pooled.erase(_pooled.begin(), _pooled.begin() + evicted);
+}
+
+void ImagePool::SetBudget(VkDeviceSize budget) {
+  std::lock_guard lock(_mutex);
+  _budget = budget;
+  TrimLocked();
+}
+
+void ImagePool::Clear() {
+  std::lock_guard lock(_mutex);
+  for (const auto &image : _pooled) {
+    Destroy(image);
+  }
+  _pooled.clear();
+  _stats.pooled_bytes = 0;
+}
+
+ImagePool::Stats ImagePool::GetStats() const {
+  std::lock_guard lock(_mutex);
+  Stats stats = _stats;
+  stats.pooled_images = _pooled.size();
+  return stats;
+}
+
+}  // namespace rdc
@@ -0,0 +1,82 @@
+#ifndef RENDER_CORE_IMAGE_POOL_H_
+#define RENDER_CORE_IMAGE_POOL_H_
+
+#include <vk_mem_alloc.h>
+#include <volk.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "tools.hpp"
+
+namespace rdc {
+
+// recycles images between resources of the same format, extent, mip count
+// and usage, e.g. the layers of two documents opened one after another.
+// released images stay pooled up to a byte budget, the oldest are destroyed
+// first. safe to use from any thread
+class ImagePool : public NoCopyable {
+ public:
+  struct Desc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {0, 0};
+    uint32_t mip_levels = 1;
+    VkImageUsageFlags usage = 0;
+    VkSharingMode sharing_mode = VK_SHARING_MODE_EXCLUSIVE;
+    bool operator==(const Desc &other) const {
+      return format == other.format && extent.width == other.extent.width &&
+             extent.height == other.extent.height &&
+             mip_levels == other.mip_levels && usage == other.usage &&
+             sharing_mode == other.sharing_mode;
+    }
+  };
+  struct Image {
+    Desc desc;
+    VkImage image = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    // covers every mip level
+    VkImageView view = VK_NULL_HANDLE;
+    VkDeviceSize bytes = 0;
+  };
+  struct Stats {
+    size_t pooled_images = 0;
+    VkDeviceSize pooled_bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+  static constexpr VkDeviceSize kDefaultBudget = VkDeviceSize{256} << 20;
+
+ private:
+  VkDevice _device = VK_NULL_HANDLE;
+  VmaAllocator _allocator = VK_NULL_HANDLE;
+  mutable std::mutex _mutex;
+  // oldest first
+  std::vector<Image> _pooled;
+  VkDeviceSize _budget = kDefaultBudget;
+  Stats _stats;
+
+  void Destroy(const Image &image) const;
+  // destroys the oldest pooled images until they fit the budget
+  void TrimLocked();
+
+ public:
+  ImagePool(VkDevice device, VmaAllocator allocator);
+  ~ImagePool() override;
+
+  // a pooled image matching info or a new one. the contents are undefined,
+  // transition it from undefined layout before use
+  Image Acquire(const VkImageCreateInfo &info);
+  // only once the gpu is done with it, e.g. when a retired resource is
+  // destroyed
+  void Release(const Image &image);
+  // bytes kept for reuse, 0 destroys everything released from now on
+  void SetBudget(VkDeviceSize budget);
+  // destroys every pooled image
+  void Clear();
+  Stats GetStats() const;
+};
+
+}  // namespace rdc
+
+#endif  // RENDER_CORE_IMAGE_POOL_H_
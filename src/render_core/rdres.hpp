@@ -1,54 +1,129 @@
 #ifndef RENDER_CORE_RDRES_HPP_
 #define RENDER_CORE_RDRES_HPP_
 
+#include <deque>
+#include <memory>
+#include <vector>
+
 #include "tools.hpp"
 namespace rdc {
+// slot index plus the generation of the slot when the handle was issued, a
+// handle to a released resource never resolves again even once its slot is
+// reused
+struct ResourceHandle {
+  uint32_t index = UINT32_MAX;
+  uint32_t generation = 0;
+  bool IsValid() const { return index != UINT32_MAX; }
+  bool operator==(const ResourceHandle &) const = default;
+};
+
 class IRenderResource {
   friend class RenderResourceManager;
 
  protected:
-  uint32_t _id = UINT32_MAX;
+  ResourceHandle _handle;
 
  public:
-  uint32_t GetId() const { return _id; }
+  ResourceHandle GetHandle() const { return _handle; }
   virtual ~IRenderResource() = default;
 };
 
+// owns render resources in a slot map. released resources leave their slot
+// at once but are destroyed only after every frame that may still use them
+// has finished, so nothing has to wait for the device to go idle
+class RenderResourceManager : public NoCopyable {
+  struct Slot {
+    std::unique_ptr<IRenderResource> resource;
+    // bumped on release, odd while the slot holds a resource
+    uint32_t generation = 0;
+    uint32_t next_free = UINT32_MAX;
+  };
+  struct Retired {
+    std::unique_ptr<IRenderResource> resource;
+    uint64_t frame_number = 0;
+  };
+  std::vector<Slot> _slots;
+  uint32_t _free_head = UINT32_MAX;
+  std::deque<Retired> _retired;
+  uint32_t _frames_in_flight = 1;
+  uint64_t _frame_number = 0;
 
-class RenderResourceManager {
-  std::unordered_map<uint32_t, std::unique_ptr<IRenderResource>> _resources;
-  IdAllocator _id_allocator;
+  const Slot *Resolve(ResourceHandle handle) const {
+    if (handle.index >= _slots.size()) {
+      return nullptr;
+    }
+    const auto &slot = _slots[handle.index];
+    return slot.generation == handle.generation && slot.resource ? &slot
+                                                                 : nullptr;
+  }
 
  public:
+  explicit RenderResourceManager(uint32_t frames_in_flight = 1)
+      : _frames_in_flight(std::max(frames_in_flight, 1u)) {}
+
   template <typename T, typename... Args>
   T *CreateResource(Args &&...args) {
-    auto resource = std::make_unique<T>(std::forward<Args>(args)...);
-    resource->_id = _id_allocator.AllocateId();
-    T *ptr = resource.get();
-    _resources[ptr->_id] = std::move(resource);
-    return ptr;
+    return AddResource(std::make_unique<T>(std::forward<Args>(args)...));
   }
   template <typename T>
   T *AddResource(std::unique_ptr<T> resource) {
-    resource->_id = _id_allocator.AllocateId();
+    uint32_t index = _free_head;
+    if (index == UINT32_MAX) {
+      index = static_cast<uint32_t>(_slots.size());
+      _slots.emplace_back();
+    } else {
+      _free_head = _slots[index].next_free;
+    }
+    auto &slot = _slots[index];
+    ++slot.generation;
+    slot.next_free = UINT32_MAX;
+    resource->_handle = {.index = index, .generation = slot.generation};
     T *ptr = resource.get();
-    _resources[ptr->_id] = std::move(resource);
+    slot.resource = std::move(resource);
     return ptr;
   }
   template <typename T>
   T *AddResource(T *resource) {
-    resource->_id = _id_allocator.AllocateId();
-    T *ptr = resource;
-    _resources[ptr->_id] = std::unique_ptr<T>(resource);
-    return ptr;
+    return AddResource(std::unique_ptr<T>(resource));
   }
 
+  // null when the handle is stale or was never issued
   template <typename T>
-  T *GetResource(uint32_t rid) {
-    return static_cast<T *>(_resources[rid].get());
+  T *GetResource(ResourceHandle handle) const {
+    const auto *slot = Resolve(handle);
+    return slot ? static_cast<T *>(slot->resource.get()) : nullptr;
+  }
+  bool IsAlive(ResourceHandle handle) const {
+    return Resolve(handle) != nullptr;
   }
 
-  void ReleaseResource(uint32_t rid) { _resources.erase(rid); }
+  // the handle goes stale immediately, the resource itself is destroyed by
+  // the BeginFrame that follows the current frame's last possible use
+  void ReleaseResource(ResourceHandle handle) {
+    if (!Resolve(handle)) {
+      return;
+    }
+    auto &slot = _slots[handle.index];
+    _retired.push_back({
+        .resource = std::move(slot.resource),
+        .frame_number = _frame_number,
+    });
+    ++slot.generation;
+    slot.next_free = _free_head;
+    _free_head = handle.index;
+  }
+
+  // call once the current frame's fence has signaled, destroys what frames
+  // before frame_number - frames_in_flight released
+  void BeginFrame(uint64_t frame_number) {
+    _frame_number = frame_number;
+    while (!_retired.empty() &&
+           _retired.front().frame_number + _frames_in_flight <= frame_number) {
+      _retired.pop_front();
+    }
+  }
+  // released resources still waiting for their frames to finish
+  size_t GetRetiredCount() const { return _retired.size(); }
 };
 }  // namespace rdc
 #endif  // RENDER_CORE_RDRES_HPP_
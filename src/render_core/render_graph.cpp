@@ -0,0 +1,750 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+#include "render_core/gpu_profiler.h"
+#include "render_core/vulkan_driver.h"
+
+namespace {
+struct UsageInfo {
+  VkPipelineStageFlags stages = 0;
+  VkAccessFlags access = 0;
+  VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+constexpr VkAccessFlags kWriteAccess =
+    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+    VK_ACCESS_MEMORY_WRITE_BIT;
+
+// frames a physical transient image survives without being used
+constexpr uint64_t kTransientKeepFrames = 60;
+
+UsageInfo GetUsageInfo(rdc::ImageUsage usage, bool write, bool discard) {
+  switch (usage) {
+    case rdc::ImageUsage::kColorAttachment: {
+      // loading or blending reads what is already there
+      VkAccessFlags access = discard ? 0 : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+      if (write) {
+        access |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      }
+      return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, access,
+              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    }
+    case rdc::ImageUsage::kSampled:
+      return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    case rdc::ImageUsage::kTransferSrc:
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+    case rdc::ImageUsage::kTransferDst:
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+  }
+  return {};
+}
+
+UsageInfo GetUsageInfo(rdc::BufferUsage usage) {
+  switch (usage) {
+    case rdc::BufferUsage::kTransferSrc:
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT};
+    case rdc::BufferUsage::kTransferDst:
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+    case rdc::BufferUsage::kVertexInput:
+      return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+              VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT};
+    case rdc::BufferUsage::kIndirect:
+      return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+              VK_ACCESS_INDIRECT_COMMAND_READ_BIT};
+    case rdc::BufferUsage::kUniform:
+      return {VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+              VK_ACCESS_UNIFORM_READ_BIT};
+    case rdc::BufferUsage::kHostRead:
+      return {VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT};
+  }
+  return {};
+}
+
+const char *LayoutName(VkImageLayout layout) {
+  switch (layout) {
+    case VK_IMAGE_LAYOUT_UNDEFINED:
+      return "undefined";
+    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+      return "color attachment";
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+      return "shader read";
+    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+      return "transfer src";
+    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+      return "transfer dst";
+    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+      return "present";
+    default:
+      return "other";
+  }
+}
+
+const char *UsageName(bool is_image, uint8_t usage) {
+  if (is_image) {
+    switch (static_cast<rdc::ImageUsage>(usage)) {
+      case rdc::ImageUsage::kColorAttachment:
+        return "color attachment";
+      case rdc::ImageUsage::kSampled:
+        return "sampled";
+      case rdc::ImageUsage::kTransferSrc:
+        return "transfer src";
+      case rdc::ImageUsage::kTransferDst:
+        return "transfer dst";
+    }
+  }
+  switch (static_cast<rdc::BufferUsage>(usage)) {
+    case rdc::BufferUsage::kTransferSrc:
+      return "transfer src";
+    case rdc::BufferUsage::kTransferDst:
+      return "transfer dst";
+    case rdc::BufferUsage::kVertexInput:
+      return "vertex input";
+    case rdc::BufferUsage::kIndirect:
+      return "indirect";
+    case rdc::BufferUsage::kUniform:
+      return "uniform";
+    case rdc::BufferUsage::kHostRead:
+      return "host read";
+  }
+  return "";
+}
+}  // namespace
+
+namespace rdc {
+TransientImagePool::TransientImagePool(uint32_t frames_in_flight)
+    : _frames_in_flight(std::max(frames_in_flight, 1u)) {}
+
+TransientImagePool::~TransientImagePool() {
+  for (auto &image : _images) {
+    Destroy(*image);
+  }
+}
+
+TransientImagePool::Image *TransientImagePool::Create(const Desc &desc) {
+  auto *driver = VulkanDriver::GetSingleton();
+  auto image = std::make_unique<Image>();
+  image->desc = desc;
+  VmaAllocationCreateInfo const alloc_info = {
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+  };
+  VkImageCreateInfo const image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = desc.format,
+      .extent = {desc.extent.width, desc.extent.height, 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = desc.usage,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  AssertVkResult(vmaCreateImage(driver->GetVmaAllocator(), &image_info,
+                                &alloc_info, &image->image, &image->allocation,
+                                nullptr),
+                 "Failed to create transient image");
+  VkImageViewCreateInfo const view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .image = image->image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = desc.format,
+      .components = {},
+      .subresourceRange =
+          {
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .baseMipLevel = 0,
+              .levelCount = 1,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+          },
+  };
+  AssertVkResult(vkCreateImageView(driver->GetDevice(), &view_info, nullptr,
+                                   &image->view),
+                 "Failed to create transient image view");
+  _images.push_back(std::move(image));
+  return _images.back().get();
+}
+
+void TransientImagePool::Destroy(Image &image) const {
+  auto *driver = VulkanDriver::GetSingleton();
+  vkDestroyImageView(driver->GetDevice(), image.view, nullptr);
+  vmaDestroyImage(driver->GetVmaAllocator(), image.image, image.allocation);
+}
+
+void TransientImagePool::BeginFrame(uint64_t frame_number) {
+  _frame_number = frame_number;
+  // every frame that used an image this old has finished
+  uint64_t const keep = std::max<uint64_t>(kTransientKeepFrames,
+                                           _frames_in_flight);
+  std::erase_if(_images, [&](const std::unique_ptr<Image> &image) {
+    if (image->last_used_frame + keep > frame_number) {
+      return false;
+    }
+    Destroy(*image);
+    return true;
+  });
+}
+
+void RenderGraph::PassBuilder::Read(RenderGraphImage image, ImageUsage usage) {
+  assert(image.index < _graph->_images.size());
+  _pass->accesses.push_back({.resource = image.index,
+                             .is_image = true,
+                             .usage = static_cast<uint8_t>(usage),
+                             .write = false,
+                             .discard = false});
+}
+void RenderGraph::PassBuilder::Write(RenderGraphImage image, ImageUsage usage,
+                                     bool discard) {
+  assert(image.index < _graph->_images.size());
+  _pass->accesses.push_back({.resource = image.index,
+                             .is_image = true,
+                             .usage = static_cast<uint8_t>(usage),
+                             .write = true,
+                             .discard = discard});
+}
+void RenderGraph::PassBuilder::Read(RenderGraphBuffer buffer,
+                                    BufferUsage usage) {
+  assert(buffer.index < _graph->_buffers.size());
+  _pass->accesses.push_back({.resource = buffer.index,
+                             .is_image = false,
+                             .usage = static_cast<uint8_t>(usage),
+                             .write = false,
+                             .discard = false});
+}
+void RenderGraph::PassBuilder::Write(RenderGraphBuffer buffer,
+                                     BufferUsage usage, bool discard) {
+  assert(buffer.index < _graph->_buffers.size());
+  _pass->accesses.push_back({.resource = buffer.index,
+                             .is_image = false,
+                             .usage = static_cast<uint8_t>(usage),
+                             .write = true,
+                             .discard = discard});
+}
+
+void RenderGraph::Reset() {
+  _passes.clear();
+  _images.clear();
+  _buffers.clear();
+  _final = {};
+  _compiled = false;
+}
+
+RenderGraphImage RenderGraph::ImportImage(const char *name, VkImage image,
+                                          VkImageView view, VkFormat format,
+                                          VkExtent2D extent,
+                                          const ResourceState &initial,
+                                          VkImageLayout final_layout) {
+  _images.push_back({
+      .name = name,
+      .image = image,
+      .view = view,
+      .format = format,
+      .extent = extent,
+      .initial = initial,
+      .final_layout = final_layout,
+  });
+  return {static_cast<uint32_t>(_images.size() - 1)};
+}
+
+RenderGraphImage RenderGraph::CreateImage(const char *name, VkFormat format,
+                                          VkExtent2D extent,
+                                          VkImageUsageFlags usage) {
+  assert(_pool != nullptr && "transient images need a pool");
+  _images.push_back({
+      .name = name,
+      .format = format,
+      .extent = extent,
+      .transient = true,
+      .transient_usage = usage,
+  });
+  return {static_cast<uint32_t>(_images.size() - 1)};
+}
+
+RenderGraphBuffer RenderGraph::ImportBuffer(const char *name, VkBuffer buffer,
+                                            const ResourceState &initial) {
+  _buffers.push_back({.name = name, .buffer = buffer, .initial = initial});
+  return {static_cast<uint32_t>(_buffers.size() - 1)};
+}
+
+RenderGraphBuffer RenderGraph::ImportBuffer(const char *name, VkBuffer buffer,
+                                            const ResourceState &initial,
+                                            BufferUsage final_usage) {
+  _buffers.push_back({
+      .name = name,
+      .buffer = buffer,
+      .initial = initial,
+      .exported = true,
+      .final_usage = final_usage,
+  });
+  return {static_cast<uint32_t>(_buffers.size() - 1)};
+}
+
+void RenderGraph::AddPass(const char *name, const SetupFunc &setup,
+                          RecordFunc record) {
+  _passes.push_back({.name = name, .record = std::move(record)});
+  PassBuilder builder(this, &_passes.back());
+  setup(builder);
+}
+
+void RenderGraph::Cull() {
+  // walk backwards from the outputs, a pass lives when a later live pass or
+  // the output needs something it writes
+  std::vector<bool> image_needed(_images.size());
+  std::vector<bool> buffer_needed(_buffers.size());
+  for (size_t i = 0; i < _images.size(); ++i) {
+    image_needed[i] = _images[i].final_layout != VK_IMAGE_LAYOUT_UNDEFINED;
+  }
+  for (size_t i = 0; i < _buffers.size(); ++i) {
+    buffer_needed[i] = _buffers[i].exported;
+  }
+  auto needed = [&](const Access &access) {
+    return access.is_image ? image_needed[access.resource]
+                           : buffer_needed[access.resource];
+  };
+  auto set_needed = [&](const Access &access, bool value) {
+    if (access.is_image) {
+      image_needed[access.resource] = value;
+    } else {
+      buffer_needed[access.resource] = value;
+    }
+  };
+  for (auto pass = _passes.rbegin(); pass != _passes.rend(); ++pass) {
+    bool live = pass->side_effects;
+    for (const auto &access : pass->accesses) {
+      live |= access.write && needed(access);
+    }
+    pass->culled = !live;
+    if (!live) {
+      continue;
+    }
+    // a full overwrite ends the need for what earlier passes wrote
+    for (const auto &access : pass->accesses) {
+      if (access.write && access.discard) {
+        set_needed(access, false);
+      }
+    }
+    for (const auto &access : pass->accesses) {
+      if (!access.write || !access.discard) {
+        set_needed(access, true);
+      }
+    }
+  }
+}
+
+void RenderGraph::AllocateTransients() {
+  for (uint32_t p = 0; p < _passes.size(); ++p) {
+    if (_passes[p].culled) {
+      continue;
+    }
+    for (const auto &access : _passes[p].accesses) {
+      if (access.is_image) {
+        auto &image = _images[access.resource];
+        image.first_pass = std::min(image.first_pass, p);
+        image.last_pass = std::max(image.last_pass, p);
+      }
+    }
+  }
+  std::vector<uint32_t> transients;
+  for (uint32_t i = 0; i < _images.size(); ++i) {
+    if (_images[i].transient && _images[i].first_pass != UINT32_MAX) {
+      transients.push_back(i);
+    }
+  }
+  std::ranges::sort(transients, [this](uint32_t a, uint32_t b) {
+    return _images[a].first_pass < _images[b].first_pass;
+  });
+  // a physical image is free for a transient once every pass of its
+  // previous occupant this frame came before the transient's first pass
+  struct Occupancy {
+    TransientImagePool::Image *physical;
+    uint32_t last_pass;
+  };
+  std::vector<Occupancy> occupied;
+  for (auto index : transients) {
+    auto &image = _images[index];
+    TransientImagePool::Desc const desc = {
+        .format = image.format,
+        .extent = image.extent,
+        .usage = image.transient_usage,
+    };
+    TransientImagePool::Image *physical = nullptr;
+    for (auto &occupancy : occupied) {
+      if (occupancy.physical->desc == desc &&
+          occupancy.last_pass < image.first_pass) {
+        physical = occupancy.physical;
+        occupancy.last_pass = image.last_pass;
+        break;
+      }
+    }
+    if (!physical) {
+      for (auto &candidate : _pool->_images) {
+        bool const taken = std::ranges::any_of(
+            occupied, [&candidate](const Occupancy &occupancy) {
+              return occupancy.physical == candidate.get();
+            });
+        if (!taken && candidate->desc == desc) {
+          physical = candidate.get();
+          break;
+        }
+      }
+      if (!physical) {
+        physical = _pool->Create(desc);
+      }
+      occupied.push_back({physical, image.last_pass});
+    }
+    image.physical = physical;
+    image.image = physical->image;
+    image.view = physical->view;
+    physical->last_used_frame = _pool->_frame_number;
+  }
+}
+
+void RenderGraph::AddBarrier(Pass &pass, const Access &access) {
+  auto &tracked = access.is_image ? _images[access.resource].tracked
+                                  : _buffers[access.resource].tracked;
+  auto const info =
+      access.is_image
+          ? GetUsageInfo(static_cast<ImageUsage>(access.usage), access.write,
+                         access.discard)
+          : GetUsageInfo(static_cast<BufferUsage>(access.usage));
+  bool const layout_change = access.is_image && info.layout != tracked.layout;
+  VkPipelineStageFlags src_stages = 0;
+  VkAccessFlags src_access = 0;
+  VkImageLayout old_layout = tracked.layout;
+
+  if (!access.write && !layout_change) {
+    tracked.read_stages |= info.stages;
+    bool const visible =
+        (info.stages & ~tracked.visible_stages) == 0 &&
+        (info.access & ~tracked.visible_access) == 0;
+    if (tracked.pending_write == 0 || visible) {
+      // reads after reads need no barrier
+      return;
+    }
+    src_stages = tracked.write_stages;
+    src_access = tracked.pending_write;
+    tracked.visible_stages |= info.stages;
+    tracked.visible_access |= info.access;
+  } else {
+    // a write or a layout transition, which writes as well, waits for every
+    // access since the last write
+    src_stages = tracked.write_stages | tracked.read_stages;
+    src_access = tracked.pending_write;
+    if (access.discard) {
+      old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+    tracked.layout = info.layout;
+    tracked.visible_stages = 0;
+    tracked.visible_access = 0;
+    if (access.write) {
+      tracked.write_stages = info.stages;
+      tracked.read_stages = 0;
+      tracked.pending_write = info.access & kWriteAccess;
+    } else {
+      tracked.write_stages = 0;
+      tracked.read_stages = info.stages;
+      tracked.pending_write = 0;
+    }
+  }
+  if (src_stages == 0) {
+    src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  }
+  pass.src_stages |= src_stages;
+  pass.dst_stages |= info.stages;
+  if (access.is_image) {
+    if (!layout_change && src_access == 0) {
+      // write after read, ordering the stages is enough
+      return;
+    }
+    pass.image_barriers.push_back({
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = src_access,
+        .dstAccessMask = info.access,
+        .oldLayout = old_layout,
+        .newLayout = info.layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = _images[access.resource].image,
+        .subresourceRange =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .baseArrayLayer = 0,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS,
+            },
+    });
+  } else if (src_access != 0) {
+    pass.buffer_barriers.push_back({
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = src_access,
+        .dstAccessMask = info.access,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _buffers[access.resource].buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    });
+  }
+}
+
+void RenderGraph::DeriveBarriers() {
+  auto const start = [](const ResourceState &state) {
+    return Tracked{
+        .layout = state.layout,
+        .write_stages = state.access != 0 ? state.stages : 0,
+        .read_stages = state.access != 0 ? 0 : state.stages,
+        .pending_write = state.access & kWriteAccess,
+    };
+  };
+  for (auto &image : _images) {
+    // transients start at their first pass
+    image.tracked = image.transient ? Tracked{} : start(image.initial);
+  }
+  for (auto &buffer : _buffers) {
+    buffer.tracked = start(buffer.initial);
+  }
+
+  for (uint32_t p = 0; p < _passes.size(); ++p) {
+    auto &pass = _passes[p];
+    if (pass.culled) {
+      continue;
+    }
+    // aliased memory starts undefined, whatever occupied it before
+    for (const auto &access : pass.accesses) {
+      if (!access.is_image) {
+        continue;
+      }
+      auto &image = _images[access.resource];
+      if (image.physical && image.first_pass == p) {
+        image.tracked = start({.layout = VK_IMAGE_LAYOUT_UNDEFINED,
+                               .stages = image.physical->stages,
+                               .access = image.physical->access});
+      }
+    }
+    for (const auto &access : pass.accesses) {
+      AddBarrier(pass, access);
+    }
+    // the next occupant of a physical image waits for this one
+    for (const auto &access : pass.accesses) {
+      if (!access.is_image) {
+        continue;
+      }
+      auto &image = _images[access.resource];
+      if (image.physical && image.last_pass == p) {
+        image.physical->stages =
+            image.tracked.write_stages | image.tracked.read_stages;
+        image.physical->access = image.tracked.pending_write;
+      }
+    }
+  }
+
+  // bring the outputs into their final state
+  for (uint32_t i = 0; i < _images.size(); ++i) {
+    auto const &image = _images[i];
+    if (image.final_layout == VK_IMAGE_LAYOUT_UNDEFINED ||
+        image.final_layout == image.tracked.layout) {
+      continue;
+    }
+    auto &tracked = _images[i].tracked;
+    VkPipelineStageFlags const src_stages =
+        tracked.write_stages | tracked.read_stages;
+    _final.src_stages |=
+        src_stages != 0 ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    // presentation and later submissions synchronize with semaphores
+    _final.dst_stages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    _final.image_barriers.push_back({
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = tracked.pending_write,
+        .dstAccessMask = 0,
+        .oldLayout = tracked.layout,
+        .newLayout = image.final_layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image.image,
+        .subresourceRange =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .baseArrayLayer = 0,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS,
+            },
+    });
+    tracked.layout = image.final_layout;
+  }
+  for (auto &buffer : _buffers) {
+    if (!buffer.exported) {
+      continue;
+    }
+    Access const access = {
+        .resource = static_cast<uint32_t>(&buffer - _buffers.data()),
+        .is_image = false,
+        .usage = static_cast<uint8_t>(buffer.final_usage),
+    };
+    AddBarrier(_final, access);
+  }
+}
+
+void RenderGraph::Compile() {
+  Cull();
+  if (_pool) {
+    AllocateTransients();
+  }
+  DeriveBarriers();
+  _compiled = true;
+}
+
+void RenderGraph::Execute(VkCommandBuffer command_buffer,
+                          GpuProfiler *profiler) {
+  assert(_compiled && "compile the render graph before executing it");
+  auto const barrier = [command_buffer](const Pass &pass) {
+    if (pass.src_stages == 0) {
+      return;
+    }
+    vkCmdPipelineBarrier(
+        command_buffer, pass.src_stages, pass.dst_stages, 0, 0, nullptr,
+        static_cast<uint32_t>(pass.buffer_barriers.size()),
+        pass.buffer_barriers.data(),
+        static_cast<uint32_t>(pass.image_barriers.size()),
+        pass.image_barriers.data());
+  };
+  for (auto &pass : _passes) {
+    if (pass.culled) {
+      continue;
+    }
+    barrier(pass);
+    uint32_t const scope =
+        profiler ? profiler->BeginScope(command_buffer, pass.name) : UINT32_MAX;
+    pass.record(command_buffer);
+    if (profiler) {
+      profiler->EndScope(command_buffer, scope);
+    }
+  }
+  barrier(_final);
+}
+
+VkImage RenderGraph::GetImage(RenderGraphImage image) const {
+  assert(_images[image.index].image != VK_NULL_HANDLE);
+  return _images[image.index].image;
+}
+
+VkImageView RenderGraph::GetImageView(RenderGraphImage image) const {
+  return _images[image.index].view;
+}
+
+std::string RenderGraph::Dump() const {
+  std::ostringstream out;
+  auto const image_name = [this](VkImage image) -> const char * {
+    for (const auto &candidate : _images) {
+      if (candidate.image == image) {
+        return candidate.name;
+      }
+    }
+    return "?";
+  };
+  auto const buffer_name = [this](VkBuffer buffer) -> const char * {
+    for (const auto &candidate : _buffers) {
+      if (candidate.buffer == buffer) {
+        return candidate.name;
+      }
+    }
+    return "?";
+  };
+  auto const dump_barriers = [&](const Pass &pass) {
+    if (pass.src_stages == 0) {
+      return;
+    }
+    out << "    barrier stages 0x" << std::hex << pass.src_stages << " -> 0x"
+        << pass.dst_stages << std::dec << "\n";
+    for (const auto &barrier : pass.image_barriers) {
+      out << "      " << image_name(barrier.image) << ": "
+          << LayoutName(barrier.oldLayout) << " -> "
+          << LayoutName(barrier.newLayout) << ", access 0x" << std::hex
+          << barrier.srcAccessMask << " -> 0x" << barrier.dstAccessMask
+          << std::dec << "\n";
+    }
+    for (const auto &barrier : pass.buffer_barriers) {
+      out << "      " << buffer_name(barrier.buffer) << ": access 0x"
+          << std::hex << barrier.srcAccessMask << " -> 0x"
+          << barrier.dstAccessMask << std::dec << "\n";
+    }
+  };
+
+  out << "render graph, " << _passes.size() << " passes\n";
+  for (const auto &pass : _passes) {
+    out << "  pass \"" << pass.name << "\"";
+    if (pass.culled) {
+      out << " culled";
+    }
+    if (pass.side_effects) {
+      out << " side effects";
+    }
+    out << "\n";
+    for (const auto &access : pass.accesses) {
+      out << "    " << (access.write ? "write " : "read ")
+          << (access.is_image ? _images[access.resource].name
+                              : _buffers[access.resource].name)
+          << " as " << UsageName(access.is_image, access.usage)
+          << (access.discard ? ", discard" : "")
+          << "\n";
+    }
+    if (!pass.culled) {
+      dump_barriers(pass);
+    }
+  }
+  out << "  final\n";
+  dump_barriers(_final);
+  out << "images\n";
+  for (const auto &image : _images) {
+    out << "  " << image.name << " " << image.extent.width << "x"
+        << image.extent.height;
+    if (image.transient) {
+      out << " transient";
+      if (image.physical) {
+        auto const &pool_images = _pool->_images;
+        auto const it = std::ranges::find_if(
+            pool_images, [&image](const auto &candidate) {
+              return candidate.get() == image.physical;
+            });
+        out << " in pool image " << (it - pool_images.begin());
+      } else {
+        out << " unused";
+      }
+    } else {
+      out << " imported";
+    }
+    if (image.final_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+      out << ", output in " << LayoutName(image.final_layout);
+    }
+    out << "\n";
+  }
+  if (!_buffers.empty()) {
+    out << "buffers\n";
+    for (const auto &buffer : _buffers) {
+      out << "  " << buffer.name << (buffer.exported ? ", output" : "")
+          << "\n";
+    }
+  }
+  return out.str();
+}
+
+}  // namespace rdc
@@ -0,0 +1,247 @@
+#ifndef RENDER_CORE_RENDER_GRAPH_H_
+#define RENDER_CORE_RENDER_GRAPH_H_
+
+#include <vk_mem_alloc.h>
+#include <volk.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tools.hpp"
+
+namespace rdc {
+class GpuProfiler;
+
+// how a pass touches an image, decides its layout, stages and access
+enum class ImageUsage : uint8_t {
+  // rendered to, loaded or blended onto unless written with discard
+  kColorAttachment,
+  // sampled in fragment shaders
+  kSampled,
+  kTransferSrc,
+  kTransferDst,
+};
+enum class BufferUsage : uint8_t {
+  kTransferSrc,
+  kTransferDst,
+  // vertex and index fetch
+  kVertexInput,
+  kIndirect,
+  kUniform,
+  // mapped and read by the cpu once the frame's fence signaled
+  kHostRead,
+};
+
+struct RenderGraphImage {
+  uint32_t index = UINT32_MAX;
+  bool IsValid() const { return index != UINT32_MAX; }
+};
+struct RenderGraphBuffer {
+  uint32_t index = UINT32_MAX;
+  bool IsValid() const { return index != UINT32_MAX; }
+};
+
+// what happened to an imported resource before the graph runs. access is 0
+// when the last use only read it
+struct ResourceState {
+  VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  VkAccessFlags access = 0;
+};
+
+// images render graphs alias between passes and across frames. physical
+// images are matched by format, extent and usage and destroyed once no
+// frame has used them for a while
+class TransientImagePool : public NoCopyable {
+  friend class RenderGraph;
+
+ public:
+  struct Desc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {0, 0};
+    VkImageUsageFlags usage = 0;
+    bool operator==(const Desc &other) const {
+      return format == other.format && extent.width == other.extent.width &&
+             extent.height == other.extent.height && usage == other.usage;
+    }
+  };
+
+ private:
+  struct Image {
+    Desc desc;
+    VkImage image = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    uint64_t last_used_frame = 0;
+    // how the last frame that used it left it, its first barrier waits on
+    // this
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags access = 0;
+  };
+  // stable addresses, graphs keep pointers while they execute
+  std::vector<std::unique_ptr<Image>> _images;
+  uint32_t _frames_in_flight = 1;
+  uint64_t _frame_number = 0;
+
+  Image *Create(const Desc &desc);
+  void Destroy(Image &image) const;
+
+ public:
+  explicit TransientImagePool(uint32_t frames_in_flight);
+  ~TransientImagePool() override;
+
+  // call once the current frame's fence has signaled
+  void BeginFrame(uint64_t frame_number);
+  size_t GetImageCount() const { return _images.size(); }
+};
+
+// per frame list of passes that declare the images and buffers they read and
+// write. Compile culls passes whose results nobody uses, places transient
+// images in the pool and derives the barriers, Execute records every live
+// pass after one batched barrier. rebuild it every frame:
+//
+//   graph.Reset();
+//   auto target = graph.ImportImage(...);
+//   graph.AddPass("name", [&](RenderGraph::PassBuilder &pass) { ... },
+//                 [&](VkCommandBuffer cmd) { ... });
+//   graph.Compile();
+//   graph.Execute(cmd, profiler);
+class RenderGraph : public NoCopyable {
+ public:
+  using RecordFunc = std::function<void(VkCommandBuffer command_buffer)>;
+
+ private:
+  struct Access {
+    uint32_t resource = 0;
+    bool is_image = true;
+    uint8_t usage = 0;
+    bool write = false;
+    // every texel is overwritten, the previous contents are not needed
+    bool discard = false;
+  };
+  struct Pass {
+    // string literals like gpu profiler scope names
+    const char *name = nullptr;
+    std::vector<Access> accesses;
+    RecordFunc record;
+    bool side_effects = false;
+    bool culled = false;
+    std::vector<VkImageMemoryBarrier> image_barriers;
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+    VkPipelineStageFlags src_stages = 0;
+    VkPipelineStageFlags dst_stages = 0;
+  };
+  // what the graph knows about a resource while it walks the passes
+  struct Tracked {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // stages of the last write and of the reads since then
+    VkPipelineStageFlags write_stages = 0;
+    VkPipelineStageFlags read_stages = 0;
+    // access of a write no barrier has made visible yet to everything
+    VkAccessFlags pending_write = 0;
+    // stages and accesses the pending write was already made visible to
+    VkPipelineStageFlags visible_stages = 0;
+    VkAccessFlags visible_access = 0;
+  };
+  struct Image {
+    const char *name = nullptr;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {0, 0};
+    ResourceState initial;
+    // undefined when the image is not an output of the graph
+    VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    bool transient = false;
+    VkImageUsageFlags transient_usage = 0;
+    TransientImagePool::Image *physical = nullptr;
+    // live passes using it, set by Compile
+    uint32_t first_pass = UINT32_MAX;
+    uint32_t last_pass = 0;
+    Tracked tracked;
+  };
+  struct Buffer {
+    const char *name = nullptr;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    ResourceState initial;
+    bool exported = false;
+    BufferUsage final_usage = BufferUsage::kHostRead;
+    Tracked tracked;
+  };
+
+  TransientImagePool *_pool = nullptr;
+  std::vector<Pass> _passes;
+  std::vector<Image> _images;
+  std::vector<Buffer> _buffers;
+  // barriers that bring the outputs into their final state
+  Pass _final;
+  bool _compiled = false;
+
+  void Cull();
+  void AllocateTransients();
+  void DeriveBarriers();
+  void AddBarrier(Pass &pass, const Access &access);
+
+ public:
+  class PassBuilder {
+    friend class RenderGraph;
+    RenderGraph *_graph;
+    Pass *_pass;
+    PassBuilder(RenderGraph *graph, Pass *pass) : _graph(graph), _pass(pass) {}
+
+   public:
+    void Read(RenderGraphImage image, ImageUsage usage);
+    // discard when every texel is overwritten, passes before that only
+    // writing the image are culled
+    void Write(RenderGraphImage image, ImageUsage usage, bool discard = false);
+    void Read(RenderGraphBuffer buffer, BufferUsage usage);
+    void Write(RenderGraphBuffer buffer, BufferUsage usage,
+               bool discard = false);
+    // never culled, for passes whose effects the graph cannot see
+    void SetSideEffects() { _pass->side_effects = true; }
+  };
+  using SetupFunc = std::function<void(PassBuilder &pass)>;
+
+  // without a pool the graph cannot create transient images
+  explicit RenderGraph(TransientImagePool *pool = nullptr) : _pool(pool) {}
+
+  // forget every pass and resource, keeps the allocations
+  void Reset();
+  // final_layout marks an output, left undefined the image is only an input
+  // and may end in any layout
+  RenderGraphImage ImportImage(const char *name, VkImage image,
+                               VkImageView view, VkFormat format,
+                               VkExtent2D extent, const ResourceState &initial,
+                               VkImageLayout final_layout);
+  // placed in the pool by Compile, contents are undefined at its first use
+  RenderGraphImage CreateImage(const char *name, VkFormat format,
+                               VkExtent2D extent, VkImageUsageFlags usage);
+  RenderGraphBuffer ImportBuffer(const char *name, VkBuffer buffer,
+                                 const ResourceState &initial);
+  // an output, made available to final_usage after the last pass
+  RenderGraphBuffer ImportBuffer(const char *name, VkBuffer buffer,
+                                 const ResourceState &initial,
+                                 BufferUsage final_usage);
+  // passes run in the order they were added
+  void AddPass(const char *name, const SetupFunc &setup, RecordFunc record);
+
+  void Compile();
+  // each pass runs in a profiler scope of its name when profiler is set
+  void Execute(VkCommandBuffer command_buffer, GpuProfiler *profiler);
+
+  // valid once compiled
+  VkImage GetImage(RenderGraphImage image) const;
+  VkImageView GetImageView(RenderGraphImage image) const;
+  VkBuffer GetBuffer(RenderGraphBuffer buffer) const {
+    return _buffers[buffer.index].buffer;
+  }
+  // passes, culling, transient placement and barriers of the compiled graph
+  std::string Dump() const;
+};
+
+}  // namespace rdc
+
+#endif  // RENDER_CORE_RENDER_GRAPH_H_
@@ -1,8 +1,20 @@
 #include "model_renderer.h"
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <chrono>
+#include <iterator>
+#include <span>
+#include "render_core/gpu_profiler.h"
+#include "render_core/shader_cache.h"
+#include "render_core/upload_batcher.h"
 #include "render_core/vulkan_driver.h"
+#include "render_core/canvas_bindless_sd.gen.h"
 #include "render_core/canvas_sd.gen.h"
+#include "trace.hpp"
 
 namespace {
 
@@ -38,65 +50,192 @@ void SetVertexInput(VkCommandBuffer cmd) {
                          attributes.data());
 }
 
+// vertex and fragment shader objects linked together, through the shader
+// cache so later runs can skip compiling the spir-v
+void CreateLinkedShaders(rdc::ShaderCache *cache, const uint32_t *vertex_code,
+                         size_t vertex_size, const uint32_t *fragment_code,
+                         size_t fragment_size,
+                         const VkDescriptorSetLayout &set_layout,
+                         VkShaderEXT (&shaders)[2],
+                         std::span<const VkPushConstantRange>
+                             push_constant_ranges = {}) {
+  VkShaderCreateInfoEXT shader_create_infos[2];
+  VkShaderCreateInfoEXT &vert_shader_create_info = shader_create_infos[0];
+  vert_shader_create_info = {};
+  vert_shader_create_info.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+  vert_shader_create_info.pNext = nullptr;
+  vert_shader_create_info.pName = "main";
+  vert_shader_create_info.flags = VK_SHADER_CREATE_LINK_STAGE_BIT_EXT;
+  vert_shader_create_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+  vert_shader_create_info.nextStage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  vert_shader_create_info.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+  vert_shader_create_info.codeSize = vertex_size;
+  vert_shader_create_info.pCode = vertex_code;
+  vert_shader_create_info.setLayoutCount = 1;
+  vert_shader_create_info.pSetLayouts = &set_layout;
+  vert_shader_create_info.pushConstantRangeCount =
+      static_cast<uint32_t>(push_constant_ranges.size());
+  vert_shader_create_info.pPushConstantRanges = push_constant_ranges.data();
+
+  VkShaderCreateInfoEXT &frag_shader_create_info = shader_create_infos[1];
+  frag_shader_create_info = vert_shader_create_info;
+  frag_shader_create_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  frag_shader_create_info.nextStage = 0;
+  frag_shader_create_info.codeSize = fragment_size;
+  frag_shader_create_info.pCode = fragment_code;
+
+  rdc::AssertVkResult(cache->CreateShaders(2, shader_create_infos, shaders),
+                      "Failed to create shader objects");
+}
+
+// matches LayerConstants in canvas_sd.glsl
+struct LayerPushConstants {
+  float opacity = 1.0f;
+};
+constexpr VkPushConstantRange kLayerPushConstantRange = {
+    .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+    .offset = 0,
+    .size = sizeof(LayerPushConstants),
+};
+
+// matches DrawData in canvas_bindless_sd.glsl, std430
+struct LayerDrawData {
+  glm::vec4 transform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+  uint32_t texture_index = 0;
+  float opacity = 1.0f;
+  glm::vec2 padding = glm::vec2(0.0f);
+};
+static_assert(sizeof(LayerDrawData) == 32);
+
+constexpr uint32_t kMaxBindlessLayers = 16384;
+
+// rows premultiplied per thread pool task
+constexpr uint32_t kPremultiplyRowsPerTask = 64;
+
+// fewest per layer draws worth a secondary command buffer of their own
+constexpr uint32_t kMinLayersPerRecordChunk = 256;
+
+// per layer draws timed by one "layer batch" gpu scope, a scope per layer
+// would exhaust the profiler's per frame budget on large rigs
+constexpr uint32_t kLayersPerGpuScope = 64;
+
+// gap between the draw orders of neighbouring layers after a renumbering,
+// room for 32 inserts at the same spot before the next one
+constexpr uint64_t kDrawOrderSpacing = uint64_t{1} << 32;
+
+// layer textures are stored with premultiplied alpha so that the linear
+// downsample of the mip chain does not bleed the color of fully transparent
+// texels into the edges
+void PremultiplyAlpha(const uint8_t *src, uint8_t *dst, uint32_t width,
+                      uint32_t height) {
+  size_t const row_size = static_cast<size_t>(width) * 4;
+  uint32_t const tasks =
+      (height + kPremultiplyRowsPerTask - 1) / kPremultiplyRowsPerTask;
+  ThreadPool::GetGlobal()->ParallelFor(tasks, [&](size_t task) {
+    size_t const begin = task * kPremultiplyRowsPerTask * row_size;
+    size_t const end = std::min<size_t>(
+        (task + 1) * kPremultiplyRowsPerTask, height) * row_size;
+    for (size_t i = begin; i < end; i += 4) {
+      uint32_t const alpha = src[i + 3];
+      dst[i + 0] = static_cast<uint8_t>((src[i + 0] * alpha + 127) / 255);
+      dst[i + 1] = static_cast<uint8_t>((src[i + 1] * alpha + 127) / 255);
+      dst[i + 2] = static_cast<uint8_t>((src[i + 2] * alpha + 127) / 255);
+      dst[i + 3] = static_cast<uint8_t>(alpha);
+    }
+  });
+}
+
 }  // namespace
 
 namespace rdc {
-void Layer2dResource::SetVertex(std::span<ModelVertex> vertices,
-                                std::span<uint32_t> indices) {
-  if (_vertices.size() != vertices.size() ||
-      _indices.size() != indices.size()) {
-    _dirty_flag = 2;
+void Layer2dResource::MarkVerticesDirty(uint32_t first, uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+  // ranges closer than this are uploaded as one copy
+  constexpr uint32_t kMergeGap = 16;
+  uint32_t begin = first;
+  uint32_t end = first + count;
+  auto it = std::lower_bound(
+      _dirty_vertex_ranges.begin(), _dirty_vertex_ranges.end(), begin,
+      [](const auto &range, uint32_t value) {
+        return range.second + kMergeGap < value;
+      });
+  auto last = it;
+  while (last != _dirty_vertex_ranges.end() && last->first <= end + kMergeGap) {
+    begin = std::min(begin, last->first);
+    end = std::max(end, last->second);
+    ++last;
+  }
+  it = _dirty_vertex_ranges.erase(it, last);
+  _dirty_vertex_ranges.insert(it, {begin, end});
+}
+void Layer2dResource::SetVertex(std::span<const ModelVertex> vertices,
+                                std::span<const uint32_t> indices) {
+  if (vertices.size() != _vertices.size()) {
+    _vertices.assign(vertices.begin(), vertices.end());
+    MarkVerticesDirty(0, static_cast<uint32_t>(_vertices.size()));
   } else {
-    _dirty_flag = 1;
+    // mark each run of changed vertices
+    auto const changed = [&](size_t i) {
+      return memcmp(&vertices[i], &_vertices[i], sizeof(ModelVertex)) != 0;
+    };
+    size_t i = 0;
+    while (i < vertices.size()) {
+      if (!changed(i)) {
+        ++i;
+        continue;
+      }
+      size_t const begin = i;
+      while (i < vertices.size() && changed(i)) {
+        _vertices[i] = vertices[i];
+        ++i;
+      }
+      MarkVerticesDirty(static_cast<uint32_t>(begin),
+                        static_cast<uint32_t>(i - begin));
+    }
+  }
+  if (indices.size() != _indices.size() ||
+      !std::equal(indices.begin(), indices.end(), _indices.begin())) {
+    _indices.assign(indices.begin(), indices.end());
+    _indices_dirty = true;
   }
-  _vertices = std::vector<ModelVertex>(vertices.begin(), vertices.end());
-  _indices = std::vector<uint32_t>(indices.begin(), indices.end());
+}
+void Layer2dResource::UpdateVertices(uint32_t first,
+                                     std::span<const ModelVertex> vertices) {
+  assert(first + vertices.size() <= _vertices.size());
+  std::copy(vertices.begin(), vertices.end(), _vertices.begin() + first);
+  MarkVerticesDirty(first, static_cast<uint32_t>(vertices.size()));
 }
 void Layer2dResource::RefreshBuffer() {
-  if (_dirty_flag == 2) {
-    // delete
-    auto *driver = VulkanDriver::GetSingleton();
-    vmaDestroyBuffer(driver->GetVmaAllocator(), _vertex_buffer._buffer,
-                     _vertex_buffer._allocation);
-    vmaDestroyBuffer(driver->GetVmaAllocator(), _index_buffer._buffer,
-                     _index_buffer._allocation);
-
-    // recreate vertex buffer
-    driver->HCreateBuffer(
-        sizeof(ModelVertex) * _vertices.size(),
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VMA_MEMORY_USAGE_CPU_TO_GPU, _vertex_buffer._buffer,
-        _vertex_buffer._allocation);
-    void *data;
-    vmaMapMemory(driver->GetVmaAllocator(), _vertex_buffer._allocation, &data);
-    memcpy(data, _vertices.data(), sizeof(ModelVertex) * _vertices.size());
-    vmaUnmapMemory(driver->GetVmaAllocator(), _vertex_buffer._allocation);
-    // recreate index buffer
-
-    driver->HCreateBuffer(
-        sizeof(uint32_t) * _indices.size(),
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VMA_MEMORY_USAGE_CPU_TO_GPU, _index_buffer._buffer,
-        _index_buffer._allocation);
-    vmaMapMemory(driver->GetVmaAllocator(), _index_buffer._allocation, &data);
-    memcpy(data, _indices.data(), sizeof(uint32_t) * _indices.size());
-    vmaUnmapMemory(driver->GetVmaAllocator(), _index_buffer._allocation);
-  } else if (_dirty_flag == 1) {
-    // update
-    auto *driver = VulkanDriver::GetSingleton();
-    void *data;
-    vmaMapMemory(driver->GetVmaAllocator(), _vertex_buffer._allocation, &data);
-    memcpy(data, _vertices.data(), sizeof(ModelVertex) * _vertices.size());
-    vmaUnmapMemory(driver->GetVmaAllocator(), _vertex_buffer._allocation);
-
-    vmaMapMemory(driver->GetVmaAllocator(), _index_buffer._allocation, &data);
-    memcpy(data, _indices.data(), sizeof(uint32_t) * _indices.size());
-    vmaUnmapMemory(driver->GetVmaAllocator(), _index_buffer._allocation);
-  }
-  _dirty_flag = 0;
+  auto *arena = VulkanDriver::GetSingleton()->GetGeometryArena();
+  VkDeviceSize const vertex_size = sizeof(ModelVertex) * _vertices.size();
+  VkDeviceSize const index_size = sizeof(uint32_t) * _indices.size();
+  if (_geometry.vertex_size != vertex_size ||
+      _geometry.index_size != index_size) {
+    // counts changed, move to a range of the new size
+    arena->Free(_geometry);
+    _geometry = arena->Allocate(vertex_size, sizeof(ModelVertex), index_size);
+    arena->Write(_geometry, _vertices.data(), _indices.data());
+  } else {
+    // arena copies are ordered after earlier frames' reads, so ranges are
+    // patched in place
+    for (const auto &[begin, end] : _dirty_vertex_ranges) {
+      arena->WriteVertices(_geometry, sizeof(ModelVertex) * begin,
+                           _vertices.data() + begin,
+                           sizeof(ModelVertex) * (end - begin));
+    }
+    if (_indices_dirty) {
+      arena->WriteIndices(_geometry, 0, _indices.data(), index_size);
+    }
+  }
+  _dirty_vertex_ranges.clear();
+  _indices_dirty = false;
 }
+VkDeviceSize Layer2dResource::GetImageBytes() const { return _image.bytes; }
 std::unique_ptr<Layer2dResource> Layer2dResource::CreateFromImage(
     const ImageConfig &config) {
+  WAIFU_TRACE_SCOPE("Layer2dResource::CreateFromImage");
   auto *driver = VulkanDriver::GetSingleton();
 
   auto result = std::unique_ptr<Layer2dResource>(new Layer2dResource());
@@ -107,22 +246,18 @@ std::unique_ptr<Layer2dResource> Layer2dResource::CreateFromImage(
   VkDeviceSize const size = static_cast<int64_t>(
       cpu_image->width * cpu_image->height * cpu_image->channels);
 
-  VkBuffer staging_buffer;
-  VmaAllocation staging_allocation;
-  driver->HCreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                        VMA_MEMORY_USAGE_CPU_ONLY, staging_buffer,
-                        staging_allocation);
-  void *data;
-  vmaMapMemory(driver->GetVmaAllocator(), staging_allocation, &data);
-  memcpy(data, cpu_image->data, size);
-  vmaUnmapMemory(driver->GetVmaAllocator(), staging_allocation);
-
-  // create vkimage
-  VmaAllocationCreateInfo const alloc_info = {
-      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
-      .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-  };
-  VkImageCreateInfo const image_info = {
+  uint32_t const full_chain =
+      std::bit_width(std::max(cpu_image->width, cpu_image->height));
+  result->_mip_levels = config.mip_levels == 0
+                            ? full_chain
+                            : std::min(config.mip_levels, full_chain);
+  if (result->_mip_levels > 1 && !driver->HSupportsLinearBlit(config.format)) {
+    result->_mip_levels = 1;
+  }
+  result->_extent = {cpu_image->width, cpu_image->height};
+
+  // reuse an image of a previous document when one matches
+  VkImageCreateInfo image_info = {
       .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
       .pNext = nullptr,
       .flags = 0,
@@ -134,105 +269,129 @@ std::unique_ptr<Layer2dResource> Layer2dResource::CreateFromImage(
               .height = cpu_image->height,
               .depth = 1,
           },
-      .mipLevels = 1,
+      .mipLevels = result->_mip_levels,
       .arrayLayers = 1,
       .samples = VK_SAMPLE_COUNT_1_BIT,
       .tiling = VK_IMAGE_TILING_OPTIMAL,
-      .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+      .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+               VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
       .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
   };
+  driver->HSetUploadSharingMode(image_info);
 
-  AssertVkResult(
-      vmaCreateImage(driver->GetVmaAllocator(), &image_info, &alloc_info,
-                     &result->_image, &result->_allocation, nullptr),
-      "Failed to create image");
-
-  VkCommandBuffer single_command_buffer = driver->HBeginOneTimeCommandBuffer();
-
-  driver->HTransitionImageLayout(
-      single_command_buffer, result->_image, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
-      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  VkBufferImageCopy const copy_region = {
-      .bufferOffset = 0,
-      .bufferRowLength = 0,
-      .bufferImageHeight = 0,
-      .imageSubresource =
-          {
-              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-              .mipLevel = 0,
-              .baseArrayLayer = 0,
-              .layerCount = 1,
-          },
-      .imageExtent =
-          {
-              .width = cpu_image->width,
-              .height = cpu_image->height,
-              .depth = 1,
-          },
-  };
-  vkCmdCopyBufferToImage(single_command_buffer, staging_buffer, result->_image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-
-  driver->HTransitionImageLayout(
-      single_command_buffer, result->_image, VK_ACCESS_TRANSFER_WRITE_BIT,
-      VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  result->_image = driver->GetImagePool()->Acquire(image_info);
+  // the rest of the chain is blitted from mip 0 on the graphics queue
+  result->_mips_pending = result->_mip_levels > 1;
+  VkImageLayout const upload_layout =
+      result->_mips_pending ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                            : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  // the upload transitions from undefined, whatever a pooled image held
+  driver->GetUploadBatcher()->UploadImage(
+      result->_image.image, size, image_info.extent,
+      [cpu_image, size](uint8_t *staging) {
+        if (cpu_image->channels == 4) {
+          PremultiplyAlpha(static_cast<const uint8_t *>(cpu_image->data),
+                           staging, cpu_image->width, cpu_image->height);
+        } else {
+          memcpy(staging, cpu_image->data, size);
+        }
+      },
+      upload_layout);
 
-  // create vertex buffer
-  const auto &vertices = config.vertices;
-  const auto &indices = config.indices;
-  result->SetVertex(vertices, indices);
-  result->RefreshBuffer();
+  // geometry is uploaded by the next PrepareRender
+  result->SetVertex(config.vertices, config.indices);
 
-  driver->HEndOneTimeCommandBuffer(single_command_buffer,
-                                   driver->GetGraphicsQueue());
+  return result;
+}
 
-  vmaDestroyBuffer(driver->GetVmaAllocator(), staging_buffer,
-                   staging_allocation);
+void Layer2dResource::RecordMipGeneration(VkCommandBuffer command_buffer) {
+  if (!_mips_pending) {
+    return;
+  }
+  _mips_pending = false;
 
-  // create image view
-  VkImageViewCreateInfo const image_view_info = {
-      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+  VkImageMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
       .pNext = nullptr,
-      .flags = 0,
-      .image = result->_image,
-      .viewType = VK_IMAGE_VIEW_TYPE_2D,
-      .format = config.format,
-      .components =
-          {
-              .r = VK_COMPONENT_SWIZZLE_IDENTITY,
-              .g = VK_COMPONENT_SWIZZLE_IDENTITY,
-              .b = VK_COMPONENT_SWIZZLE_IDENTITY,
-              .a = VK_COMPONENT_SWIZZLE_IDENTITY,
-          },
+      .srcAccessMask = 0,
+      .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = _image.image,
       .subresourceRange =
           {
               .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-              .baseMipLevel = 0,
-              .levelCount = 1,
+              .baseMipLevel = 1,
+              .levelCount = _mip_levels - 1,
               .baseArrayLayer = 0,
               .layerCount = 1,
           },
   };
-  AssertVkResult(vkCreateImageView(driver->GetDevice(), &image_view_info,
-                                   nullptr, &result->_image_view),
-                 "Failed to create image view");
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
 
-  return result;
+  // mip 0 arrives in transfer src layout, each level becomes the source of
+  // the next once written
+  auto width = static_cast<int32_t>(_extent.width);
+  auto height = static_cast<int32_t>(_extent.height);
+  barrier.subresourceRange.levelCount = 1;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  for (uint32_t level = 1; level < _mip_levels; ++level) {
+    int32_t const next_width = std::max(width / 2, 1);
+    int32_t const next_height = std::max(height / 2, 1);
+    VkImageBlit const blit = {
+        .srcSubresource =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = level - 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        .srcOffsets = {{0, 0, 0}, {width, height, 1}},
+        .dstSubresource =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = level,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        .dstOffsets = {{0, 0, 0}, {next_width, next_height, 1}},
+    };
+    vkCmdBlitImage(command_buffer, _image.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _image.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    barrier.subresourceRange.baseMipLevel = level;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+    width = next_width;
+    height = next_height;
+  }
+
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = _mip_levels;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                       0, nullptr, 1, &barrier);
 }
 
 Layer2dResource::~Layer2dResource() {
   auto *driver = VulkanDriver::GetSingleton();
-  vmaDestroyImage(driver->GetVmaAllocator(), _image, _allocation);
-  vkDestroyImageView(driver->GetDevice(), _image_view, nullptr);
-  vmaDestroyBuffer(driver->GetVmaAllocator(), _vertex_buffer._buffer,
-                   _vertex_buffer._allocation);
-  vmaDestroyBuffer(driver->GetVmaAllocator(), _index_buffer._buffer,
-                   _index_buffer._allocation);
+  driver->GetImagePool()->Release(_image);
+  driver->GetGeometryArena()->Free(_geometry);
 }
 
 ModelRenderer::ModelRenderer() {
@@ -272,59 +431,275 @@ ModelRenderer::ModelRenderer() {
         .flags = 0,
         .setLayoutCount = 1,
         .pSetLayouts = &_descriptor_set_layout,
-        .pushConstantRangeCount = 0,
-        .pPushConstantRanges = nullptr,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &kLayerPushConstantRange,
     };
     AssertVkResult(
         vkCreatePipelineLayout(driver->GetDevice(), &pipeline_layout_info,
                                nullptr, &_pipeline_layout),
         "Failed to create pipeline layout");
   }
-  {
-    VkDeviceSize const size =
-        sizeof(shader_gen::canvas_sd::UniformBufferObject);
-    driver->HCreateBuffer(
-        size,
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VMA_MEMORY_USAGE_CPU_TO_GPU, _ubo_buffer.buffer,
-        _ubo_buffer.allocation);
-  }
   {
     // shader objects
     _vertex_shader.stage_flag = VK_SHADER_STAGE_VERTEX_BIT;
     _fragment_shader.stage_flag = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkShaderEXT shader_exts[2];
+    CreateLinkedShaders(driver->GetShaderCache(),
+                        shader_gen::canvas_sd::vertex_spv,
+                        sizeof(shader_gen::canvas_sd::vertex_spv),
+                        shader_gen::canvas_sd::fragment_spv,
+                        sizeof(shader_gen::canvas_sd::fragment_spv),
+                        _descriptor_set_layout, shader_exts,
+                        {&kLayerPushConstantRange, 1});
+    _vertex_shader.shader = shader_exts[0];
+    _fragment_shader.shader = shader_exts[1];
+  }
+  if (driver->SupportsBindless()) {
+    CreateBindlessResources();
+  }
+  _record_chunks.resize(driver->GetFramesInFlight());
+}
 
-    VkShaderCreateInfoEXT shader_create_infos[2];
-    VkShaderCreateInfoEXT &vert_shader_create_info = shader_create_infos[0];
-    vert_shader_create_info = {};
-    vert_shader_create_info.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
-    vert_shader_create_info.pNext = nullptr;
-    vert_shader_create_info.pName = "main";
-    vert_shader_create_info.flags = VK_SHADER_CREATE_LINK_STAGE_BIT_EXT;
-    vert_shader_create_info.stage = _vertex_shader.stage_flag;
-    vert_shader_create_info.nextStage = _fragment_shader.stage_flag;
-    vert_shader_create_info.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
-    vert_shader_create_info.codeSize =
-        sizeof(shader_gen::canvas_sd::vertex_spv);
-    vert_shader_create_info.pCode = shader_gen::canvas_sd::vertex_spv;
-    vert_shader_create_info.setLayoutCount = 1;
-    vert_shader_create_info.pSetLayouts = &_descriptor_set_layout;
-
-    VkShaderCreateInfoEXT &frag_shader_create_info = shader_create_infos[1];
-    frag_shader_create_info = vert_shader_create_info;
-    frag_shader_create_info.stage = _fragment_shader.stage_flag;
-    frag_shader_create_info.nextStage = 0;
-    frag_shader_create_info.codeSize =
-        sizeof(shader_gen::canvas_sd::fragment_spv);
-    frag_shader_create_info.pCode = shader_gen::canvas_sd::fragment_spv;
+void ModelRenderer::CreateBindlessResources() {
+  const auto *driver = VulkanDriver::GetSingleton();
+  namespace sd = shader_gen::canvas_bindless_sd;
+  {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(driver->GetPhysicalDevice(), &properties);
+    const auto &limits = properties.limits;
+    _max_bindless_layers = std::min({
+        kMaxBindlessLayers,
+        limits.maxPerStageDescriptorSampledImages,
+        limits.maxPerStageDescriptorSamplers,
+        limits.maxDescriptorSetSampledImages,
+        limits.maxDescriptorSetSamplers,
+        limits.maxDrawIndirectCount,
+    });
+  }
+  {
+    std::array<VkDescriptorSetLayoutBinding, 3> const bindings = {{
+        {
+            .binding = sd::ubo.binding,
+            .descriptorType = sd::ubo.desc_type,
+            .descriptorCount = 1,
+            .stageFlags = sd::ubo.stages,
+        },
+        {
+            .binding = sd::draw_buffer.binding,
+            .descriptorType = sd::draw_buffer.desc_type,
+            .descriptorCount = 1,
+            .stageFlags = sd::draw_buffer.stages,
+        },
+        {
+            .binding = sd::layer_textures.binding,
+            .descriptorType = sd::layer_textures.desc_type,
+            .descriptorCount = _max_bindless_layers,
+            .stageFlags = sd::layer_textures.stages,
+        },
+    }};
+    // the texture array is last, so it may have a variable size
+    std::array<VkDescriptorBindingFlagsEXT, 3> constexpr binding_flags = {
+        0,
+        0,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT,
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT const flags_info = {
+        .sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+        .pNext = nullptr,
+        .bindingCount = static_cast<uint32_t>(binding_flags.size()),
+        .pBindingFlags = binding_flags.data(),
+    };
+    VkDescriptorSetLayoutCreateInfo const set_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = &flags_info,
+        .flags = 0,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data(),
+    };
+    AssertVkResult(
+        vkCreateDescriptorSetLayout(driver->GetDevice(), &set_layout_info,
+                                    nullptr, &_bindless_set_layout),
+        "Failed to create bindless descriptor set layout");
+
+    VkPipelineLayoutCreateInfo const pipeline_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = &_bindless_set_layout,
+        .pushConstantRangeCount = 0,
+        .pPushConstantRanges = nullptr,
+    };
+    AssertVkResult(
+        vkCreatePipelineLayout(driver->GetDevice(), &pipeline_layout_info,
+                               nullptr, &_bindless_pipeline_layout),
+        "Failed to create bindless pipeline layout");
+  }
+  {
+    auto const frame_count = driver->GetFramesInFlight();
+    std::array<VkDescriptorPoolSize, 3> const pool_sizes = {{
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frame_count},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame_count},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         frame_count * _max_bindless_layers},
+    }};
+    VkDescriptorPoolCreateInfo const pool_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .maxSets = frame_count,
+        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+        .pPoolSizes = pool_sizes.data(),
+    };
+    AssertVkResult(vkCreateDescriptorPool(driver->GetDevice(), &pool_info,
+                                          nullptr, &_bindless_descriptor_pool),
+                   "Failed to create bindless descriptor pool");
 
+    _bindless_frames.resize(frame_count);
+    for (auto &frame : _bindless_frames) {
+      VkDescriptorSetVariableDescriptorCountAllocateInfoEXT const count_info = {
+          .sType =
+              VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT,
+          .pNext = nullptr,
+          .descriptorSetCount = 1,
+          .pDescriptorCounts = &_max_bindless_layers,
+      };
+      VkDescriptorSetAllocateInfo const alloc_info = {
+          .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+          .pNext = &count_info,
+          .descriptorPool = _bindless_descriptor_pool,
+          .descriptorSetCount = 1,
+          .pSetLayouts = &_bindless_set_layout,
+      };
+      AssertVkResult(vkAllocateDescriptorSets(driver->GetDevice(), &alloc_info,
+                                              &frame.descriptor_set),
+                     "Failed to allocate bindless descriptor set");
+    }
+  }
+  {
+    _bindless_vertex_shader.stage_flag = VK_SHADER_STAGE_VERTEX_BIT;
+    _bindless_fragment_shader.stage_flag = VK_SHADER_STAGE_FRAGMENT_BIT;
     VkShaderEXT shader_exts[2];
+    CreateLinkedShaders(driver->GetShaderCache(), sd::vertex_spv,
+                        sizeof(sd::vertex_spv), sd::fragment_spv,
+                        sizeof(sd::fragment_spv), _bindless_set_layout,
+                        shader_exts);
+    _bindless_vertex_shader.shader = shader_exts[0];
+    _bindless_fragment_shader.shader = shader_exts[1];
+  }
+}
 
-    AssertVkResult(vkCreateShadersEXT(
-        driver->GetDevice(), 2, shader_create_infos, nullptr, shader_exts));
-    _vertex_shader.shader = shader_exts[0];
-    _fragment_shader.shader = shader_exts[1];
+void ModelRenderer::DestroyBindlessResources() {
+  if (_max_bindless_layers == 0) {
+    return;
+  }
+  auto *driver = VulkanDriver::GetSingleton();
+  _bindless_frames.clear();
+  _bindless_vertex_shader.Destroy(driver->GetDevice());
+  _bindless_fragment_shader.Destroy(driver->GetDevice());
+  vkDestroyDescriptorPool(driver->GetDevice(), _bindless_descriptor_pool,
+                          nullptr);
+  vkDestroyPipelineLayout(driver->GetDevice(), _bindless_pipeline_layout,
+                          nullptr);
+  vkDestroyDescriptorSetLayout(driver->GetDevice(), _bindless_set_layout,
+                               nullptr);
+  _max_bindless_layers = 0;
+}
+
+bool ModelRenderer::IsBindlessActive() const {
+  return _draw_mode == DrawMode::kBindlessIndirect && IsBindlessSupported() &&
+         !_draw_layers.empty() &&
+         _draw_layers.size() <= _max_bindless_layers;
+}
+
+void ModelRenderer::UpdateBindlessFrame() {
+  auto *driver = VulkanDriver::GetSingleton();
+  auto *frame_ring = driver->GetFrameRing();
+  auto &frame = _bindless_frames[driver->GetCurrentFrameIndex()];
+  auto const layer_count = static_cast<uint32_t>(_draw_layers.size());
+  namespace sd = shader_gen::canvas_bindless_sd;
+
+  // geometry ranges move whenever a mesh is edited, rebuild every frame
+  auto const draw_data =
+      frame_ring->AllocateStorage(sizeof(LayerDrawData) * layer_count);
+  frame.indirect_commands = frame_ring->Allocate(
+      sizeof(VkDrawIndexedIndirectCommand) * layer_count, sizeof(uint32_t));
+  auto *draws = static_cast<LayerDrawData *>(draw_data.data);
+  auto *commands =
+      static_cast<VkDrawIndexedIndirectCommand *>(frame.indirect_commands.data);
+  for (uint32_t i = 0; i < layer_count; ++i) {
+    const auto *layer = _draw_layers[i];
+    draws[i] = LayerDrawData{};
+    draws[i].texture_index = i;
+    draws[i].opacity = layer->GetOpacity();
+    commands[i] = {
+        .indexCount = layer->GetIndexCount(),
+        .instanceCount = 1,
+        .firstIndex = layer->GetFirstIndex(),
+        .vertexOffset = layer->GetVertexOffset(),
+        .firstInstance = i,
+    };
+  }
+
+  std::vector<VkWriteDescriptorSet> writes;
+  VkDescriptorBufferInfo const ubo_info = {
+      .buffer = _ubo_allocation.buffer,
+      .offset = _ubo_allocation.offset,
+      .range = _ubo_allocation.size,
+  };
+  writes.push_back({
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .pNext = nullptr,
+      .dstSet = frame.descriptor_set,
+      .dstBinding = sd::ubo.binding,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = sd::ubo.desc_type,
+      .pBufferInfo = &ubo_info,
+  });
+  VkDescriptorBufferInfo const draw_info = {
+      .buffer = draw_data.buffer,
+      .offset = draw_data.offset,
+      .range = draw_data.size,
+  };
+  writes.push_back({
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .pNext = nullptr,
+      .dstSet = frame.descriptor_set,
+      .dstBinding = sd::draw_buffer.binding,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = sd::draw_buffer.desc_type,
+      .pBufferInfo = &draw_info,
+  });
+  // texture slots only change with the layer list
+  std::vector<VkDescriptorImageInfo> image_infos;
+  if (frame.layers_version != _layers_version) {
+    image_infos.resize(layer_count);
+    for (uint32_t i = 0; i < layer_count; ++i) {
+      image_infos[i] = {
+          .sampler = _sampler,
+          .imageView = _draw_layers[i]->GetImageView(),
+          .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      };
+    }
+    writes.push_back({
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = frame.descriptor_set,
+        .dstBinding = sd::layer_textures.binding,
+        .dstArrayElement = 0,
+        .descriptorCount = layer_count,
+        .descriptorType = sd::layer_textures.desc_type,
+        .pImageInfo = image_infos.data(),
+    });
+    frame.layers_version = _layers_version;
   }
+  vkUpdateDescriptorSets(driver->GetDevice(),
+                         static_cast<uint32_t>(writes.size()), writes.data(),
+                         0, nullptr);
 }
 
 void ModelRenderer::AutoCenterCanvas() {
@@ -338,49 +713,301 @@ void ModelRenderer::AutoCenterCanvas() {
   _canvas_scale = canvas_2_region_scale;
   _canvas_offset.x = canvas_x_offset;
   _canvas_offset.y = canvas_y_offset;
+  _canvas_dirty = true;
 }
 void ModelRenderer::UpdateUniform() {
   auto *driver = VulkanDriver::GetSingleton();
-  void *data;
-  vmaMapMemory(driver->GetVmaAllocator(), _ubo_buffer.allocation, &data);
   shader_gen::canvas_sd::UniformBufferObject ubo = {};
   ubo.region_scale = _canvas_scale;
   ubo.screen_size = glm::vec2(static_cast<float>(_region.width),
                               static_cast<float>(_region.height));
   ubo.region_offset = _canvas_offset;
-  memcpy(data, &ubo, sizeof(ubo));
-  vmaUnmapMemory(driver->GetVmaAllocator(), _ubo_buffer.allocation);
+  _ubo_allocation = driver->GetFrameRing()->PushUniform(ubo);
+}
+void ModelRenderer::EnsureCanvasTarget() {
+  auto *driver = VulkanDriver::GetSingleton();
+  const auto &extent = _render_target.extent;
+  if (_canvas.image != VK_NULL_HANDLE &&
+      _canvas.extent.width == extent.width &&
+      _canvas.extent.height == extent.height &&
+      _canvas.format == _render_target.format) {
+    return;
+  }
+  DestroyCanvasTarget();
+  _canvas.extent = extent;
+  _canvas.format = _render_target.format;
+
+  VmaAllocationCreateInfo const alloc_info = {
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+  };
+  VkImageCreateInfo const image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = _canvas.format,
+      .extent = {.width = extent.width, .height = extent.height, .depth = 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+               VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  AssertVkResult(
+      vmaCreateImage(driver->GetVmaAllocator(), &image_info, &alloc_info,
+                     &_canvas.image, &_canvas.allocation, nullptr),
+      "Failed to create canvas image");
+  VkImageViewCreateInfo const image_view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .image = _canvas.image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = _canvas.format,
+      .components =
+          {
+              .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+          },
+      .subresourceRange =
+          {
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .baseMipLevel = 0,
+              .levelCount = 1,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+          },
+  };
+  AssertVkResult(vkCreateImageView(driver->GetDevice(), &image_view_info,
+                                   nullptr, &_canvas.view),
+                 "Failed to create canvas image view");
+  _canvas_dirty = true;
+}
+void ModelRenderer::DestroyCanvasTarget() {
+  if (_canvas.image == VK_NULL_HANDLE) {
+    return;
+  }
+  auto *driver = VulkanDriver::GetSingleton();
+  // only happens on resize, frames in flight may still copy from it
+  vkDeviceWaitIdle(driver->GetDevice());
+  vkDestroyImageView(driver->GetDevice(), _canvas.view, nullptr);
+  vmaDestroyImage(driver->GetVmaAllocator(), _canvas.image,
+                  _canvas.allocation);
+  _canvas = {};
 }
 void ModelRenderer::PrepareRender() {
-  for (auto &layer : _render_layers) {
+  WAIFU_TRACE_SCOPE("ModelRenderer::PrepareRender");
+  if (_draw_layers_version != _layers_version) {
+    // O(drawn), about what recording them costs anyway
+    _draw_layers.assign(_drawn_layers.begin(), _drawn_layers.end());
+    _draw_layers_version = _layers_version;
+  }
+  for (auto &layer : _draw_layers) {
     if (layer->IsBufferDirty()) {
       layer->RefreshBuffer();
+      _canvas_dirty = true;
+    }
+    _canvas_dirty |= layer->HasPendingMips();
+  }
+  if (IsCanvasCacheEnabled()) {
+    EnsureCanvasTarget();
+    if (!_canvas_dirty) {
+      // the cached canvas is reused, nothing to draw this frame
+      return;
     }
   }
-}
-void ModelRenderer::RecordCommandBuffer(VkCommandBuffer command_buffer) {
-  // begin record command buffer
   UpdateUniform();
-  auto driver = VulkanDriver::GetSingleton();
+  if (IsBindlessActive()) {
+    UpdateBindlessFrame();
+  }
+}
+void ModelRenderer::AddPasses(RenderGraph &graph, RenderGraphImage target) {
+  // blits are not allowed inside dynamic rendering
+  if (std::ranges::any_of(_draw_layers, [](const Layer2dResource *layer) {
+        return layer->HasPendingMips();
+      })) {
+    graph.AddPass(
+        "mip generation",
+        [](RenderGraph::PassBuilder &pass) {
+          // layer images are not tracked by the graph, each keeps its own
+          // barriers
+          pass.SetSideEffects();
+        },
+        [this](VkCommandBuffer command_buffer) {
+          for (auto *layer : _draw_layers) {
+            layer->RecordMipGeneration(command_buffer);
+          }
+        });
+  }
+  if (!IsCanvasCacheEnabled()) {
+    graph.AddPass(
+        "canvas pass",
+        [target](RenderGraph::PassBuilder &pass) {
+          pass.Write(target, ImageUsage::kColorAttachment, true);
+        },
+        [this, &graph, target](VkCommandBuffer command_buffer) {
+          RecordCanvasPass(command_buffer, graph.GetImageView(target),
+                           _render_target.format);
+          _canvas_dirty = false;
+        });
+    return;
+  }
+  // the canvas stays in transfer src layout between frames, a frame still in
+  // flight may be copying from it
+  auto const canvas = graph.ImportImage(
+      "canvas", _canvas.image, _canvas.view, _canvas.format, _canvas.extent,
+      {.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+       .stages = VK_PIPELINE_STAGE_TRANSFER_BIT,
+       .access = 0},
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  if (_canvas_dirty) {
+    graph.AddPass(
+        "canvas pass",
+        [canvas](RenderGraph::PassBuilder &pass) {
+          pass.Write(canvas, ImageUsage::kColorAttachment, true);
+        },
+        [this](VkCommandBuffer command_buffer) {
+          RecordCanvasPass(command_buffer, _canvas.view, _canvas.format);
+          _canvas_dirty = false;
+        });
+  } else {
+    _record_cpu_ms = 0.0f;
+  }
+  graph.AddPass(
+      "canvas composite",
+      [canvas, target](RenderGraph::PassBuilder &pass) {
+        pass.Read(canvas, ImageUsage::kTransferSrc);
+        pass.Write(target, ImageUsage::kTransferDst, true);
+      },
+      [this, &graph, target](VkCommandBuffer command_buffer) {
+        RecordCanvasComposite(command_buffer, graph.GetImage(target));
+      });
+}
+void ModelRenderer::RecordCanvasComposite(VkCommandBuffer command_buffer,
+                                          VkImage target) const {
+  VkImageSubresourceLayers constexpr subresource = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .mipLevel = 0,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+  };
+  VkImageCopy const region = {
+      .srcSubresource = subresource,
+      .srcOffset = {0, 0, 0},
+      .dstSubresource = subresource,
+      .dstOffset = {0, 0, 0},
+      .extent = {_canvas.extent.width, _canvas.extent.height, 1},
+  };
+  vkCmdCopyImage(command_buffer, _canvas.image,
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+void ModelRenderer::SetCanvasState(VkCommandBuffer command_buffer) const {
+  vkCmdSetCullModeEXT(command_buffer, VK_CULL_MODE_NONE);
+  vkCmdSetDepthTestEnableEXT(command_buffer, VK_FALSE);
+  vkCmdSetDepthWriteEnableEXT(command_buffer, VK_FALSE);
+  vkCmdSetRasterizerDiscardEnableEXT(command_buffer, VK_FALSE);
+  vkCmdSetStencilTestEnableEXT(command_buffer, VK_FALSE);
+  vkCmdSetDepthBiasEnableEXT(command_buffer, VK_FALSE);
+  vkCmdSetRasterizationSamplesEXT(command_buffer, VK_SAMPLE_COUNT_1_BIT);
+  constexpr VkSampleMask mask = ~0u;
+  vkCmdSetSampleMaskEXT(command_buffer, VK_SAMPLE_COUNT_1_BIT, &mask);
+  vkCmdSetAlphaToOneEnableEXT(command_buffer, VK_FALSE);
+  vkCmdSetAlphaToCoverageEnableEXT(command_buffer, VK_FALSE);
+
+  vkCmdSetPolygonModeEXT(command_buffer, VK_POLYGON_MODE_FILL);
+  vkCmdSetPrimitiveTopologyEXT(command_buffer,
+                               VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  vkCmdSetPrimitiveRestartEnableEXT(command_buffer, VK_FALSE);
+
+  constexpr VkBool32 blend_enable = VK_TRUE;
+  vkCmdSetColorBlendEnableEXT(command_buffer, 0 /* firstAttachment */,
+                              1 /* count */, &blend_enable);
+  VkColorBlendEquationEXT constexpr blend_equation = {
+      // layer textures are premultiplied
+      .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+      .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+      .colorBlendOp = VK_BLEND_OP_ADD,
+      // keeps coverage correct for targets that are read back
+      .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+      .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+      .alphaBlendOp = VK_BLEND_OP_ADD,
+  };
+  vkCmdSetColorBlendEquationEXT(command_buffer, 0 /* firstAttachment */,
+                                1 /* count */, &blend_equation);
+
+  const VkColorComponentFlags color_mask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+  vkCmdSetColorWriteMaskEXT(command_buffer, 0 /* firstAttachment */,
+                            1 /* count */, &color_mask);
+
+  const VkViewport viewport = {static_cast<float>(_region.x),
+                               static_cast<float>(_region.y),
+                               static_cast<float>(_region.width),
+                               static_cast<float>(_region.height),
+                               0.0f,
+                               1.0f};
+  vkCmdSetViewportWithCountEXT(command_buffer, 1, &viewport);
+  const VkRect2D scissor = {
+      .offset = {_region.x, _region.y},
+      .extent = {_region.width, _region.height},
+  };
+
+  vkCmdSetScissorWithCountEXT(command_buffer, 1, &scissor);
+
+  SetVertexInput(command_buffer);
+  // every layer lives in the shared arena, bind it once
+  const auto *arena = VulkanDriver::GetSingleton()->GetGeometryArena();
+  auto *vertex_buffer = arena->GetVertexBuffer();
+  constexpr VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer, &offset);
+  vkCmdBindIndexBuffer(command_buffer, arena->GetIndexBuffer(), 0,
+                       VK_INDEX_TYPE_UINT32);
+}
+uint32_t ModelRenderer::ChooseRecordChunkCount() const {
+  if (!_parallel_recording || IsBindlessActive()) {
+    return 1;
+  }
+  // below a few hundred draws the secondary command buffers cost more than
+  // recording inline
+  auto const layer_count = static_cast<uint32_t>(_draw_layers.size());
+  uint32_t const max_chunks =
+      static_cast<uint32_t>(ThreadPool::GetGlobal()->GetThreadCount()) + 1;
+  return std::clamp(layer_count / kMinLayersPerRecordChunk, 1u, max_chunks);
+}
+void ModelRenderer::RecordCanvasPass(VkCommandBuffer command_buffer,
+                                     VkImageView view, VkFormat format) {
+  auto const record_begin = std::chrono::steady_clock::now();
+  uint32_t const chunk_count = ChooseRecordChunkCount();
   {
     VkRenderingAttachmentInfo att_info = {};
     att_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    att_info.imageView = _render_target_view;
+    att_info.imageView = view;
     att_info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     att_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     att_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    att_info.clearValue = {.color = {0.8f, 0.8f, 0.8f, 1.0f}};
+    att_info.clearValue = {.color = _clear_color};
     att_info.resolveMode = VK_RESOLVE_MODE_NONE;
 
     // render_info
     VkRenderingInfo const render_info = {
         .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
         .pNext = nullptr,
-        .flags = 0,
+        .flags = chunk_count > 1
+                     ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT
+                     : VkRenderingFlags{0},
         .renderArea =
             {
                 .offset = {0, 0},
-                .extent = driver->GetSwapchainExtent(),
+                .extent = _render_target.extent,
             },
         .layerCount = 1,
         .colorAttachmentCount = 1,
@@ -388,85 +1015,174 @@ void ModelRenderer::RecordCommandBuffer(VkCommandBuffer command_buffer) {
     };
     vkCmdBeginRenderingKHR(command_buffer, &render_info);
   }
+  if (chunk_count > 1) {
+    RecordParallelDraws(command_buffer, format, chunk_count);
+  } else {
+    SetCanvasState(command_buffer);
+    if (IsBindlessActive()) {
+      RecordBindlessDraws(command_buffer);
+    } else {
+      RecordPerLayerDraws(command_buffer);
+    }
+  }
+  _record_chunk_count = chunk_count > 1 ? chunk_count : 0;
   {
-    vkCmdSetCullModeEXT(command_buffer, VK_CULL_MODE_NONE);
-    vkCmdSetDepthTestEnableEXT(command_buffer, VK_FALSE);
-    vkCmdSetDepthWriteEnableEXT(command_buffer, VK_FALSE);
-    vkCmdSetRasterizerDiscardEnableEXT(command_buffer, VK_FALSE);
-    vkCmdSetStencilTestEnableEXT(command_buffer, VK_FALSE);
-    vkCmdSetDepthBiasEnableEXT(command_buffer, VK_FALSE);
-    vkCmdSetRasterizationSamplesEXT(command_buffer, VK_SAMPLE_COUNT_1_BIT);
-    constexpr VkSampleMask mask = ~0u;
-    vkCmdSetSampleMaskEXT(command_buffer, VK_SAMPLE_COUNT_1_BIT, &mask);
-    vkCmdSetAlphaToOneEnableEXT(command_buffer, VK_FALSE);
-    vkCmdSetAlphaToCoverageEnableEXT(command_buffer, VK_FALSE);
-
-    vkCmdSetPolygonModeEXT(command_buffer, VK_POLYGON_MODE_FILL);
-    vkCmdSetPrimitiveTopologyEXT(command_buffer,
-                                 VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-    vkCmdSetPrimitiveRestartEnableEXT(command_buffer, VK_FALSE);
-
-    constexpr VkBool32 blend_enable = VK_TRUE;
-    vkCmdSetColorBlendEnableEXT(command_buffer, 0 /* firstAttachment */,
-                                1 /* count */, &blend_enable);
-    VkColorBlendEquationEXT constexpr blend_equation = {
-        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
-        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
-        .colorBlendOp = VK_BLEND_OP_ADD,
-        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .alphaBlendOp = VK_BLEND_OP_ADD,
-    };
-    vkCmdSetColorBlendEquationEXT(command_buffer, 0 /* firstAttachment */,
-                                  1 /* count */, &blend_equation);
-
-    const VkColorComponentFlags color_mask =
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-    vkCmdSetColorWriteMaskEXT(command_buffer, 0 /* firstAttachment */,
-                              1 /* count */, &color_mask);
-
-    const VkViewport viewport = {static_cast<float>(_region.x),
-                                 static_cast<float>(_region.y),
-                                 static_cast<float>(_region.width),
-                                 static_cast<float>(_region.height),
-                                 0.0f,
-                                 1.0f};
-    vkCmdSetViewportWithCountEXT(command_buffer, 1, &viewport);
-    const VkRect2D scissor = {
-        .offset = {_region.x, _region.y},
-        .extent = {_region.width, _region.height},
-    };
-
-    vkCmdSetScissorWithCountEXT(command_buffer, 1, &scissor);
+    vkCmdEndRenderingKHR(command_buffer);
   }
+  _record_cpu_ms = std::chrono::duration<float, std::milli>(
+                       std::chrono::steady_clock::now() - record_begin)
+                       .count();
+}
 
-  {
-    SetVertexInput(command_buffer);
-    auto shader_stages = std::array<VkShaderEXT, 2>{_vertex_shader.shader,
-                                                    _fragment_shader.shader};
-    auto shader_bits = std::array<VkShaderStageFlagBits, 2>{
-        _vertex_shader.stage_flag, _fragment_shader.stage_flag};
-    vkCmdBindShadersEXT(command_buffer,
-                        static_cast<uint32_t>(shader_stages.size()),
-                        shader_bits.data(), shader_stages.data());
-    for (uint32_t i = 0; i < _render_layers.size(); ++i) {
+void ModelRenderer::BindPerLayerShaders(VkCommandBuffer command_buffer) const {
+  auto shader_stages = std::array<VkShaderEXT, 2>{_vertex_shader.shader,
+                                                  _fragment_shader.shader};
+  auto shader_bits = std::array<VkShaderStageFlagBits, 2>{
+      _vertex_shader.stage_flag, _fragment_shader.stage_flag};
+  vkCmdBindShadersEXT(command_buffer,
+                      static_cast<uint32_t>(shader_stages.size()),
+                      shader_bits.data(), shader_stages.data());
+}
+
+void ModelRenderer::RecordPerLayerDraws(VkCommandBuffer command_buffer) const {
+  BindPerLayerShaders(command_buffer);
+  auto *profiler = VulkanDriver::GetSingleton()->GetGpuProfiler();
+  auto const layer_count = static_cast<uint32_t>(_draw_layers.size());
+  for (uint32_t begin = 0; begin < layer_count; begin += kLayersPerGpuScope) {
+    GpuScope const scope(profiler, command_buffer, "layer batch",
+                         static_cast<int32_t>(begin / kLayersPerGpuScope));
+    uint32_t const end = std::min(begin + kLayersPerGpuScope, layer_count);
+    for (uint32_t i = begin; i < end; ++i) {
+      const auto *layer = _draw_layers[i];
       BindLayerDrawCommand(command_buffer, i);
-      vkCmdDrawIndexed(command_buffer, _render_layers[i]->GetIndexCount(), 1, 0,
-                       0, 0);
+      vkCmdDrawIndexed(command_buffer, layer->GetIndexCount(), 1,
+                       layer->GetFirstIndex(), layer->GetVertexOffset(), 0);
     }
   }
-  {
-    vkCmdEndRenderingKHR(command_buffer);
+  VulkanDriver::GetSingleton()->CountDrawCalls(
+      static_cast<uint32_t>(_draw_layers.size()));
+}
+
+void ModelRenderer::RecordParallelDraws(VkCommandBuffer command_buffer,
+                                        VkFormat format,
+                                        uint32_t chunk_count) {
+  auto *driver = VulkanDriver::GetSingleton();
+  auto &chunks = _record_chunks[driver->GetCurrentFrameIndex()];
+  while (chunks.size() < chunk_count) {
+    RecordChunk chunk;
+    VkCommandPoolCreateInfo const command_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = driver->GetGraphicsQueueFamilyIndex(),
+    };
+    AssertVkResult(vkCreateCommandPool(driver->GetDevice(), &command_pool_info,
+                                       nullptr, &chunk.command_pool),
+                   "Failed to create record chunk command pool");
+    VkCommandBufferAllocateInfo const alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .commandPool = chunk.command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandBufferCount = 1,
+    };
+    AssertVkResult(vkAllocateCommandBuffers(driver->GetDevice(), &alloc_info,
+                                            &chunk.command_buffer),
+                   "Failed to allocate record chunk command buffer");
+    chunks.push_back(chunk);
+  }
+
+  VkCommandBufferInheritanceRenderingInfo const rendering_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .viewMask = 0,
+      .colorAttachmentCount = 1,
+      .pColorAttachmentFormats = &format,
+      .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
+      .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+  };
+  VkCommandBufferInheritanceInfo const inheritance_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+      .pNext = &rendering_info,
+      .renderPass = VK_NULL_HANDLE,
+      .subpass = 0,
+      .framebuffer = VK_NULL_HANDLE,
+      .occlusionQueryEnable = VK_FALSE,
+      .queryFlags = 0,
+      .pipelineStatistics = 0,
+  };
+  auto const layer_count = static_cast<uint32_t>(_draw_layers.size());
+  // contiguous ranges executed in chunk order keep the layer order intact.
+  // the gpu profiler is not thread safe, the whole pass is one scope here
+  ThreadPool::GetGlobal()->ParallelFor(chunk_count, [&](size_t index) {
+    auto const &chunk = chunks[index];
+    AssertVkResult(
+        vkResetCommandPool(driver->GetDevice(), chunk.command_pool, 0),
+        "Failed to reset record chunk command pool");
+    VkCommandBufferBeginInfo const begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                 VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritance_info,
+    };
+    AssertVkResult(vkBeginCommandBuffer(chunk.command_buffer, &begin_info),
+                   "Failed to begin record chunk command buffer");
+    SetCanvasState(chunk.command_buffer);
+    BindPerLayerShaders(chunk.command_buffer);
+    auto const begin =
+        static_cast<uint32_t>(uint64_t{layer_count} * index / chunk_count);
+    auto const end = static_cast<uint32_t>(uint64_t{layer_count} *
+                                           (index + 1) / chunk_count);
+    for (uint32_t i = begin; i < end; ++i) {
+      const auto *layer = _draw_layers[i];
+      BindLayerDrawCommand(chunk.command_buffer, i);
+      vkCmdDrawIndexed(chunk.command_buffer, layer->GetIndexCount(), 1,
+                       layer->GetFirstIndex(), layer->GetVertexOffset(), 0);
+    }
+    AssertVkResult(vkEndCommandBuffer(chunk.command_buffer),
+                   "Failed to end record chunk command buffer");
+  });
+
+  std::vector<VkCommandBuffer> command_buffers;
+  command_buffers.reserve(chunk_count);
+  for (uint32_t i = 0; i < chunk_count; ++i) {
+    command_buffers.push_back(chunks[i].command_buffer);
   }
+  vkCmdExecuteCommands(command_buffer, chunk_count, command_buffers.data());
+  driver->CountDrawCalls(layer_count);
+}
+
+void ModelRenderer::RecordBindlessDraws(VkCommandBuffer command_buffer) const {
+  auto *driver = VulkanDriver::GetSingleton();
+  const auto &frame = _bindless_frames[driver->GetCurrentFrameIndex()];
+  auto shader_stages = std::array<VkShaderEXT, 2>{
+      _bindless_vertex_shader.shader, _bindless_fragment_shader.shader};
+  auto shader_bits = std::array<VkShaderStageFlagBits, 2>{
+      _bindless_vertex_shader.stage_flag, _bindless_fragment_shader.stage_flag};
+  vkCmdBindShadersEXT(command_buffer,
+                      static_cast<uint32_t>(shader_stages.size()),
+                      shader_bits.data(), shader_stages.data());
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          _bindless_pipeline_layout, 0, 1,
+                          &frame.descriptor_set, 0, nullptr);
+  // one batch holds every layer
+  GpuScope const scope(driver->GetGpuProfiler(), command_buffer,
+                       "layer batch", 0);
+  vkCmdDrawIndexedIndirect(command_buffer, frame.indirect_commands.buffer,
+                           frame.indirect_commands.offset,
+                           static_cast<uint32_t>(_draw_layers.size()),
+                           sizeof(VkDrawIndexedIndirectCommand));
+  driver->CountDrawCalls(1);
 }
 
 void ModelRenderer::BindLayerDrawCommand(VkCommandBuffer command_buffer,
                                          uint32_t index) const {
   VkDescriptorImageInfo const image_info = {
       .sampler = _sampler,
-      .imageView = _render_layers[index]->GetImageView(),
+      .imageView = _draw_layers[index]->GetImageView(),
       .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
   };
 
@@ -482,7 +1198,10 @@ void ModelRenderer::BindLayerDrawCommand(VkCommandBuffer command_buffer,
   };
 
   VkDescriptorBufferInfo const buffer_info = {
-      .buffer = _ubo_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+      .buffer = _ubo_allocation.buffer,
+      .offset = _ubo_allocation.offset,
+      .range = _ubo_allocation.size,
+  };
   VkWriteDescriptorSet const ubo_write_set = {
       .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
       .pNext = nullptr,
@@ -499,22 +1218,111 @@ void ModelRenderer::BindLayerDrawCommand(VkCommandBuffer command_buffer,
   vkCmdPushDescriptorSetKHR(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                             _pipeline_layout, 0, write_sets.size(),
                             write_sets.data());
-
-  auto *vertex_buffer = _render_layers[index]->GetVertexBuffer();
-  auto *index_buffer = _render_layers[index]->GetIndexBuffer();
-  constexpr VkDeviceSize offset = 0;
-  vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer, &offset);
-  vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+  LayerPushConstants const constants = {
+      .opacity = _draw_layers[index]->GetOpacity(),
+  };
+  vkCmdPushConstants(command_buffer, _pipeline_layout,
+                     kLayerPushConstantRange.stageFlags,
+                     kLayerPushConstantRange.offset,
+                     kLayerPushConstantRange.size, &constants);
+}
+void ModelRenderer::DestroyRecordChunks() {
+  const auto *driver = VulkanDriver::GetSingleton();
+  for (auto &chunks : _record_chunks) {
+    for (auto &chunk : chunks) {
+      // frees the command buffer with it
+      vkDestroyCommandPool(driver->GetDevice(), chunk.command_pool, nullptr);
+    }
+  }
+  _record_chunks.clear();
 }
 void ModelRenderer::AddLayer(Layer2dResource *layer) {
-  _render_layers.push_back(layer);
+  InsertLayer(layer, nullptr);
+}
+void ModelRenderer::InsertLayer(Layer2dResource *layer,
+                                Layer2dResource *before) {
+  auto const position = before && IsListed(before) ? before->_list_position
+                                                     : _render_layers.end();
+  layer->_list_position = _render_layers.insert(position, layer);
+  layer->_list_generation = _list_generation;
+  AssignDrawOrder(layer);
+  if (layer->IsDrawn()) {
+    _drawn_layers.insert(layer);
+    ++_layers_version;
+    _canvas_dirty = true;
+  }
+}
+void ModelRenderer::RemoveLayer(Layer2dResource *layer) {
+  if (!IsListed(layer)) {
+    return;
+  }
+  if (_drawn_layers.erase(layer) > 0) {
+    ++_layers_version;
+    _canvas_dirty = true;
+  }
+  _render_layers.erase(layer->_list_position);
+  layer->_list_generation = 0;
+}
+void ModelRenderer::ClearLayers() {
+  ++_list_generation;
+  _render_layers.clear();
+  _drawn_layers.clear();
+  ++_layers_version;
+  _canvas_dirty = true;
+}
+void ModelRenderer::AssignDrawOrder(Layer2dResource *layer) {
+  auto const it = layer->_list_position;
+  uint64_t const previous =
+      it == _render_layers.begin() ? 0 : (*std::prev(it))->_draw_order;
+  auto const next = std::next(it);
+  if (next == _render_layers.end()) {
+    layer->_draw_order = previous + kDrawOrderSpacing;
+    return;
+  }
+  if ((*next)->_draw_order - previous >= 2) {
+    layer->_draw_order = previous + ((*next)->_draw_order - previous) / 2;
+    return;
+  }
+  // the relative order stays the same, so _drawn_layers stays sorted
+  uint64_t order = 0;
+  for (auto *other : _render_layers) {
+    order += kDrawOrderSpacing;
+    other->_draw_order = order;
+  }
+}
+void ModelRenderer::UpdateDrawLayer(Layer2dResource *layer, bool was_drawn) {
+  if (!IsListed(layer) || layer->IsDrawn() == was_drawn) {
+    // not added yet, InsertLayer looks at the flags
+    return;
+  }
+  if (was_drawn) {
+    _drawn_layers.erase(layer);
+  } else {
+    _drawn_layers.insert(layer);
+  }
+  ++_layers_version;
+  _canvas_dirty = true;
+}
+void ModelRenderer::SetLayerVisible(Layer2dResource *layer, bool visible) {
+  bool const was_drawn = layer->IsDrawn();
+  layer->_visible = visible;
+  UpdateDrawLayer(layer, was_drawn);
+}
+void ModelRenderer::SetLayerOpacity(Layer2dResource *layer, float opacity) {
+  bool const was_drawn = layer->IsDrawn();
+  opacity = std::clamp(opacity, 0.0f, 1.0f);
+  _canvas_dirty |= layer->_opacity != opacity;
+  layer->_opacity = opacity;
+  UpdateDrawLayer(layer, was_drawn);
 }
 ModelRenderer::~ModelRenderer() {
   auto *driver = VulkanDriver::GetSingleton();
   vkDeviceWaitIdle(driver->GetDevice());
+  DestroyCanvasTarget();
+  DestroyBindlessResources();
+  DestroyRecordChunks();
   _vertex_shader.Destroy(driver->GetDevice());
   _fragment_shader.Destroy(driver->GetDevice());
-  _ubo_buffer.Destroy(driver->GetVmaAllocator());
   vkDestroySampler(driver->GetDevice(), _sampler, nullptr);
 
   vkDestroyDescriptorSetLayout(driver->GetDevice(), _descriptor_set_layout,
@@ -4,8 +4,16 @@
 #include <volk.h>
 #include <vk_mem_alloc.h>
 #include <glm/glm.hpp>
+#include <list>
+#include <set>
 #include <span>
+#include <utility>
+#include <vector>
+#include "render_core/frame_ring.h"
+#include "render_core/geometry_arena.h"
+#include "render_core/image_pool.h"
 #include "render_core/rdres.hpp"
+#include "render_core/render_graph.h"
 #include "editor/types.hpp"
 
 namespace rdc {
@@ -15,46 +23,120 @@ namespace rdc {
 };
 
 class Layer2dResource : public IRenderResource, public NoCopyable {
-  // friend class ModelRenderer;
+  // visibility and opacity are set through the model renderer, which keeps
+  // its draw list in step
+  friend class ModelRenderer;
 
-  VkImage _image = VK_NULL_HANDLE;
-  VmaAllocation _allocation = VK_NULL_HANDLE;
-  VkImageView _image_view = VK_NULL_HANDLE;
+  // goes back to the driver's image pool on destruction
+  ImagePool::Image _image;
   Layer2dResource() = default;
-  struct Buffer {
-    VkBuffer _buffer = VK_NULL_HANDLE;
-    VmaAllocation _allocation = VK_NULL_HANDLE;
-  };
-  Buffer _vertex_buffer;
-  Buffer _index_buffer;
+  // sub-range of the driver's geometry arena
+  GeometryAllocation _geometry;
   std::vector<ModelVertex> _vertices;
   std::vector<uint32_t> _indices;
-  int _dirty_flag = 0;  // 1: dirt, 2: need recreate, 0: clean
+  // [begin, end) vertex ranges changed since the last refresh, sorted and
+  // disjoint
+  std::vector<std::pair<uint32_t, uint32_t>> _dirty_vertex_ranges;
+  bool _indices_dirty = false;
+  VkExtent2D _extent = {0, 0};
+  uint32_t _mip_levels = 1;
+  // mip 0 is uploaded, the rest of the chain is still to be blitted
+  bool _mips_pending = false;
+  bool _visible = true;
+  float _opacity = 1.0f;
+  // where the model renderer keeps this layer, valid while _list_generation
+  // matches the renderer's
+  std::list<Layer2dResource *>::iterator _list_position;
+  uint64_t _list_generation = 0;
+  // grows along the layer list, orders the drawn set
+  uint64_t _draw_order = 0;
+
+  void MarkVerticesDirty(uint32_t first, uint32_t count);
 
  public:
   struct ImageConfig {
     CPUImage *pimage = nullptr;
     VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
-    std::span<ModelVertex> vertices;
-    std::span<uint32_t> indices;
+    std::span<const ModelVertex> vertices;
+    std::span<const uint32_t> indices;
+    // 0 builds the full chain down to 1x1
+    uint32_t mip_levels = 0;
   };
   static std::unique_ptr<Layer2dResource> CreateFromImage(
       const ImageConfig &config);
-  VkBuffer GetVertexBuffer() const { return _vertex_buffer._buffer; }
-  VkBuffer GetIndexBuffer() const { return _index_buffer._buffer; }
-  VkImage GetImage() const { return _image; }
-  VkImageView GetImageView() const { return _image_view; }
+  VkImage GetImage() const { return _image.image; }
+  VkImageView GetImageView() const { return _image.view; }
+  uint32_t GetMipLevels() const { return _mip_levels; }
+  // device memory of the image with its whole mip chain
+  VkDeviceSize GetImageBytes() const;
+  // the mesh's share of the geometry arena
+  VkDeviceSize GetBufferBytes() const {
+    return _geometry.vertex_size + _geometry.index_size;
+  }
+  bool HasPendingMips() const { return _mips_pending; }
+  bool IsVisible() const { return _visible; }
+  float GetOpacity() const { return _opacity; }
+  // hidden and fully transparent layers are left out of the draws
+  bool IsDrawn() const { return _visible && _opacity > 0.0f; }
+  // downsample mip 0 into the rest of the chain and leave every level in
+  // shader read only layout. must be recorded outside of rendering
+  void RecordMipGeneration(VkCommandBuffer command_buffer);
   uint32_t GetIndexCount() const { return _indices.size(); }
-  void SetVertex(std::span<ModelVertex> vertices, std::span<uint32_t> indices);
-  bool IsBufferDirty() const { return _dirty_flag != 0; }
+  uint32_t GetFirstIndex() const {
+    return static_cast<uint32_t>(_geometry.index_offset / sizeof(uint32_t));
+  }
+  int32_t GetVertexOffset() const {
+    return static_cast<int32_t>(_geometry.vertex_offset / sizeof(ModelVertex));
+  }
+  // diffs against the current mesh, only what changed is uploaded
+  void SetVertex(std::span<const ModelVertex> vertices,
+                 std::span<const uint32_t> indices);
+  // overwrite vertices [first, first + vertices.size()), topology unchanged
+  void UpdateVertices(uint32_t first, std::span<const ModelVertex> vertices);
+  std::span<const ModelVertex> GetVertices() const { return _vertices; }
+  bool IsBufferDirty() const {
+    return !_dirty_vertex_ranges.empty() || _indices_dirty;
+  }
   void RefreshBuffer();
 
   ~Layer2dResource() override;
 };
 
 class ModelRenderer {
-  // render resources use to render layer
-  std::vector<Layer2dResource *> _render_layers;
+ public:
+  struct RenderTarget {
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkExtent2D extent = {0, 0};
+    VkFormat format = VK_FORMAT_UNDEFINED;
+  };
+  enum class DrawMode : uint8_t {
+    // one descriptor push and one draw per layer
+    kPerLayer,
+    // all textures in one descriptor array, one indirect draw for the model
+    kBindlessIndirect,
+  };
+
+ private:
+  struct DrawOrderLess {
+    bool operator()(const Layer2dResource *a, const Layer2dResource *b) const {
+      return a->_draw_order < b->_draw_order;
+    }
+  };
+  // render resources use to render layer, each knows its own position so
+  // insert and remove cost O(1)
+  std::list<Layer2dResource *> _render_layers;
+  // the drawn layers of _render_layers in the same order, O(log n) to change
+  std::set<Layer2dResource *, DrawOrderLess> _drawn_layers;
+  // _drawn_layers flattened for the indexed draws, refreshed by PrepareRender
+  // when _layers_version moved
+  std::vector<Layer2dResource *> _draw_layers;
+  uint64_t _draw_layers_version = 0;
+  // bumped by ClearLayers, which thereby unlists every layer without
+  // touching them, they may already be gone
+  uint64_t _list_generation = 1;
+  // bumped whenever the draw list changes
+  uint64_t _layers_version = 0;
   VkDescriptorSetLayout _descriptor_set_layout = VK_NULL_HANDLE;
   VkPipelineLayout _pipeline_layout = VK_NULL_HANDLE;
   VkSampler _sampler = VK_NULL_HANDLE;
@@ -69,15 +151,52 @@ class ModelRenderer {
   };
   Shader _vertex_shader;
   Shader _fragment_shader;
-  struct {
-    VkBuffer buffer = VK_NULL_HANDLE;
-    VmaAllocation allocation = VK_NULL_HANDLE;
-    void Destroy(const VmaAllocator &allocator) {
-      vmaDestroyBuffer(allocator, buffer, allocation);
-    }
-  } _ubo_buffer;
+  // this frame's ubo in the driver's frame ring
+  FrameAllocation _ubo_allocation;
+
+  DrawMode _draw_mode = DrawMode::kPerLayer;
+  float _record_cpu_ms = 0.0f;
+  // per frame in flight, only touched after that frame's fence has signaled
+  struct BindlessFrame {
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    FrameAllocation indirect_commands;
+    uint64_t layers_version = UINT64_MAX;
+  };
+  VkDescriptorSetLayout _bindless_set_layout = VK_NULL_HANDLE;
+  VkPipelineLayout _bindless_pipeline_layout = VK_NULL_HANDLE;
+  VkDescriptorPool _bindless_descriptor_pool = VK_NULL_HANDLE;
+  Shader _bindless_vertex_shader;
+  Shader _bindless_fragment_shader;
+  std::vector<BindlessFrame> _bindless_frames;
+  // texture array size and indirect draw count limit
+  uint32_t _max_bindless_layers = 0;
+
+  // a secondary command buffer recording one chunk of the per layer draws.
+  // each chunk has its own pool, so whichever thread records it needs no
+  // lock
+  struct RecordChunk {
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  };
+  // per frame in flight, reset once that frame's fence has signaled
+  std::vector<std::vector<RecordChunk>> _record_chunks;
+  bool _parallel_recording = true;
+  uint32_t _record_chunk_count = 0;
+
+  RenderTarget _render_target;
+  VkClearColorValue _clear_color = {.float32 = {0.8f, 0.8f, 0.8f, 1.0f}};
 
-  VkImageView _render_target_view = VK_NULL_HANDLE;
+  // offscreen copy of the last drawn canvas, copied into the swapchain image
+  // on frames where nothing that affects the layers changed
+  struct CanvasTarget {
+    VkImage image = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkExtent2D extent = {0, 0};
+    VkFormat format = VK_FORMAT_UNDEFINED;
+  } _canvas;
+  bool _canvas_dirty = true;
+  bool _canvas_cache_enabled = false;
 
   struct Region {
     int x;
@@ -93,14 +212,68 @@ class ModelRenderer {
   uint32_t _canvas_height = 600;
 
   void UpdateUniform();
+  // give layer, just put into _render_layers, a draw order between its
+  // neighbours, renumbering the whole list when they leave no room
+  void AssignDrawOrder(Layer2dResource *layer);
+  bool IsListed(const Layer2dResource *layer) const {
+    return layer->_list_generation == _list_generation;
+  }
+  // add or drop layer from the draw list after its visibility or opacity
+  // changed
+  void UpdateDrawLayer(Layer2dResource *layer, bool was_drawn);
+  void EnsureCanvasTarget();
+  void DestroyCanvasTarget();
+  void CreateBindlessResources();
+  void DestroyBindlessResources();
+  bool IsBindlessActive() const;
+  void UpdateBindlessFrame();
+  void DestroyRecordChunks();
+  // how many chunks the per layer draws of this frame are split into, 1
+  // records them inline
+  uint32_t ChooseRecordChunkCount() const;
   // cmd
+  // dynamic state, vertex input and geometry buffers of the canvas pass,
+  // secondary command buffers inherit none of it
+  void SetCanvasState(VkCommandBuffer command_buffer) const;
+  void BindPerLayerShaders(VkCommandBuffer command_buffer) const;
   void BindLayerDrawCommand(VkCommandBuffer command_buffer,
                             uint32_t index) const;
+  void RecordPerLayerDraws(VkCommandBuffer command_buffer) const;
+  // record the layers split into chunk_count secondary command buffers on
+  // the thread pool and execute them in layer order
+  void RecordParallelDraws(VkCommandBuffer command_buffer, VkFormat format,
+                           uint32_t chunk_count);
+  void RecordBindlessDraws(VkCommandBuffer command_buffer) const;
+  // clear view and draw every layer into it, at most once per frame
+  void RecordCanvasPass(VkCommandBuffer command_buffer, VkImageView view,
+                        VkFormat format);
+  // copy the cached canvas into target, both already in transfer layouts
+  void RecordCanvasComposite(VkCommandBuffer command_buffer,
+                             VkImage target) const;
 
  public:
   ModelRenderer();
   void AddLayer(Layer2dResource *layer);
-  std::span<Layer2dResource *> GetLayers() { return _render_layers; }
+  // draws layer right before before, or last when before is not added
+  void InsertLayer(Layer2dResource *layer, Layer2dResource *before);
+  // stops drawing layer, the caller keeps it alive until the frames that
+  // drew it have finished, e.g. with RenderResourceManager::ReleaseResource
+  void RemoveLayer(Layer2dResource *layer);
+  // the resources stay owned by the caller, keep them alive until the frames
+  // that drew them have finished. they are not touched here
+  void ClearLayers();
+  const std::list<Layer2dResource *> &GetLayers() const {
+    return _render_layers;
+  }
+  // hidden layers stay in the layer list but cost no descriptor push and no
+  // draw. may be set before the layer is added
+  void SetLayerVisible(Layer2dResource *layer, bool visible);
+  // in [0, 1], scales the premultiplied color. 0 skips the layer like hiding
+  void SetLayerOpacity(Layer2dResource *layer, float opacity);
+  // layers that are actually drawn
+  uint32_t GetDrawnLayerCount() const {
+    return static_cast<uint32_t>(_drawn_layers.size());
+  }
   ~ModelRenderer();
 
   void SetRegion(int pos_x, int pos_y, uint32_t width, uint32_t height);
@@ -109,11 +282,41 @@ class ModelRenderer {
   void SetCanvasOffset(float x, float y) {
     _canvas_offset.x = x;
     _canvas_offset.y = y;
+    _canvas_dirty = true;
   }
 
-  void SetTargetView(VkImageView view) { _render_target_view = view; }
+  // view and format of the graph image passed to AddPasses
+  void SetTarget(const RenderTarget &target) { _render_target = target; }
+  void SetClearColor(const VkClearColorValue &color) {
+    _clear_color = color;
+    _canvas_dirty = true;
+  }
+  // falls back to per layer draws when the device lacks bindless support
+  void SetDrawMode(DrawMode mode) {
+    _canvas_dirty |= mode != _draw_mode;
+    _draw_mode = mode;
+  }
+  DrawMode GetDrawMode() const { return _draw_mode; }
+  bool IsBindlessSupported() const { return _max_bindless_layers > 0; }
+  // cpu time spent recording the last frame's model draws
+  float GetRecordCpuTime() const { return _record_cpu_ms; }
+  // split large per layer draw lists over the thread pool
+  void SetParallelRecording(bool enabled) { _parallel_recording = enabled; }
+  bool IsParallelRecording() const { return _parallel_recording; }
+  // secondary command buffers used by the last recorded canvas pass, 0 when
+  // it was recorded inline
+  uint32_t GetRecordChunkCount() const { return _record_chunk_count; }
+  // redraw the layers next frame instead of reusing the cached canvas
+  void MarkCanvasDirty() { _canvas_dirty = true; }
+  bool IsCanvasDirty() const { return _canvas_dirty; }
+  // draw into an offscreen canvas and copy it to the target, the layers are
+  // only redrawn when something changed. the target needs transfer dst usage
+  void SetCanvasCacheEnabled(bool enabled) { _canvas_cache_enabled = enabled; }
+  bool IsCanvasCacheEnabled() const { return _canvas_cache_enabled; }
   void PrepareRender();
-  void RecordCommandBuffer(VkCommandBuffer command_buffer);
+  // mip generation, the canvas pass and the composite into target, which
+  // holds the canvas once they ran. target is fully overwritten
+  void AddPasses(RenderGraph &graph, RenderGraphImage target);
 };
 }
 
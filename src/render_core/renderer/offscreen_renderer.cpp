@@ -0,0 +1,300 @@
+#include "offscreen_renderer.h"
+
+#include "render_core/geometry_arena.h"
+#include "render_core/upload_batcher.h"
+#include "render_core/vulkan_driver.h"
+
+namespace rdc {
+OffscreenRenderer::OffscreenRenderer() {
+  auto *driver = VulkanDriver::GetSingleton();
+  _model_renderer = std::make_unique<ModelRenderer>();
+  // every frame draws something new, a cached canvas would only add a copy
+  _model_renderer->SetCanvasCacheEnabled(false);
+  _model_renderer->SetClearColor({.float32 = {0.0f, 0.0f, 0.0f, 0.0f}});
+  // only imports, no transient pool needed
+  _render_graph = std::make_unique<RenderGraph>();
+
+  _slots.resize(driver->GetFramesInFlight());
+  std::vector<VkCommandBuffer> command_buffers(_slots.size());
+  VkCommandBufferAllocateInfo const alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .pNext = nullptr,
+      .commandPool = driver->GetCommandPool(),
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = static_cast<uint32_t>(command_buffers.size()),
+  };
+  AssertVkResult(vkAllocateCommandBuffers(driver->GetDevice(), &alloc_info,
+                                          command_buffers.data()),
+                 "Failed to allocate command buffer");
+  VkFenceCreateInfo constexpr fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+  };
+  for (size_t i = 0; i < _slots.size(); ++i) {
+    _slots[i].command_buffer = command_buffers[i];
+    AssertVkResult(vkCreateFence(driver->GetDevice(), &fence_info, nullptr,
+                                 &_slots[i].fence),
+                   "Failed to create offscreen fence");
+  }
+}
+
+OffscreenRenderer::~OffscreenRenderer() {
+  auto *driver = VulkanDriver::GetSingleton();
+  // layers may be shared with the caller and freed by the callbacks Finish
+  // runs, drop the references first
+  _model_renderer->ClearLayers();
+  Finish();
+  _model_renderer.reset();
+  for (auto &slot : _slots) {
+    DestroySlotTarget(slot);
+    vkDestroyFence(driver->GetDevice(), slot.fence, nullptr);
+    vkFreeCommandBuffers(driver->GetDevice(), driver->GetCommandPool(), 1,
+                         &slot.command_buffer);
+  }
+}
+
+void OffscreenRenderer::EnsureSlotTarget(Slot &slot, uint32_t width,
+                                         uint32_t height) {
+  if (slot.image != VK_NULL_HANDLE && slot.extent.width == width &&
+      slot.extent.height == height) {
+    return;
+  }
+  // the slot's fence has signaled, nothing uses the old target anymore
+  DestroySlotTarget(slot);
+  auto *driver = VulkanDriver::GetSingleton();
+  slot.extent = {width, height};
+
+  VmaAllocationCreateInfo const image_alloc_info = {
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+  };
+  VkImageCreateInfo const image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = kTargetFormat,
+      .extent = {.width = width, .height = height, .depth = 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+               VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  AssertVkResult(
+      vmaCreateImage(driver->GetVmaAllocator(), &image_info, &image_alloc_info,
+                     &slot.image, &slot.image_allocation, nullptr),
+      "Failed to create offscreen image");
+  VkImageViewCreateInfo const image_view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .image = slot.image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = kTargetFormat,
+      .components =
+          {
+              .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+              .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+          },
+      .subresourceRange =
+          {
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .baseMipLevel = 0,
+              .levelCount = 1,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+          },
+  };
+  AssertVkResult(vkCreateImageView(driver->GetDevice(), &image_view_info,
+                                   nullptr, &slot.image_view),
+                 "Failed to create offscreen image view");
+
+  VmaAllocationCreateInfo const readback_alloc_info = {
+      .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .usage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+  };
+  VkBufferCreateInfo const buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .size = VkDeviceSize{width} * height * 4,
+      .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  VmaAllocationInfo allocation_info;
+  AssertVkResult(vmaCreateBuffer(driver->GetVmaAllocator(), &buffer_info,
+                                 &readback_alloc_info, &slot.readback_buffer,
+                                 &slot.readback_allocation, &allocation_info),
+                 "Failed to create readback buffer");
+  slot.readback_data = allocation_info.pMappedData;
+}
+
+void OffscreenRenderer::DestroySlotTarget(Slot &slot) {
+  if (slot.image == VK_NULL_HANDLE) {
+    return;
+  }
+  auto *driver = VulkanDriver::GetSingleton();
+  vkDestroyImageView(driver->GetDevice(), slot.image_view, nullptr);
+  vmaDestroyImage(driver->GetVmaAllocator(), slot.image,
+                  slot.image_allocation);
+  vmaDestroyBuffer(driver->GetVmaAllocator(), slot.readback_buffer,
+                   slot.readback_allocation);
+  slot.image = VK_NULL_HANDLE;
+  slot.image_view = VK_NULL_HANDLE;
+  slot.readback_buffer = VK_NULL_HANDLE;
+  slot.readback_data = nullptr;
+  slot.extent = {0, 0};
+}
+
+void OffscreenRenderer::Drain(Slot &slot) {
+  auto *driver = VulkanDriver::GetSingleton();
+  AssertVkResult(vkWaitForFences(driver->GetDevice(), 1, &slot.fence, VK_TRUE,
+                                 UINT64_MAX),
+                 "Failed to wait for offscreen frame");
+  if (!slot.on_ready) {
+    return;
+  }
+  // readback memory may be non coherent
+  AssertVkResult(vmaInvalidateAllocation(driver->GetVmaAllocator(),
+                                         slot.readback_allocation, 0,
+                                         VK_WHOLE_SIZE),
+                 "Failed to invalidate readback memory");
+  auto on_ready = std::move(slot.on_ready);
+  slot.on_ready = nullptr;
+  on_ready({
+      .width = slot.extent.width,
+      .height = slot.extent.height,
+      .pixels = static_cast<const uint8_t *>(slot.readback_data),
+  });
+}
+
+void OffscreenRenderer::Render(uint32_t width, uint32_t height,
+                               ReadbackCallback on_ready) {
+  auto *driver = VulkanDriver::GetSingleton();
+  auto &slot = _slots[driver->GetCurrentFrameIndex()];
+  Drain(slot);
+  driver->BeginFrame();
+  vkResetFences(driver->GetDevice(), 1, &slot.fence);
+
+  EnsureSlotTarget(slot, width, height);
+  _model_renderer->SetRegion(0, 0, width, height);
+  _model_renderer->SetTarget({
+      .image = slot.image,
+      .view = slot.image_view,
+      .extent = slot.extent,
+      .format = kTargetFormat,
+  });
+  _model_renderer->PrepareRender();
+
+  auto *command_buffer = slot.command_buffer;
+  constexpr VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .pNext = nullptr,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  vkResetCommandBuffer(command_buffer, 0);
+  AssertVkResult(vkBeginCommandBuffer(command_buffer, &begin_info),
+                 "Failed to begin command buffer");
+  auto &graph = *_render_graph;
+  graph.Reset();
+  // the slot's last frame finished with its fence
+  auto const target = graph.ImportImage(
+      "offscreen target", slot.image, slot.image_view, kTargetFormat,
+      slot.extent,
+      {.layout = VK_IMAGE_LAYOUT_UNDEFINED,
+       .stages = VK_PIPELINE_STAGE_TRANSFER_BIT,
+       .access = 0},
+      VK_IMAGE_LAYOUT_UNDEFINED);
+  auto const readback = graph.ImportBuffer(
+      "readback", slot.readback_buffer,
+      {.layout = VK_IMAGE_LAYOUT_UNDEFINED,
+       .stages = VK_PIPELINE_STAGE_HOST_BIT,
+       .access = 0},
+      BufferUsage::kHostRead);
+  graph.AddPass(
+      "geometry copies",
+      [](RenderGraph::PassBuilder &pass) { pass.SetSideEffects(); },
+      [driver](VkCommandBuffer cmd) {
+        driver->GetGeometryArena()->RecordPendingCopies(cmd);
+      });
+  _model_renderer->AddPasses(graph, target);
+  // copy the target into host memory
+  graph.AddPass(
+      "readback",
+      [target, readback](RenderGraph::PassBuilder &pass) {
+        pass.Read(target, ImageUsage::kTransferSrc);
+        pass.Write(readback, BufferUsage::kTransferDst, true);
+      },
+      [&slot, width, height](VkCommandBuffer cmd) {
+        VkBufferImageCopy const region = {
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource =
+                {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {width, height, 1},
+        };
+        vkCmdCopyImageToBuffer(cmd, slot.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               slot.readback_buffer, 1, &region);
+      });
+  graph.Compile();
+  graph.Execute(command_buffer, nullptr);
+  vkEndCommandBuffer(command_buffer);
+
+  // sampling and mip generation wait for the layer uploads
+  auto *upload_batcher = driver->GetUploadBatcher();
+  uint64_t const upload_value = upload_batcher->Flush();
+  upload_batcher->Collect();
+  VkSemaphore const wait_semaphore = upload_batcher->GetTimelineSemaphore();
+  VkPipelineStageFlags const wait_stage =
+      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  VkTimelineSemaphoreSubmitInfoKHR const timeline_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+      .pNext = nullptr,
+      .waitSemaphoreValueCount = 1,
+      .pWaitSemaphoreValues = &upload_value,
+      .signalSemaphoreValueCount = 0,
+      .pSignalSemaphoreValues = nullptr,
+  };
+  VkSubmitInfo const submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &timeline_info,
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = &wait_semaphore,
+      .pWaitDstStageMask = &wait_stage,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &command_buffer,
+      .signalSemaphoreCount = 0,
+      .pSignalSemaphores = nullptr,
+  };
+  AssertVkResult(driver->QueueSubmit(driver->GetGraphicsQueue(), 1,
+                                     &submit_info, slot.fence),
+                 "Failed to submit offscreen frame");
+  slot.on_ready = std::move(on_ready);
+  driver->AdvanceFrame();
+}
+
+void OffscreenRenderer::Finish() {
+  auto *driver = VulkanDriver::GetSingleton();
+  // the current slot holds the oldest frame
+  for (size_t i = 0; i < _slots.size(); ++i) {
+    Drain(_slots[(driver->GetCurrentFrameIndex() + i) % _slots.size()]);
+  }
+}
+
+}  // namespace rdc
@@ -0,0 +1,72 @@
+#ifndef RENDER_CORE_RENDERER_OFFSCREEN_RENDERER_H_
+#define RENDER_CORE_RENDERER_OFFSCREEN_RENDERER_H_
+
+#include <vk_mem_alloc.h>
+#include <volk.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "model_renderer.h"
+#include "render_core/render_graph.h"
+#include "tools.hpp"
+
+namespace rdc {
+
+// renders the model without a window and reads the pixels back. one slot
+// per frame in flight, a slot's pixels are handed out right before the slot
+// is reused, so readback of one frame overlaps rendering of the next
+class OffscreenRenderer : public NoCopyable {
+ public:
+  struct Readback {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // tightly packed rgba8 with premultiplied alpha, valid during the call
+    const uint8_t *pixels = nullptr;
+  };
+  // also owns whatever must outlive the frame, e.g. the drawn layers
+  using ReadbackCallback = std::function<void(const Readback &readback)>;
+
+ private:
+  static constexpr VkFormat kTargetFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+  struct Slot {
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkImage image = VK_NULL_HANDLE;
+    VmaAllocation image_allocation = VK_NULL_HANDLE;
+    VkImageView image_view = VK_NULL_HANDLE;
+    VkExtent2D extent = {0, 0};
+    VkBuffer readback_buffer = VK_NULL_HANDLE;
+    VmaAllocation readback_allocation = VK_NULL_HANDLE;
+    void *readback_data = nullptr;
+    // set while a submitted frame has not been handed out
+    ReadbackCallback on_ready;
+  };
+  std::unique_ptr<ModelRenderer> _model_renderer;
+  std::unique_ptr<RenderGraph> _render_graph;
+  std::vector<Slot> _slots;
+
+  void EnsureSlotTarget(Slot &slot, uint32_t width, uint32_t height);
+  void DestroySlotTarget(Slot &slot);
+  // waits for the slot's frame and hands its pixels out
+  void Drain(Slot &slot);
+
+ public:
+  OffscreenRenderer();
+  ~OffscreenRenderer() override;
+
+  // layers and canvas size are set on it before every Render
+  ModelRenderer *GetModelRenderer() const { return _model_renderer.get(); }
+  // draw the model renderer's layers into a width x height image, on_ready
+  // runs once the pixels are on the cpu, from a later Render or Finish
+  void Render(uint32_t width, uint32_t height, ReadbackCallback on_ready);
+  // wait for every frame in flight and hand out their pixels in order
+  void Finish();
+};
+
+}  // namespace rdc
+
+#endif  // RENDER_CORE_RENDERER_OFFSCREEN_RENDERER_H_
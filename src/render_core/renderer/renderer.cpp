@@ -3,24 +3,33 @@
 #include <vector>
 
 #include "vulkan/vulkan_core.h"
+#include "render_core/geometry_arena.h"
+#include "render_core/gpu_profiler.h"
+#include "render_core/upload_batcher.h"
 #include "render_core/vulkan_driver.h"
+#include "trace.hpp"
 
 namespace rdc {
 ApplicationRenderer::ApplicationRenderer() {
   _model_renderer = std::make_unique<ModelRenderer>();
   _ui_renderer = std::make_unique<UiRenderer>();
   auto *driver = VulkanDriver::GetSingleton();
+  _frames.resize(driver->GetFramesInFlight());
   {
+    std::vector<VkCommandBuffer> command_buffers(_frames.size());
     VkCommandBufferAllocateInfo const alloc_info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .pNext = nullptr,
         .commandPool = driver->GetCommandPool(),
         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1,
+        .commandBufferCount = static_cast<uint32_t>(command_buffers.size()),
     };
     AssertVkResult(vkAllocateCommandBuffers(driver->GetDevice(), &alloc_info,
-                                            &_app_command_buffer),
+                                            command_buffers.data()),
                    "Failed to allocate command buffer");
+    for (size_t i = 0; i < _frames.size(); ++i) {
+      _frames[i].command_buffer = command_buffers[i];
+    }
   }
   {
     VkSemaphoreCreateInfo constexpr semaphore_info = {
@@ -28,124 +37,238 @@ ApplicationRenderer::ApplicationRenderer() {
         .pNext = nullptr,
         .flags = 0,
     };
-    AssertVkResult(
-        vkCreateSemaphore(driver->GetDevice(), &semaphore_info, nullptr,
-                          &_swapchain_image_available_semaphore),
-        "Failed to create swapchain image available semaphore");
-    AssertVkResult(vkCreateSemaphore(driver->GetDevice(), &semaphore_info,
-                                     nullptr, &_graphics_finished_semaphore),
-                   "Failed to create graphics finished semaphore");
+    // signaled so the first wait on every frame returns immediately
+    VkFenceCreateInfo constexpr fence_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+    };
+    for (auto &frame : _frames) {
+      AssertVkResult(
+          vkCreateSemaphore(driver->GetDevice(), &semaphore_info, nullptr,
+                            &frame.image_available_semaphore),
+          "Failed to create swapchain image available semaphore");
+      AssertVkResult(vkCreateFence(driver->GetDevice(), &fence_info, nullptr,
+                                   &frame.in_flight_fence),
+                     "Failed to create frame fence");
+    }
+    CreatePresentSemaphores();
   }
   {
-    _app_resource_manager = std::make_unique<RenderResourceManager>();
+    _app_resource_manager =
+        std::make_unique<RenderResourceManager>(driver->GetFramesInFlight());
+    _transient_pool =
+        std::make_unique<TransientImagePool>(driver->GetFramesInFlight());
+    _render_graph = std::make_unique<RenderGraph>(_transient_pool.get());
   }
 }
 ApplicationRenderer::~ApplicationRenderer() {
   auto* driver = VulkanDriver::GetSingleton();
   vkDeviceWaitIdle(driver->GetDevice());
-  vkDestroySemaphore(driver->GetDevice(), _swapchain_image_available_semaphore,
-                     nullptr);
-  vkDestroySemaphore(driver->GetDevice(), _graphics_finished_semaphore,
-                     nullptr);
-  vkFreeCommandBuffers(driver->GetDevice(), driver->GetCommandPool(), 1,
-                       &_app_command_buffer);
+  for (auto &frame : _frames) {
+    vkDestroySemaphore(driver->GetDevice(), frame.image_available_semaphore,
+                       nullptr);
+    vkDestroyFence(driver->GetDevice(), frame.in_flight_fence, nullptr);
+    vkFreeCommandBuffers(driver->GetDevice(), driver->GetCommandPool(), 1,
+                         &frame.command_buffer);
+  }
+  DestroyPresentSemaphores();
+}
+void ApplicationRenderer::CreatePresentSemaphores() {
+  auto *driver = VulkanDriver::GetSingleton();
+  DestroyPresentSemaphores();
+  VkSemaphoreCreateInfo constexpr semaphore_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+  };
+  _render_finished_semaphores.resize(driver->GetSwapchainImages().size());
+  for (auto &semaphore : _render_finished_semaphores) {
+    AssertVkResult(vkCreateSemaphore(driver->GetDevice(), &semaphore_info,
+                                     nullptr, &semaphore),
+                   "Failed to create graphics finished semaphore");
+  }
+}
+void ApplicationRenderer::DestroyPresentSemaphores() {
+  auto *driver = VulkanDriver::GetSingleton();
+  for (auto *semaphore : _render_finished_semaphores) {
+    vkDestroySemaphore(driver->GetDevice(), semaphore, nullptr);
+  }
+  _render_finished_semaphores.clear();
 }
 void ApplicationRenderer::SetWindowSize(int width, int height) {
+  if (width != _window_width || height != _window_height) {
+    VulkanDriver::GetSingleton()->MarkSwapchainInvalid();
+  }
   _window_height = height;
   _window_width = width;
 }
-void ApplicationRenderer::Render() {
+void ApplicationRenderer::CloseDocument() {
+  for (auto *layer : _model_renderer->GetLayers()) {
+    _app_resource_manager->ReleaseResource(layer->GetHandle());
+  }
+  _model_renderer->ClearLayers();
+}
+void ApplicationRenderer::Render(ImDrawData *ui_draw_data) {
+  WAIFU_TRACE_SCOPE("ApplicationRenderer::Render");
   auto *driver = VulkanDriver::GetSingleton();
   if (!driver->IsSwapchainValid()) {
     driver->RecreateSwapchain({static_cast<uint32_t>(_window_width),
                                static_cast<uint32_t>(_window_height)});
+    // the device is idle and the old swapchain gone, nothing waits on them
+    CreatePresentSemaphores();
   }
-  vkQueueWaitIdle(driver->GetGraphicsQueue());
+  // only wait for the frame that last used these resources, the other
+  // frames in flight keep the gpu busy while we record
+  auto &frame = _frames[driver->GetCurrentFrameIndex()];
+  AssertVkResult(vkWaitForFences(driver->GetDevice(), 1,
+                                 &frame.in_flight_fence, VK_TRUE, UINT64_MAX),
+                 "Failed to wait for frame fence");
+  // the frame that last used this slot is done, recycle what it used
+  driver->BeginFrame();
+  _app_resource_manager->BeginFrame(driver->GetFrameNumber());
+  _transient_pool->BeginFrame(driver->GetFrameNumber());
 
   // acquire image
   uint32_t index = 0;
   auto acquire_result = driver->AcquireSwapchainNextImage(
-      _swapchain_image_available_semaphore, VK_NULL_HANDLE, index);
-  if (acquire_result != VK_SUCCESS) {
-    if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR ||
-        acquire_result == VK_SUBOPTIMAL_KHR) {
-      driver->MarkSwapchainInvalid();
-      return;
-    }
+      frame.image_available_semaphore, VK_NULL_HANDLE, index);
+  if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
+    driver->MarkSwapchainInvalid();
+    return;
+  }
+  if (acquire_result != VK_SUBOPTIMAL_KHR) {
     AssertVkResult(acquire_result, "Failed to acquire swapchain image");
   }
+  // reset only once we know this frame will be submitted, otherwise the
+  // next wait on it would never return
+  vkResetFences(driver->GetDevice(), 1, &frame.in_flight_fence);
 
   auto *target_image = driver->GetSwapchainImages()[index];
   auto *target_image_view = driver->GetSwapchainImageViews()[index];
+  auto *command_buffer = frame.command_buffer;
+  auto *render_finished_semaphore = _render_finished_semaphores[index];
 
   constexpr VkCommandBufferBeginInfo begin_info = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
       .pNext = nullptr,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
   };
 
   // prepare
+  _model_renderer->SetCanvasCacheEnabled(
+      driver->SwapchainSupportsTransferDst());
+  _model_renderer->SetTarget({
+      .image = target_image,
+      .view = target_image_view,
+      .extent = driver->GetSwapchainExtent(),
+      .format = driver->GetSwapchainFormat(),
+  });
   _model_renderer->PrepareRender();
 
-  vkResetCommandBuffer(_app_command_buffer, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-  AssertVkResult(vkBeginCommandBuffer(_app_command_buffer, &begin_info),
+  vkResetCommandBuffer(command_buffer, 0);
+  AssertVkResult(vkBeginCommandBuffer(command_buffer, &begin_info),
                  "Failed to begin command buffer");
+  auto *profiler = driver->GetGpuProfiler();
+  profiler->BeginFrame(command_buffer, driver->GetCurrentFrameIndex(),
+                       driver->GetFrameNumber());
 
-  // model render
-  driver->HTransitionImageLayout(_app_command_buffer, target_image, 0,
-                                 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                 VK_IMAGE_LAYOUT_UNDEFINED,
-                                 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  auto &graph = *_render_graph;
+  graph.Reset();
+  // the acquire semaphore is waited on at these stages
+  auto const target = graph.ImportImage(
+      "swapchain", target_image, target_image_view,
+      driver->GetSwapchainFormat(), driver->GetSwapchainExtent(),
+      {.layout = VK_IMAGE_LAYOUT_UNDEFINED,
+       .stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+       .access = 0},
+      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  graph.AddPass(
+      "geometry copies",
+      [](RenderGraph::PassBuilder &pass) {
+        // the arena's buffers are not tracked, it keeps its own barriers
+        pass.SetSideEffects();
+      },
+      [driver](VkCommandBuffer cmd) {
+        driver->GetGeometryArena()->RecordPendingCopies(cmd);
+      });
+  _model_renderer->AddPasses(graph, target);
+  graph.AddPass(
+      "ui",
+      [target](RenderGraph::PassBuilder &pass) {
+        pass.Write(target, ImageUsage::kColorAttachment);
+      },
+      [this, &graph, target, ui_draw_data](VkCommandBuffer cmd) {
+        _ui_renderer->SetRenderTargetView(graph.GetImageView(target));
+        _ui_renderer->RecordUiCommandBuffer(cmd, ui_draw_data);
+      });
+  graph.Compile();
+  graph.Execute(command_buffer, profiler);
+  profiler->EndFrame();
 
-  _model_renderer->SetTargetView(target_image_view);
-  _model_renderer->RecordCommandBuffer(_app_command_buffer);
+  vkEndCommandBuffer(command_buffer);
 
-  _ui_renderer->SetRenderTargetView(target_image_view);
-  _ui_renderer->RecordUiCommandBuffer(_app_command_buffer);
-
-  driver->HTransitionImageLayout(_app_command_buffer, target_image,
-                                 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0,
-                                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                                 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                                 VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-  // end model render
-
-  vkEndCommandBuffer(_app_command_buffer);
+  // submit the uploads recorded this frame and make sampling and mip
+  // generation wait for them
+  auto *upload_batcher = driver->GetUploadBatcher();
+  uint64_t const upload_value = upload_batcher->Flush();
+  upload_batcher->Collect();
 
+  VkSemaphore const wait_semaphores[] = {
+      frame.image_available_semaphore,
+      upload_batcher->GetTimelineSemaphore(),
+  };
+  // binary semaphores ignore their value
+  uint64_t const wait_values[] = {0, upload_value};
+  // the cached canvas is copied into the swapchain image
   VkPipelineStageFlags const pipeline_stages[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT |
+          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+  };
+  VkTimelineSemaphoreSubmitInfoKHR const timeline_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+      .pNext = nullptr,
+      .waitSemaphoreValueCount = 2,
+      .pWaitSemaphoreValues = wait_values,
+      .signalSemaphoreValueCount = 0,
+      .pSignalSemaphoreValues = nullptr,
   };
   VkSubmitInfo const submit_info = {
       .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-      .pNext = nullptr,
-      .waitSemaphoreCount = 1,
-      .pWaitSemaphores = &_swapchain_image_available_semaphore,
+      .pNext = &timeline_info,
+      .waitSemaphoreCount = 2,
+      .pWaitSemaphores = wait_semaphores,
       .pWaitDstStageMask = pipeline_stages,
       .commandBufferCount = 1,
-      .pCommandBuffers = &_app_command_buffer,
+      .pCommandBuffers = &command_buffer,
       .signalSemaphoreCount = 1,
-      .pSignalSemaphores = &_graphics_finished_semaphore,
+      .pSignalSemaphores = &render_finished_semaphore,
   };
-  vkQueueSubmit(driver->GetGraphicsQueue(), 1, &submit_info, VK_NULL_HANDLE);
+  AssertVkResult(driver->QueueSubmit(driver->GetGraphicsQueue(), 1,
+                                     &submit_info, frame.in_flight_fence),
+                 "Failed to submit frame");
 
   VkPresentInfoKHR const present_info = {
       .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
       .pNext = nullptr,
       .waitSemaphoreCount = 1,
-      .pWaitSemaphores = &_graphics_finished_semaphore,
+      .pWaitSemaphores = &render_finished_semaphore,
       .swapchainCount = 1,
       .pSwapchains = &driver->GetSwapchain(),
       .pImageIndices = &index,
       .pResults = nullptr,
   };
-  auto result = vkQueuePresentKHR(driver->GetPresentQueue(), &present_info);
-  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+  auto result = driver->QueuePresent(driver->GetPresentQueue(), present_info);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
+      acquire_result == VK_SUBOPTIMAL_KHR) {
     driver->MarkSwapchainInvalid();
   } else if (result != VK_SUCCESS) {
     AssertVkResult(result, "Failed to present swapchain image");
   }
+  driver->AdvanceFrame();
 }
 
-}  // namespace rdc
\ No newline at end of file
+}  // namespace rdc
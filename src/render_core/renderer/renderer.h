@@ -2,6 +2,7 @@
 #define RENDER_CORE_RENDERER_H_
 
 #include "model_renderer.h"
+#include "render_core/render_graph.h"
 #include "ui_renderer.h"
 namespace rdc {
 
@@ -11,22 +12,46 @@ class ApplicationRenderer {
   std::unique_ptr<ModelRenderer> _model_renderer;
   std::unique_ptr<UiRenderer> _ui_renderer;
 
-  VkCommandBuffer _app_command_buffer = VK_NULL_HANDLE;
-  VkSemaphore _swapchain_image_available_semaphore = VK_NULL_HANDLE;
-  VkSemaphore _graphics_finished_semaphore = VK_NULL_HANDLE;
+  // resources owned by one frame in flight, reused once its fence signals
+  struct FrameContext {
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    VkSemaphore image_available_semaphore = VK_NULL_HANDLE;
+    VkFence in_flight_fence = VK_NULL_HANDLE;
+  };
+  std::vector<FrameContext> _frames;
+  // waited on by the present of one swapchain image. indexed by image, not
+  // by frame, the presentation engine may still hold the one of an image
+  // while another frame in flight is submitted
+  std::vector<VkSemaphore> _render_finished_semaphores;
+
+  // one per swapchain image, the old ones are dropped
+  void CreatePresentSemaphores();
+  void DestroyPresentSemaphores();
 
   std::unique_ptr<RenderResourceManager> _app_resource_manager;
 
+  // rebuilt every frame, transient images outlive it in the pool
+  std::unique_ptr<TransientImagePool> _transient_pool;
+  std::unique_ptr<RenderGraph> _render_graph;
+
  public:
   ApplicationRenderer();
   ~ApplicationRenderer();
+  // a new size recreates the swapchain before the next frame
   void SetWindowSize(int width, int height);
-  void Render();
+  // ui_draw_data is drawn on top of the model, may be null
+  void Render(ImDrawData *ui_draw_data);
+  // drops every layer of the open document. frames in flight may still draw
+  // them, they are destroyed once those finished and their images go back to
+  // the driver's image pool for the next document
+  void CloseDocument();
   ModelRenderer *GetModelRenderer() const { return _model_renderer.get(); }
   UiRenderer *GetUiRenderer() const { return _ui_renderer.get(); }
   RenderResourceManager *GetResourceManager() const {
     return _app_resource_manager.get();
   }
+  // the graph of the last rendered frame
+  const RenderGraph *GetRenderGraph() const { return _render_graph.get(); }
 };
 
 }  // namespace rdc
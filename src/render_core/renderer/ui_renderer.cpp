@@ -2,6 +2,11 @@
 
 #include <imgui.h>
 #include <backends/imgui_impl_vulkan.h>
+
+#include <cstring>
+
+#include "render_core/shader_cache.h"
+#include "render_core/upload_batcher.h"
 #include "render_core/vulkan_driver.h"
 
 namespace rdc {
@@ -16,22 +21,12 @@ StaticUiResource::StaticUiResource(const std::string &res_name,
     VkDeviceSize const size = static_cast<int64_t>(
         cpu_image->width * cpu_image->height * cpu_image->channels);
 
-    VkBuffer staging_buffer;
-    VmaAllocation staging_allocation;
-    driver->HCreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                          VMA_MEMORY_USAGE_CPU_ONLY, staging_buffer,
-                          staging_allocation);
-    void *data;
-    vmaMapMemory(driver->GetVmaAllocator(), staging_allocation, &data);
-    memcpy(data, cpu_image->data, size);
-    vmaUnmapMemory(driver->GetVmaAllocator(), staging_allocation);
-
     // create vkimage
     VmaAllocationCreateInfo const alloc_info = {
         .usage = VMA_MEMORY_USAGE_GPU_ONLY,
         .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
     };
-    VkImageCreateInfo const image_info = {
+    VkImageCreateInfo image_info = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
         .pNext = nullptr,
         .flags = 0,
@@ -52,45 +47,14 @@ StaticUiResource::StaticUiResource(const std::string &res_name,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
     };
 
+    driver->HSetUploadSharingMode(image_info);
+
     AssertVkResult(vmaCreateImage(driver->GetVmaAllocator(), &image_info,
                                   &alloc_info, &_image, &_allocation, nullptr),
                    "Failed to create image");
+    driver->GetUploadBatcher()->UploadImage(_image, cpu_image->data, size,
+                                            image_info.extent);
 
-    VkCommandBuffer single_command_buffer =
-        driver->HBeginOneTimeCommandBuffer();
-
-    driver->HTransitionImageLayout(
-        single_command_buffer, _image, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    VkBufferImageCopy const copy_region = {
-        .bufferOffset = 0,
-        .bufferRowLength = 0,
-        .bufferImageHeight = 0,
-        .imageSubresource =
-            {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .mipLevel = 0,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
-            },
-        .imageExtent =
-            {
-                .width = cpu_image->width,
-                .height = cpu_image->height,
-                .depth = 1,
-            },
-    };
-    vkCmdCopyBufferToImage(single_command_buffer, staging_buffer, _image,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                           &copy_region);
-
-    driver->HTransitionImageLayout(
-        single_command_buffer, _image, VK_ACCESS_TRANSFER_WRITE_BIT,
-        VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     // create image view
     VkImageViewCreateInfo const image_view_info = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -127,9 +91,45 @@ StaticUiResource::~StaticUiResource() {
   vmaDestroyImage(driver->GetVmaAllocator(), _image, _allocation);
 }
 
-void UiRenderer::RecordUiCommandBuffer(VkCommandBuffer command_buffer) {
-  ImGui::Render();
-  auto *draw_data = ImGui::GetDrawData();
+namespace {
+// ImVector's copy frees and reallocates, this keeps the capacity
+template <typename T>
+void CopyImVector(ImVector<T> &dst, const ImVector<T> &src) {
+  dst.resize(src.Size);
+  if (src.Size > 0) {
+    std::memcpy(dst.Data, src.Data, src.size_in_bytes());
+  }
+}
+}  // namespace
+
+void UiDrawSnapshot::Capture(const ImDrawData *draw_data) {
+  _draw_data.Valid = draw_data->Valid;
+  _draw_data.CmdListsCount = draw_data->CmdListsCount;
+  _draw_data.TotalIdxCount = draw_data->TotalIdxCount;
+  _draw_data.TotalVtxCount = draw_data->TotalVtxCount;
+  _draw_data.DisplayPos = draw_data->DisplayPos;
+  _draw_data.DisplaySize = draw_data->DisplaySize;
+  _draw_data.FramebufferScale = draw_data->FramebufferScale;
+  // the backend keeps its per viewport buffers there
+  _draw_data.OwnerViewport = draw_data->OwnerViewport;
+  while (_draw_lists.size() < static_cast<size_t>(draw_data->CmdListsCount)) {
+    _draw_lists.push_back(
+        std::make_unique<ImDrawList>(ImGui::GetDrawListSharedData()));
+  }
+  _draw_data.CmdLists.resize(0);
+  for (int i = 0; i < draw_data->CmdListsCount; ++i) {
+    const auto *src = draw_data->CmdLists[i];
+    auto *dst = _draw_lists[i].get();
+    CopyImVector(dst->CmdBuffer, src->CmdBuffer);
+    CopyImVector(dst->IdxBuffer, src->IdxBuffer);
+    CopyImVector(dst->VtxBuffer, src->VtxBuffer);
+    dst->Flags = src->Flags;
+    _draw_data.CmdLists.push_back(dst);
+  }
+}
+
+void UiRenderer::RecordUiCommandBuffer(VkCommandBuffer command_buffer,
+                                       ImDrawData *draw_data) {
   if (draw_data == nullptr) {
     return;
   }
@@ -162,6 +162,11 @@ void UiRenderer::RecordUiCommandBuffer(VkCommandBuffer command_buffer) {
   }
   {
     ImGui_ImplVulkan_RenderDrawData(draw_data, command_buffer);
+    uint32_t draw_calls = 0;
+    for (int i = 0; i < draw_data->CmdListsCount; ++i) {
+      draw_calls += draw_data->CmdLists[i]->CmdBuffer.Size;
+    }
+    driver->CountDrawCalls(draw_calls);
   }
   {
     vkCmdEndRenderingKHR(command_buffer);
@@ -191,6 +196,7 @@ void UiRenderer::InitImGuiRender() {
   init_info.QueueFamily = driver->GetGraphicsQueueFamilyIndex();
   init_info.Queue = driver->GetGraphicsQueue();
   init_info.DescriptorPool = driver->GetDescriptorPool();
+  init_info.PipelineCache = driver->GetShaderCache()->GetPipelineCache();
   init_info.MinImageCount = driver->GetSurfaceCapabilities().minImageCount;
   init_info.ImageCount = driver->GetSwapchainImages().size();
   init_info.CheckVkResultFn = [](VkResult err) { AssertVkResult(err); };
@@ -208,6 +214,9 @@ void UiRenderer::InitImGuiRender() {
 
   // only build font after build vulkan
   ImGui::GetIO().Fonts->Build();
+  // upload the font atlas now, the backend would otherwise submit it from
+  // the first NewFrame while another thread may be using the queue
+  ImGui_ImplVulkan_CreateFontsTexture();
 }
 
 void UiRenderer::AddStaticResource(const std::string &res_name,
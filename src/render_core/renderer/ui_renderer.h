@@ -5,6 +5,7 @@
 #include <string>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "editor/types.hpp"
 #include "imgui.h"
@@ -26,6 +27,21 @@ class StaticUiResource{
   ~StaticUiResource();
 };
 
+// copy of one frame's imgui draw data, drawn after imgui moved on to build
+// the next frame. the draw lists are reused between captures
+class UiDrawSnapshot {
+  ImDrawData _draw_data;
+  std::vector<std::unique_ptr<ImDrawList>> _draw_lists;
+
+ public:
+  // on the thread that owns the imgui context, right after ImGui::Render
+  void Capture(const ImDrawData *draw_data);
+  // null before the first capture
+  ImDrawData *GetDrawData() {
+    return _draw_data.Valid ? &_draw_data : nullptr;
+  }
+};
+
 class UiRenderer {
   int _ui_width = 800;
   int _ui_height = 600;
@@ -46,7 +62,8 @@ class UiRenderer {
     _render_target_view = view;
   }
 
-  void RecordUiCommandBuffer(VkCommandBuffer command_buffer);
+  void RecordUiCommandBuffer(VkCommandBuffer command_buffer,
+                             ImDrawData *draw_data);
   void AddStaticResource(const std::string& res_name, const CPUImage* image);
   ImTextureID GetStaticResourceId(const std::string& res_name);
 
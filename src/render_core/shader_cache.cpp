@@ -0,0 +1,297 @@
+#include "shader_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "vulkan_driver.h"
+
+namespace rdc {
+
+namespace {
+
+constexpr uint32_t kBinaryMagic = 0x42534657;  // "WFSB"
+constexpr uint32_t kBinaryFormatVersion = 1;
+constexpr char kPipelineCacheFile[] = "pipeline.bin";
+
+struct BinaryHeader {
+  uint32_t magic;
+  uint32_t format_version;
+  uint8_t shader_binary_uuid[VK_UUID_SIZE];
+  uint32_t shader_binary_version;
+  uint32_t shader_count;
+};
+
+// fnv-1a, stable across runs and platforms unlike std::hash
+uint64_t HashBytes(uint64_t hash, const void *data, size_t size) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+template <typename T>
+uint64_t HashValue(uint64_t hash, const T &value) {
+  return HashBytes(hash, &value, sizeof(value));
+}
+
+std::string ToHex(const uint8_t *bytes, size_t size) {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  std::string result;
+  result.reserve(size * 2);
+  for (size_t i = 0; i < size; ++i) {
+    result.push_back(kDigits[bytes[i] >> 4]);
+    result.push_back(kDigits[bytes[i] & 0xf]);
+  }
+  return result;
+}
+
+std::vector<uint8_t> ReadFile(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return {};
+  }
+  std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if (!file.read(reinterpret_cast<char *>(data.data()),
+                 static_cast<std::streamsize>(data.size()))) {
+    return {};
+  }
+  return data;
+}
+
+// written next to the target and renamed, so a crash never leaves a torn
+// entry behind and concurrent instances only race on the rename
+void WriteFile(const std::filesystem::path &path,
+               const std::vector<uint8_t> &data) {
+  auto temp = path;
+  temp += ".tmp";
+  {
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char *>(data.data()),
+                    static_cast<std::streamsize>(data.size()))) {
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temp, path, error);
+  if (error) {
+    std::filesystem::remove(temp, error);
+  }
+}
+
+}  // namespace
+
+ShaderCache::ShaderCache(VkDevice device, VkPhysicalDevice physical_device,
+                         const std::filesystem::path &root)
+    : _device(device) {
+  VkPhysicalDeviceShaderObjectPropertiesEXT shader_object_properties = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_PROPERTIES_EXT,
+  };
+  VkPhysicalDeviceProperties2 properties = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+      .pNext = &shader_object_properties,
+  };
+  vkGetPhysicalDeviceProperties2(physical_device, &properties);
+  _device_properties = properties.properties;
+  std::memcpy(_shader_binary_uuid, shader_object_properties.shaderBinaryUUID,
+              VK_UUID_SIZE);
+  _shader_binary_version = shader_object_properties.shaderBinaryVersion;
+
+  if (!root.empty()) {
+    // a driver update changes the directory, stale entries are never read
+    std::ostringstream name;
+    name << ToHex(_device_properties.pipelineCacheUUID, VK_UUID_SIZE) << '_'
+         << std::hex << _device_properties.driverVersion;
+    std::error_code error;
+    std::filesystem::create_directories(root / name.str(), error);
+    if (error) {
+      std::cerr << "Shader cache disabled, failed to create "
+                << (root / name.str()).string() << ": " << error.message()
+                << "\n";
+    } else {
+      _directory = root / name.str();
+    }
+  }
+  LoadPipelineCache();
+}
+
+ShaderCache::~ShaderCache() {
+  SavePipelineCache();
+  vkDestroyPipelineCache(_device, _pipeline_cache, nullptr);
+}
+
+void ShaderCache::LoadPipelineCache() {
+  std::vector<uint8_t> data;
+  if (!_directory.empty()) {
+    data = ReadFile(_directory / kPipelineCacheFile);
+  }
+  // the driver should reject foreign data itself, but not all of them do
+  VkPipelineCacheHeaderVersionOne header = {};
+  if (data.size() >= sizeof(header)) {
+    std::memcpy(&header, data.data(), sizeof(header));
+  }
+  if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header.vendorID != _device_properties.vendorID ||
+      header.deviceID != _device_properties.deviceID ||
+      std::memcmp(header.pipelineCacheUUID,
+                  _device_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    data.clear();
+  }
+  VkPipelineCacheCreateInfo const create_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .initialDataSize = data.size(),
+      .pInitialData = data.empty() ? nullptr : data.data(),
+  };
+  AssertVkResult(
+      vkCreatePipelineCache(_device, &create_info, nullptr, &_pipeline_cache),
+      "Failed to create pipeline cache");
+}
+
+void ShaderCache::SavePipelineCache() const {
+  if (_directory.empty() || _pipeline_cache == VK_NULL_HANDLE) {
+    return;
+  }
+  size_t size = 0;
+  if (vkGetPipelineCacheData(_device, _pipeline_cache, &size, nullptr) !=
+          VK_SUCCESS ||
+      size == 0) {
+    return;
+  }
+  std::vector<uint8_t> data(size);
+  if (vkGetPipelineCacheData(_device, _pipeline_cache, &size, data.data()) !=
+      VK_SUCCESS) {
+    return;
+  }
+  data.resize(size);
+  WriteFile(_directory / kPipelineCacheFile, data);
+}
+
+VkResult ShaderCache::CreateShaders(uint32_t count,
+                                    const VkShaderCreateInfoEXT *infos,
+                                    VkShaderEXT *shaders) {
+  if (_directory.empty()) {
+    return vkCreateShadersEXT(_device, count, infos, nullptr, shaders);
+  }
+  // the key covers everything that shapes the binary besides the layouts,
+  // which are derived from the same source
+  uint64_t key = 0xcbf29ce484222325ull;
+  for (uint32_t i = 0; i < count; ++i) {
+    key = HashValue(key, infos[i].flags);
+    key = HashValue(key, infos[i].stage);
+    key = HashValue(key, infos[i].nextStage);
+    key = HashValue(key, infos[i].setLayoutCount);
+    key = HashValue(key, infos[i].pushConstantRangeCount);
+    key = HashBytes(key, infos[i].pCode, infos[i].codeSize);
+    key = HashBytes(key, infos[i].pName, std::strlen(infos[i].pName));
+  }
+  auto const path =
+      _directory / (ToHex(reinterpret_cast<const uint8_t *>(&key),
+                          sizeof(key)) +
+                    ".bin");
+
+  if (TryCreateFromBinary(path, count, infos, shaders)) {
+    ++_hits;
+    return VK_SUCCESS;
+  }
+  ++_misses;
+  VkResult const result =
+      vkCreateShadersEXT(_device, count, infos, nullptr, shaders);
+  if (result == VK_SUCCESS) {
+    StoreBinaries(path, count, shaders);
+  }
+  return result;
+}
+
+bool ShaderCache::TryCreateFromBinary(const std::filesystem::path &path,
+                                      uint32_t count,
+                                      const VkShaderCreateInfoEXT *infos,
+                                      VkShaderEXT *shaders) const {
+  auto const data = ReadFile(path);
+  BinaryHeader header = {};
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kBinaryMagic ||
+      header.format_version != kBinaryFormatVersion ||
+      header.shader_count != count ||
+      header.shader_binary_version != _shader_binary_version ||
+      std::memcmp(header.shader_binary_uuid, _shader_binary_uuid,
+                  VK_UUID_SIZE) != 0) {
+    return false;
+  }
+
+  std::vector<VkShaderCreateInfoEXT> binary_infos(infos, infos + count);
+  size_t offset = sizeof(header);
+  for (auto &info : binary_infos) {
+    uint64_t size = 0;
+    if (data.size() - offset < sizeof(size)) {
+      return false;
+    }
+    std::memcpy(&size, data.data() + offset, sizeof(size));
+    offset += sizeof(size);
+    if (data.size() - offset < size) {
+      return false;
+    }
+    info.codeType = VK_SHADER_CODE_TYPE_BINARY_EXT;
+    info.codeSize = static_cast<size_t>(size);
+    info.pCode = data.data() + offset;
+    offset += static_cast<size_t>(size);
+  }
+
+  // a driver may still refuse a binary it wrote, e.g. after an internal
+  // compiler change, that is VK_INCOMPATIBLE_SHADER_BINARY_EXT
+  VkResult const result = vkCreateShadersEXT(_device, count,
+                                             binary_infos.data(), nullptr,
+                                             shaders);
+  if (result == VK_SUCCESS) {
+    return true;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    if (shaders[i] != VK_NULL_HANDLE) {
+      vkDestroyShaderEXT(_device, shaders[i], nullptr);
+      shaders[i] = VK_NULL_HANDLE;
+    }
+  }
+  return false;
+}
+
+void ShaderCache::StoreBinaries(const std::filesystem::path &path,
+                                uint32_t count,
+                                const VkShaderEXT *shaders) const {
+  BinaryHeader header = {
+      .magic = kBinaryMagic,
+      .format_version = kBinaryFormatVersion,
+      .shader_binary_version = _shader_binary_version,
+      .shader_count = count,
+  };
+  std::memcpy(header.shader_binary_uuid, _shader_binary_uuid, VK_UUID_SIZE);
+  std::vector<uint8_t> data(sizeof(header));
+  std::memcpy(data.data(), &header, sizeof(header));
+
+  for (uint32_t i = 0; i < count; ++i) {
+    size_t size = 0;
+    if (vkGetShaderBinaryDataEXT(_device, shaders[i], &size, nullptr) !=
+            VK_SUCCESS ||
+        size == 0) {
+      return;
+    }
+    auto const stored = static_cast<uint64_t>(size);
+    size_t const offset = data.size();
+    data.resize(offset + sizeof(stored) + size);
+    std::memcpy(data.data() + offset, &stored, sizeof(stored));
+    if (vkGetShaderBinaryDataEXT(_device, shaders[i], &size,
+                                 data.data() + offset + sizeof(stored)) !=
+        VK_SUCCESS) {
+      return;
+    }
+  }
+  WriteFile(path, data);
+}
+
+}  // namespace rdc
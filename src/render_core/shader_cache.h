@@ -0,0 +1,53 @@
+#ifndef RENDER_CORE_SHADER_CACHE_H_
+#define RENDER_CORE_SHADER_CACHE_H_
+
+#include <volk.h>
+
+#include <cstdint>
+#include <filesystem>
+
+#include "tools.hpp"
+
+namespace rdc {
+
+// on-disk cache of shader object binaries and of the pipeline cache, kept
+// in a directory per device uuid and driver version. entries that are
+// missing or rejected by the driver fall back to spir-v and are rewritten
+class ShaderCache : public NoCopyable {
+  VkDevice _device = VK_NULL_HANDLE;
+  VkPipelineCache _pipeline_cache = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties _device_properties = {};
+  uint8_t _shader_binary_uuid[VK_UUID_SIZE] = {};
+  uint32_t _shader_binary_version = 0;
+  // empty when caching to disk is disabled
+  std::filesystem::path _directory;
+  uint32_t _hits = 0;
+  uint32_t _misses = 0;
+
+  void LoadPipelineCache();
+  void SavePipelineCache() const;
+  bool TryCreateFromBinary(const std::filesystem::path &path, uint32_t count,
+                           const VkShaderCreateInfoEXT *infos,
+                           VkShaderEXT *shaders) const;
+  void StoreBinaries(const std::filesystem::path &path, uint32_t count,
+                     const VkShaderEXT *shaders) const;
+
+ public:
+  // an empty root disables the disk cache, shaders are then always built
+  // from spir-v and the pipeline cache only lives in memory
+  ShaderCache(VkDevice device, VkPhysicalDevice physical_device,
+              const std::filesystem::path &root);
+  ~ShaderCache() override;
+
+  // same contract as vkCreateShadersEXT with spir-v create infos, linked
+  // stages must be passed in one call
+  VkResult CreateShaders(uint32_t count, const VkShaderCreateInfoEXT *infos,
+                         VkShaderEXT *shaders);
+  VkPipelineCache GetPipelineCache() const { return _pipeline_cache; }
+  uint32_t GetHits() const { return _hits; }
+  uint32_t GetMisses() const { return _misses; }
+};
+
+}  // namespace rdc
+
+#endif  // RENDER_CORE_SHADER_CACHE_H_
@@ -0,0 +1,380 @@
+#include "upload_batcher.h"
+
+#include <cstring>
+
+#include "render_core/vulkan_driver.h"
+
+namespace {
+constexpr VkDeviceSize kStagingAlignment = 16;
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+}  // namespace
+
+namespace rdc {
+UploadBatcher::UploadBatcher(VkDevice device, VmaAllocator allocator,
+                             VkQueue queue, uint32_t queue_family_index,
+                             VkDeviceSize ring_size, std::mutex &queue_mutex)
+    : _device(device),
+      _allocator(allocator),
+      _queue(queue),
+      _queue_mutex(&queue_mutex),
+      _ring_size(ring_size) {
+  {
+    VkCommandPoolCreateInfo const command_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                 VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queue_family_index,
+    };
+    AssertVkResult(vkCreateCommandPool(_device, &command_pool_info, nullptr,
+                                       &_command_pool),
+                   "Failed to create upload command pool");
+  }
+  {
+    VkSemaphoreTypeCreateInfoKHR const type_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+        .pNext = nullptr,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+        .initialValue = 0,
+    };
+    VkSemaphoreCreateInfo const semaphore_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &type_info,
+        .flags = 0,
+    };
+    AssertVkResult(vkCreateSemaphore(_device, &semaphore_info, nullptr,
+                                     &_timeline_semaphore),
+                   "Failed to create upload timeline semaphore");
+  }
+  {
+    VmaAllocationCreateInfo const alloc_info = {
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = VMA_MEMORY_USAGE_CPU_ONLY,
+    };
+    VkBufferCreateInfo const buffer_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .size = _ring_size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    VmaAllocationInfo allocation_info;
+    AssertVkResult(
+        vmaCreateBuffer(_allocator, &buffer_info, &alloc_info, &_ring.buffer,
+                        &_ring.allocation, &allocation_info),
+        "Failed to create upload staging ring");
+    _ring_data = static_cast<uint8_t *>(allocation_info.pMappedData);
+  }
+}
+
+UploadBatcher::~UploadBatcher() {
+  Wait(Flush());
+  Collect();
+  if (!_free_command_buffers.empty()) {
+    vkFreeCommandBuffers(_device, _command_pool,
+                         static_cast<uint32_t>(_free_command_buffers.size()),
+                         _free_command_buffers.data());
+  }
+  vkDestroyCommandPool(_device, _command_pool, nullptr);
+  vkDestroySemaphore(_device, _timeline_semaphore, nullptr);
+  vmaDestroyBuffer(_allocator, _ring.buffer, _ring.allocation);
+}
+
+VkCommandBuffer UploadBatcher::GetRecordingCommandBuffer() {
+  if (_recording.command_buffer != VK_NULL_HANDLE) {
+    return _recording.command_buffer;
+  }
+  if (_free_command_buffers.empty()) {
+    VkCommandBufferAllocateInfo const alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .commandPool = _command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    VkCommandBuffer command_buffer;
+    AssertVkResult(
+        vkAllocateCommandBuffers(_device, &alloc_info, &command_buffer),
+        "Failed to allocate upload command buffer");
+    _free_command_buffers.push_back(command_buffer);
+  }
+  _recording.command_buffer = _free_command_buffers.back();
+  _free_command_buffers.pop_back();
+  VkCommandBufferBeginInfo const begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .pNext = nullptr,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      .pInheritanceInfo = nullptr,
+  };
+  AssertVkResult(vkBeginCommandBuffer(_recording.command_buffer, &begin_info),
+                 "Failed to begin upload command buffer");
+  return _recording.command_buffer;
+}
+
+bool UploadBatcher::TryAllocateRing(VkDeviceSize size, VkDeviceSize alignment,
+                                    VkDeviceSize &offset) {
+  if (_ring_used == 0) {
+    _ring_head = 0;
+  }
+  // the free space starts at the head and wraps around to the oldest batch
+  VkDeviceSize const aligned = AlignUp(_ring_head, alignment);
+  VkDeviceSize consumed = 0;
+  if (aligned + size <= _ring_size) {
+    consumed = aligned + size - _ring_head;
+    offset = aligned;
+  } else {
+    consumed = _ring_size - _ring_head + size;
+    offset = 0;
+  }
+  if (consumed > _ring_size - _ring_used) {
+    return false;
+  }
+  _ring_used += consumed;
+  _recording.ring_consumed += consumed;
+  _ring_head = offset + size;
+  return true;
+}
+
+uint8_t *UploadBatcher::Stage(std::unique_lock<std::mutex> &lock,
+                              VkDeviceSize size, VkDeviceSize alignment,
+                              VkBuffer &buffer, VkDeviceSize &offset) {
+  CollectLocked();
+  _staged_bytes += size;
+  if (size <= _ring_size) {
+    while (!TryAllocateRing(size, alignment, offset)) {
+      // the ring is full, make the recorded batch retireable and wait for
+      // the oldest one
+      if (_in_flight.empty()) {
+        FlushLocked(lock);
+      }
+      if (!_in_flight.empty()) {
+        WaitSemaphore(_in_flight.front().timeline_value);
+      }
+      CollectLocked();
+    }
+    buffer = _ring.buffer;
+    return _ring_data + offset;
+  }
+
+  // larger than the whole ring, give it its own staging buffer
+  StagingBuffer staging;
+  VmaAllocationCreateInfo const alloc_info = {
+      .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .usage = VMA_MEMORY_USAGE_CPU_ONLY,
+  };
+  VkBufferCreateInfo const buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .size = size,
+      .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  VmaAllocationInfo allocation_info;
+  AssertVkResult(vmaCreateBuffer(_allocator, &buffer_info, &alloc_info,
+                                 &staging.buffer, &staging.allocation,
+                                 &allocation_info),
+                 "Failed to create staging buffer");
+  _recording.dedicated_staging.push_back(staging);
+  buffer = staging.buffer;
+  offset = 0;
+  return static_cast<uint8_t *>(allocation_info.pMappedData);
+}
+
+uint64_t UploadBatcher::UploadImage(VkImage image, const void *data,
+                                    VkDeviceSize size,
+                                    const VkExtent3D &extent,
+                                    VkImageLayout final_layout) {
+  return UploadImage(
+      image, size, extent,
+      [data, size](uint8_t *staging) { memcpy(staging, data, size); },
+      final_layout);
+}
+
+uint64_t UploadBatcher::UploadImage(VkImage image, VkDeviceSize size,
+                                    const VkExtent3D &extent,
+                                    const FillFunc &fill,
+                                    VkImageLayout final_layout) {
+  std::unique_lock lock(_mutex);
+  VkBuffer staging_buffer;
+  VkDeviceSize staging_offset;
+  auto *staging =
+      Stage(lock, size, kStagingAlignment, staging_buffer, staging_offset);
+  ++_active_fills;
+  lock.unlock();
+  fill(staging);
+  lock.lock();
+  auto *command_buffer = GetRecordingCommandBuffer();
+
+  VkImageSubresourceRange constexpr range = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = 1,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+  };
+  VkImageMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .pNext = nullptr,
+      .srcAccessMask = 0,
+      .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image,
+      .subresourceRange = range,
+  };
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+  VkBufferImageCopy const copy_region = {
+      .bufferOffset = staging_offset,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource =
+          {
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .mipLevel = 0,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+          },
+      .imageExtent = extent,
+  };
+  vkCmdCopyBufferToImage(command_buffer, staging_buffer, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+
+  // a transfer queue cannot name the fragment stage, the consumer's
+  // semaphore wait makes the write visible there
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = final_layout;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+  if (--_active_fills == 0) {
+    _fills_done.notify_all();
+  }
+  return _submitted_value + 1;
+}
+
+uint64_t UploadBatcher::UploadBuffer(VkBuffer buffer, VkDeviceSize dst_offset,
+                                     const void *data, VkDeviceSize size) {
+  std::unique_lock lock(_mutex);
+  VkBuffer staging_buffer;
+  VkDeviceSize staging_offset;
+  memcpy(Stage(lock, size, kStagingAlignment, staging_buffer, staging_offset),
+         data, size);
+  auto *command_buffer = GetRecordingCommandBuffer();
+  VkBufferCopy const region = {
+      .srcOffset = staging_offset,
+      .dstOffset = dst_offset,
+      .size = size,
+  };
+  vkCmdCopyBuffer(command_buffer, staging_buffer, buffer, 1, &region);
+  return _submitted_value + 1;
+}
+
+uint64_t UploadBatcher::Flush() {
+  std::unique_lock lock(_mutex);
+  return FlushLocked(lock);
+}
+
+uint64_t UploadBatcher::FlushLocked(std::unique_lock<std::mutex> &lock) {
+  _fills_done.wait(lock, [this]() { return _active_fills == 0; });
+  if (_recording.command_buffer == VK_NULL_HANDLE) {
+    return _submitted_value;
+  }
+  AssertVkResult(vkEndCommandBuffer(_recording.command_buffer),
+                 "Failed to end upload command buffer");
+  uint64_t const signal_value = _submitted_value + 1;
+  VkTimelineSemaphoreSubmitInfoKHR const timeline_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+      .pNext = nullptr,
+      .waitSemaphoreValueCount = 0,
+      .pWaitSemaphoreValues = nullptr,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &signal_value,
+  };
+  VkSubmitInfo const submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &timeline_info,
+      .waitSemaphoreCount = 0,
+      .pWaitSemaphores = nullptr,
+      .pWaitDstStageMask = nullptr,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &_recording.command_buffer,
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores = &_timeline_semaphore,
+  };
+  {
+    std::lock_guard queue_lock(*_queue_mutex);
+    AssertVkResult(vkQueueSubmit(_queue, 1, &submit_info, VK_NULL_HANDLE),
+                   "Failed to submit uploads");
+  }
+  _submitted_value = signal_value;
+  _recording.timeline_value = signal_value;
+  _in_flight.push_back(std::move(_recording));
+  _recording = {};
+  return _submitted_value;
+}
+
+void UploadBatcher::Retire(Batch &batch) {
+  _ring_used -= batch.ring_consumed;
+  for (auto &staging : batch.dedicated_staging) {
+    vmaDestroyBuffer(_allocator, staging.buffer, staging.allocation);
+  }
+  _free_command_buffers.push_back(batch.command_buffer);
+}
+
+void UploadBatcher::Collect() {
+  std::lock_guard lock(_mutex);
+  CollectLocked();
+}
+
+void UploadBatcher::CollectLocked() {
+  if (_in_flight.empty()) {
+    return;
+  }
+  uint64_t completed = 0;
+  AssertVkResult(
+      vkGetSemaphoreCounterValueKHR(_device, _timeline_semaphore, &completed));
+  while (!_in_flight.empty() &&
+         _in_flight.front().timeline_value <= completed) {
+    Retire(_in_flight.front());
+    _in_flight.pop_front();
+  }
+}
+
+bool UploadBatcher::IsComplete(uint64_t value) const {
+  uint64_t completed = 0;
+  AssertVkResult(
+      vkGetSemaphoreCounterValueKHR(_device, _timeline_semaphore, &completed));
+  return completed >= value;
+}
+
+void UploadBatcher::Wait(uint64_t value) {
+  if (value > _submitted_value) {
+    Flush();
+  }
+  WaitSemaphore(value);
+}
+
+void UploadBatcher::WaitSemaphore(uint64_t value) const {
+  VkSemaphoreWaitInfoKHR const wait_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+      .pNext = nullptr,
+      .flags = 0,
+      .semaphoreCount = 1,
+      .pSemaphores = &_timeline_semaphore,
+      .pValues = &value,
+  };
+  AssertVkResult(vkWaitSemaphoresKHR(_device, &wait_info, UINT64_MAX),
+                 "Failed to wait for uploads");
+}
+}  // namespace rdc
@@ -0,0 +1,119 @@
+#ifndef RENDER_CORE_UPLOAD_BATCHER_H_
+#define RENDER_CORE_UPLOAD_BATCHER_H_
+
+#include <vk_mem_alloc.h>
+#include <volk.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "tools.hpp"
+
+namespace rdc {
+
+// batches buffer and image uploads into few submits on the transfer queue.
+// staging memory is sub-allocated from one persistently mapped ring and
+// completion is tracked with a timeline semaphore, every upload returns the
+// timeline value that signals once its data is on the gpu.
+//
+// every member is safe to call from any thread. fill callbacks run without
+// the lock held, so texel conversion of several uploads overlaps
+class UploadBatcher : public NoCopyable {
+  struct StagingBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+  };
+  struct Batch {
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    uint64_t timeline_value = 0;
+    // ring bytes consumed by this batch, including wrap padding
+    VkDeviceSize ring_consumed = 0;
+    // uploads too large for the ring
+    std::vector<StagingBuffer> dedicated_staging;
+  };
+
+  VkDevice _device = VK_NULL_HANDLE;
+  VmaAllocator _allocator = VK_NULL_HANDLE;
+  VkQueue _queue = VK_NULL_HANDLE;
+  // shared with every other submitter of _queue
+  std::mutex *_queue_mutex = nullptr;
+  VkCommandPool _command_pool = VK_NULL_HANDLE;
+  VkSemaphore _timeline_semaphore = VK_NULL_HANDLE;
+  std::atomic_uint64_t _submitted_value = 0;
+
+  // guards everything below
+  std::mutex _mutex;
+  // uploads that staged into the recording batch and are still filling, it
+  // must not be submitted before their copies are recorded
+  uint32_t _active_fills = 0;
+  std::condition_variable _fills_done;
+
+  StagingBuffer _ring;
+  uint8_t *_ring_data = nullptr;
+  VkDeviceSize _ring_size = 0;
+  VkDeviceSize _ring_head = 0;
+  VkDeviceSize _ring_used = 0;
+  std::atomic_uint64_t _staged_bytes = 0;
+
+  Batch _recording;
+  std::deque<Batch> _in_flight;
+  std::vector<VkCommandBuffer> _free_command_buffers;
+
+  // the callers of the private members hold _mutex
+  VkCommandBuffer GetRecordingCommandBuffer();
+  // reserve staging memory, returns where to write and the buffer and offset
+  // to copy from. may release the lock while waiting for the ring
+  uint8_t *Stage(std::unique_lock<std::mutex> &lock, VkDeviceSize size,
+                 VkDeviceSize alignment, VkBuffer &buffer,
+                 VkDeviceSize &offset);
+  bool TryAllocateRing(VkDeviceSize size, VkDeviceSize alignment,
+                       VkDeviceSize &offset);
+  uint64_t FlushLocked(std::unique_lock<std::mutex> &lock);
+  void CollectLocked();
+  void WaitSemaphore(uint64_t value) const;
+  void Retire(Batch &batch);
+
+ public:
+  UploadBatcher(VkDevice device, VmaAllocator allocator, VkQueue queue,
+                uint32_t queue_family_index, VkDeviceSize ring_size,
+                std::mutex &queue_mutex);
+  ~UploadBatcher() override;
+
+  // writes size bytes of tightly packed texels straight into staging memory
+  using FillFunc = std::function<void(uint8_t *staging)>;
+
+  // copy tightly packed texels into mip 0 of image, which must be in
+  // undefined layout. mip 0 is left in final_layout, other levels untouched
+  uint64_t UploadImage(
+      VkImage image, const void *data, VkDeviceSize size,
+      const VkExtent3D &extent,
+      VkImageLayout final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  uint64_t UploadImage(VkImage image, VkDeviceSize size,
+                       const VkExtent3D &extent, const FillFunc &fill,
+                       VkImageLayout final_layout);
+  uint64_t UploadBuffer(VkBuffer buffer, VkDeviceSize dst_offset,
+                        const void *data, VkDeviceSize size);
+
+  // submit everything recorded so far, returns the last submitted value
+  uint64_t Flush();
+  // free staging memory of batches the gpu has finished
+  void Collect();
+  bool IsComplete(uint64_t value) const;
+  // flushes first when value has not been submitted yet
+  void Wait(uint64_t value);
+
+  // consumers of uploaded resources wait on this semaphore
+  VkSemaphore GetTimelineSemaphore() const { return _timeline_semaphore; }
+  uint64_t GetSubmittedValue() const { return _submitted_value; }
+  // bytes staged since startup
+  VkDeviceSize GetStagedBytes() const { return _staged_bytes; }
+};
+
+}  // namespace rdc
+
+#endif  // RENDER_CORE_UPLOAD_BATCHER_H_
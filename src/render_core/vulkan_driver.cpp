@@ -1,10 +1,17 @@
 #include "vulkan_driver.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <set>
 
+#include "render_core/frame_ring.h"
+#include "render_core/geometry_arena.h"
+#include "render_core/gpu_profiler.h"
+#include "render_core/image_pool.h"
+#include "render_core/shader_cache.h"
+#include "render_core/upload_batcher.h"
 #include "vulkan/vulkan_core.h"
 
 namespace {
@@ -18,6 +25,60 @@ void AddContainer(std::vector<const char *> &container, const char *item) {
   container.push_back(item);
 }
 
+// everything the renderers rely on, the swapchain extension is added on top
+// unless the driver is headless
+constexpr const char *kRequiredDeviceExtensions[] = {
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+    VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
+    VK_EXT_SHADER_OBJECT_EXTENSION_NAME,
+    VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+    VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+    VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME,
+    VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+};
+
+bool HasInstanceExtension(const char *name) {
+  uint32_t count = 0;
+  vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+  std::vector<VkExtensionProperties> properties(count);
+  vkEnumerateInstanceExtensionProperties(nullptr, &count, properties.data());
+  return std::any_of(properties.begin(), properties.end(),
+                     [name](const VkExtensionProperties &property) {
+                       return strcmp(property.extensionName, name) == 0;
+                     });
+}
+
+// higher is better, discrete gpus first and cpu implementations such as
+// lavapipe last
+int DeviceTypeRank(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 4;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 3;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return 2;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+// layer is null for extensions of the implementation itself
+bool HasDeviceExtension(VkPhysicalDevice device, const char *name,
+                        const char *layer = nullptr) {
+  uint32_t count = 0;
+  vkEnumerateDeviceExtensionProperties(device, layer, &count, nullptr);
+  std::vector<VkExtensionProperties> properties(count);
+  vkEnumerateDeviceExtensionProperties(device, layer, &count,
+                                       properties.data());
+  return std::any_of(properties.begin(), properties.end(),
+                     [name](const VkExtensionProperties &property) {
+                       return strcmp(property.extensionName, name) == 0;
+                     });
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL
 DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
               VkDebugUtilsMessageTypeFlagsEXT /*messageType*/,
@@ -49,6 +110,7 @@ void AssertVkResult(const VkResult &result, const char *message) {
 }
 VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
   AssertVkResult(volkInitialize());
+  _frames_in_flight = std::max(config.frames_in_flight, 1u);
 
   {
     VkApplicationInfo const app_info = {
@@ -75,11 +137,17 @@ VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
         .pUserData = nullptr,
     };
 
+    // headless runs on minimal loaders and cpu drivers, debug output is
+    // optional there
+    bool const debug_utils =
+        HasInstanceExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     auto exts = config.instance_extensions;
-    AddContainer(exts, VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    if (debug_utils) {
+      AddContainer(exts, VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    }
     VkInstanceCreateInfo const instance_info = {
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-        .pNext = &debug_info,
+        .pNext = debug_utils ? &debug_info : nullptr,
         .pApplicationInfo = &app_info,
         .enabledLayerCount =
             static_cast<uint32_t>(config.instance_layers.size()),
@@ -91,18 +159,21 @@ VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
     AssertVkResult(vkCreateInstance(&instance_info, nullptr, &_instance),
                    "Failed to create Vulkan instance");
     // create debug messenger
-
-    auto func = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
-        vkGetInstanceProcAddr(_instance, "vkCreateDebugUtilsMessengerEXT"));
-    if (func == nullptr) {
-      std::cerr << "Failed to load vkCreateDebugUtilsMessengerEXT function\n";
-      abort();
+    if (debug_utils) {
+      auto func = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
+          vkGetInstanceProcAddr(_instance, "vkCreateDebugUtilsMessengerEXT"));
+      if (func == nullptr) {
+        std::cerr
+            << "Failed to load vkCreateDebugUtilsMessengerEXT function\n";
+        abort();
+      }
+      AssertVkResult(func(_instance, &debug_info, nullptr, &_debug_messenger),
+                     "Failed to create debug messenger");
     }
-    AssertVkResult(func(_instance, &debug_info, nullptr, &_debug_messenger),
-                   "Failed to create debug messenger");
     volkLoadInstance(_instance);
   }
-  {
+  _headless = config.headless;
+  if (!_headless) {
     AssertVkResult(config.create_surface_callback(_instance, _surface),
                    "Failed to create Vulkan surface");
   }
@@ -114,62 +185,115 @@ VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
     AssertVkResult(vkEnumeratePhysicalDevices(_instance, &device_count,
                                               physical_devices.data()),
                    "Failed to enumerate physical devices");
+    // pick the best ranked device that has a graphics queue, can present
+    // to the surface and supports every required extension
     VkPhysicalDevice selected_device = VK_NULL_HANDLE;
-    // select logic
+    int selected_rank = -1;
+    uint32_t graphics_queue_family_index = UINT32_MAX;
+    uint32_t present_queue_family_index = UINT32_MAX;
+    uint32_t transfer_queue_family_index = UINT32_MAX;
+    // explicitly enabled layers may provide extensions the driver lacks,
+    // e.g. the shader object emulation layer
+    auto supports_extension = [&config](VkPhysicalDevice device,
+                                        const char *name) {
+      return HasDeviceExtension(device, name) ||
+             std::any_of(config.instance_layers.begin(),
+                         config.instance_layers.end(),
+                         [device, name](const char *layer) {
+                           return HasDeviceExtension(device, name, layer);
+                         });
+    };
     for (const auto &device : physical_devices) {
       VkPhysicalDeviceProperties device_properties;
       vkGetPhysicalDeviceProperties(device, &device_properties);
-      if (device_properties.deviceType ==
-          VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-        selected_device = device;
-        std::cout << "Selected physical device: "
-                  << device_properties.deviceName << "\n";
-        break;
+      int const rank = DeviceTypeRank(device_properties.deviceType);
+      if (rank <= selected_rank) {
+        continue;
+      }
+      bool const has_extensions =
+          std::all_of(std::begin(kRequiredDeviceExtensions),
+                      std::end(kRequiredDeviceExtensions),
+                      [&](const char *name) {
+                        return supports_extension(device, name);
+                      }) &&
+          (_headless ||
+           supports_extension(device, VK_KHR_SWAPCHAIN_EXTENSION_NAME));
+      if (!has_extensions) {
+        continue;
+      }
+
+      uint32_t queue_family_count = 0;
+      vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
+                                               nullptr);
+      std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+      vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
+                                               queue_families.data());
+      uint32_t graphics_family = UINT32_MAX;
+      uint32_t present_family = UINT32_MAX;
+      for (uint32_t i = 0; i < queue_family_count; ++i) {
+        if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+          graphics_family = i;
+        }
+        VkBool32 present_support = VK_FALSE;
+        if (!_headless) {
+          vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface,
+                                               &present_support);
+        }
+        if (present_support) {
+          present_family = i;
+        }
+        if (graphics_family != UINT32_MAX &&
+            (_headless || present_family != UINT32_MAX)) {
+          break;  // Found both graphics and present queue families
+        }
+      }
+      if (graphics_family == UINT32_MAX ||
+          (!_headless && present_family == UINT32_MAX)) {
+        continue;
       }
+      selected_device = device;
+      selected_rank = rank;
+      graphics_queue_family_index = graphics_family;
+      // headless frames are never presented
+      present_queue_family_index =
+          _headless ? graphics_family : present_family;
     }
     if (selected_device == VK_NULL_HANDLE) {
       std::cerr << "No suitable physical device found\n";
       std::abort();
     }
     _physical_device = selected_device;
+    {
+      VkPhysicalDeviceProperties device_properties;
+      vkGetPhysicalDeviceProperties(selected_device, &device_properties);
+      std::cout << "Selected physical device: " << device_properties.deviceName
+                << "\n";
+    }
 
-    // select queue
     uint32_t queue_family_count = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(selected_device,
                                              &queue_family_count, nullptr);
     std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
     vkGetPhysicalDeviceQueueFamilyProperties(
         selected_device, &queue_family_count, queue_families.data());
-    uint32_t graphics_queue_family_index = UINT32_MAX;
-    uint32_t present_queue_family_index = UINT32_MAX;
-
+    // prefer a transfer only family, those map to the copy engines
     for (uint32_t i = 0; i < queue_family_count; ++i) {
-      if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-        graphics_queue_family_index = i;
-        // break;
-      }
-      VkBool32 present_support = VK_FALSE;
-      vkGetPhysicalDeviceSurfaceSupportKHR(selected_device, i, _surface,
-                                           &present_support);
-      if (present_support) {
-        present_queue_family_index = i;
-      }
-      if (graphics_queue_family_index != UINT32_MAX &&
-          present_queue_family_index != UINT32_MAX) {
-        break;  // Found both graphics and present queue families
+      auto const flags = queue_families[i].queueFlags;
+      if ((flags & VK_QUEUE_TRANSFER_BIT) &&
+          !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+        transfer_queue_family_index = i;
+        break;
       }
     }
-
-    if (graphics_queue_family_index == UINT32_MAX ||
-        present_queue_family_index == UINT32_MAX) {
-      std::cerr << "No suitable graphics queue family found\n";
-      std::abort();
+    if (transfer_queue_family_index == UINT32_MAX) {
+      transfer_queue_family_index = graphics_queue_family_index;
     }
 
     // create device
     std::set<uint32_t> const unique_queue_families = {
         graphics_queue_family_index,
         present_queue_family_index,
+        transfer_queue_family_index,
     };
 
     std::vector<VkDeviceQueueCreateInfo> queue_infos;
@@ -188,18 +312,67 @@ VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
 
     // create logical device
     std::vector<const char *> device_extensions = config.device_extensions;
-    AddContainer(device_extensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-    AddContainer(device_extensions, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
-    AddContainer(device_extensions, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
-    AddContainer(device_extensions, VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
-    AddContainer(device_extensions,
-                 VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
-    AddContainer(device_extensions, VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
-    AddContainer(device_extensions,
-                 VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+    if (!_headless) {
+      AddContainer(device_extensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    for (const auto *extension : kRequiredDeviceExtensions) {
+      AddContainer(device_extensions, extension);
+    }
+
+    // the bindless model path is optional, only enable what it needs when
+    // the device has all of it
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_support = {
+        .sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT,
+        .pNext = nullptr,
+    };
+    VkPhysicalDeviceFeatures2 features_support = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &indexing_support,
+    };
+    vkGetPhysicalDeviceFeatures2(selected_device, &features_support);
+    _supports_bindless =
+        HasDeviceExtension(selected_device,
+                           VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+        indexing_support.runtimeDescriptorArray &&
+        indexing_support.shaderSampledImageArrayNonUniformIndexing &&
+        indexing_support.descriptorBindingPartiallyBound &&
+        indexing_support.descriptorBindingVariableDescriptorCount &&
+        features_support.features.multiDrawIndirect &&
+        features_support.features.drawIndirectFirstInstance;
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {
+        .sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT,
+        .pNext = nullptr,
+        .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+        .descriptorBindingPartiallyBound = VK_TRUE,
+        .descriptorBindingVariableDescriptorCount = VK_TRUE,
+        .runtimeDescriptorArray = VK_TRUE,
+    };
+    // real heap budgets for the memory report
+    _supports_memory_budget = HasDeviceExtension(
+        selected_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (_supports_memory_budget) {
+      AddContainer(device_extensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    VkPhysicalDeviceFeatures device_features = {};
+    if (_supports_bindless) {
+      AddContainer(device_extensions,
+                   VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+      device_features.multiDrawIndirect = VK_TRUE;
+      device_features.drawIndirectFirstInstance = VK_TRUE;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {
+        .sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+        .pNext = _supports_bindless ? &indexing_features : nullptr,
+        .timelineSemaphore = VK_TRUE,
+    };
     VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamic_state_ext = {
         .sType =
             VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+        .pNext = &timeline_features,
         .extendedDynamicState = VK_TRUE,
     };
     VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features = {
@@ -224,6 +397,7 @@ VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
         .enabledExtensionCount =
             static_cast<uint32_t>(device_extensions.size()),
         .ppEnabledExtensionNames = device_extensions.data(),
+        .pEnabledFeatures = &device_features,
     };
 
     AssertVkResult(
@@ -237,10 +411,16 @@ VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
                      &_queue_packet.present_queue);
     _queue_packet.present_queue_family_index = present_queue_family_index;
     _queue_packet.graphics_queue_family_index = graphics_queue_family_index;
+    vkGetDeviceQueue(_device, transfer_queue_family_index, 0,
+                     &_queue_packet.transfer_queue);
+    _queue_packet.transfer_queue_family_index = transfer_queue_family_index;
+    _upload_queue_families[0] = graphics_queue_family_index;
+    _upload_queue_families[1] = transfer_queue_family_index;
     std::cout << "Created Vulkan device with graphics queue family index: "
               << graphics_queue_family_index
               << ", present queue family index: " << present_queue_family_index
-              << "\n";
+              << ", transfer queue family index: "
+              << transfer_queue_family_index << "\n";
   }
 
   {
@@ -254,13 +434,16 @@ VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
         .instance = _instance,
         .vulkanApiVersion = VK_API_VERSION_1_1,
     };
+    if (_supports_memory_budget) {
+      vma_allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
     vma_allocator_info.pVulkanFunctions = &vulkan_functions;
 
     AssertVkResult(vmaCreateAllocator(&vma_allocator_info, &_vma_allocator),
                    "Failed to create VMA allocator");
   }
 
-  {
+  if (!_headless) {
     CreateSwapchain({config.initial_width, config.initial_height});
   }
 
@@ -276,6 +459,48 @@ VulkanDriver::VulkanDriver(const VulkanDriverConfig &config) {
                                        &_command_pool),
                    "Failed to create command pool");
   }
+  // upload batcher
+  {
+    _upload_batcher = std::make_unique<UploadBatcher>(
+        _device, _vma_allocator, _queue_packet.transfer_queue,
+        _queue_packet.transfer_queue_family_index, config.upload_ring_size,
+        _queue_mutex);
+  }
+  // frame ring, geometry arena and image pool
+  {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_physical_device, &properties);
+    _frame_ring = std::make_unique<FrameRing>(
+        _vma_allocator, _frames_in_flight, config.frame_ring_size,
+        properties.limits.minUniformBufferOffsetAlignment,
+        properties.limits.minStorageBufferOffsetAlignment);
+    _geometry_arena = std::make_unique<GeometryArena>(
+        _vma_allocator, _frame_ring.get(), _frames_in_flight,
+        config.geometry_vertex_capacity, config.geometry_index_capacity);
+    _image_pool = std::make_unique<ImagePool>(_device, _vma_allocator);
+  }
+  // shader cache, before anything that builds shaders or pipelines
+  {
+    _shader_cache = std::make_unique<ShaderCache>(_device, _physical_device,
+                                                  config.shader_cache_dir);
+  }
+  // gpu profiler, timestamps are written on the graphics queue only
+  {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_physical_device, &properties);
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(_physical_device, &family_count,
+                                             nullptr);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(_physical_device, &family_count,
+                                             families.data());
+    uint32_t const valid_bits =
+        families[_queue_packet.graphics_queue_family_index]
+            .timestampValidBits;
+    _gpu_profiler = std::make_unique<GpuProfiler>(
+        _device, _frames_in_flight, properties.limits.timestampPeriod,
+        valid_bits);
+  }
   // descptior pool
   {
     VkDescriptorPoolSize constexpr  ubo_pool_size = {
@@ -336,6 +561,9 @@ void VulkanDriver::CreateSwapchain(const VkExtent2D &extent) {
       .clipped = VK_TRUE,
       .oldSwapchain = old_swapchain,
   };
+  if (SwapchainSupportsTransferDst()) {
+    swapchain_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  }
   uint32_t queue_family_indices[] = {
       _queue_packet.graphics_queue_family_index,
       _queue_packet.present_queue_family_index,
@@ -434,11 +662,39 @@ VkSampler VulkanDriver::HCreateSimpleSampler() const {
                  "Failed to create sampler");
   return sampler;
 }
+VkCommandPool VulkanDriver::GetThreadCommandPool() const {
+  std::lock_guard lock(_thread_pools_mutex);
+  auto &pool = _thread_pools[std::this_thread::get_id()];
+  if (pool == VK_NULL_HANDLE) {
+    VkCommandPoolCreateInfo const command_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                 VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = _queue_packet.graphics_queue_family_index,
+    };
+    AssertVkResult(
+        vkCreateCommandPool(_device, &command_pool_info, nullptr, &pool),
+        "Failed to create thread command pool");
+  }
+  return pool;
+}
+VkResult VulkanDriver::QueueSubmit(VkQueue queue, uint32_t submit_count,
+                                   const VkSubmitInfo *submits,
+                                   VkFence fence) const {
+  std::lock_guard lock(_queue_mutex);
+  return vkQueueSubmit(queue, submit_count, submits, fence);
+}
+VkResult VulkanDriver::QueuePresent(
+    VkQueue queue, const VkPresentInfoKHR &present_info) const {
+  std::lock_guard lock(_queue_mutex);
+  return vkQueuePresentKHR(queue, &present_info);
+}
 VkCommandBuffer VulkanDriver::HBeginOneTimeCommandBuffer() const {
   VkCommandBufferAllocateInfo const alloc_info = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
       .pNext = nullptr,
-      .commandPool = _command_pool,
+      .commandPool = GetThreadCommandPool(),
       .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
       .commandBufferCount = 1,
   };
@@ -465,15 +721,22 @@ void VulkanDriver::HEndOneTimeCommandBuffer(
       .commandBufferCount = 1,
       .pCommandBuffers = &command_buffer,
   };
-  vkQueueSubmit(submit_queue, 1, &submit_info, VK_NULL_HANDLE);
-  vkQueueWaitIdle(submit_queue);
-  vkFreeCommandBuffers(_device, _command_pool, 1, &command_buffer);
+  // wait for this submission only, not for everything else on the queue
+  VkFenceCreateInfo constexpr fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+  };
+  VkFence fence;
+  AssertVkResult(vkCreateFence(_device, &fence_info, nullptr, &fence));
+  AssertVkResult(QueueSubmit(submit_queue, 1, &submit_info, fence));
+  vkWaitForFences(_device, 1, &fence, VK_TRUE, UINT64_MAX);
+  vkDestroyFence(_device, fence, nullptr);
+  vkFreeCommandBuffers(_device, GetThreadCommandPool(), 1, &command_buffer);
 }
 VkCommandBuffer VulkanDriver::HCreateOneCommandBuffer() const {
   VkCommandBufferAllocateInfo const alloc_info = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
       .pNext = nullptr,
-      .commandPool = _command_pool,
+      .commandPool = GetThreadCommandPool(),
       .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
       .commandBufferCount = 1,
   };
@@ -527,14 +790,84 @@ void VulkanDriver::HCreateBuffer(const uint32_t size,
                  "Failed to create buffer");
 }
 
+void VulkanDriver::BeginFrame() {
+  _frame_ring->BeginFrame(_current_frame_index);
+  _geometry_arena->BeginFrame(_frame_number);
+}
+
+void VulkanDriver::AdvanceFrame() {
+  VkDeviceSize const staged_bytes =
+      _upload_batcher->GetStagedBytes() + _geometry_arena->GetStagedBytes();
+  _frame_counters.uploaded_bytes = staged_bytes - _frame_staged_bytes;
+  _frame_staged_bytes = staged_bytes;
+  _last_frame_counters = _frame_counters;
+  _frame_counters = {};
+
+  _current_frame_index = (_current_frame_index + 1) % _frames_in_flight;
+  ++_frame_number;
+}
+
+std::vector<MemoryHeapStats> VulkanDriver::QueryMemoryHeaps() const {
+  const VkPhysicalDeviceMemoryProperties *memory_properties = nullptr;
+  vmaGetMemoryProperties(_vma_allocator, &memory_properties);
+  std::vector<VmaBudget> budgets(memory_properties->memoryHeapCount);
+  vmaGetHeapBudgets(_vma_allocator, budgets.data());
+  VmaTotalStatistics statistics;
+  vmaCalculateStatistics(_vma_allocator, &statistics);
+
+  std::vector<MemoryHeapStats> heaps(memory_properties->memoryHeapCount);
+  for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i) {
+    const auto &heap_statistics = statistics.memoryHeap[i].statistics;
+    heaps[i] = {
+        .flags = memory_properties->memoryHeaps[i].flags,
+        .size = memory_properties->memoryHeaps[i].size,
+        .budget = budgets[i].budget,
+        .usage = budgets[i].usage,
+        .block_bytes = heap_statistics.blockBytes,
+        .allocation_bytes = heap_statistics.allocationBytes,
+        .block_count = heap_statistics.blockCount,
+        .allocation_count = heap_statistics.allocationCount,
+    };
+  }
+  return heaps;
+}
+
+void VulkanDriver::HSetUploadSharingMode(VkImageCreateInfo &image_info) const {
+  if (!HasDedicatedTransferQueue()) {
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    return;
+  }
+  image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+  image_info.queueFamilyIndexCount = 2;
+  image_info.pQueueFamilyIndices = _upload_queue_families;
+}
+
+bool VulkanDriver::HSupportsLinearBlit(VkFormat format) const {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(_physical_device, format, &properties);
+  VkFormatFeatureFlags constexpr required =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (properties.optimalTilingFeatures & required) == required;
+}
+
 VulkanDriver::~VulkanDriver() {
   if (_debug_messenger != VK_NULL_HANDLE) {
     auto func = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(
         vkGetInstanceProcAddr(_instance, "vkDestroyDebugUtilsMessengerEXT"));
     func(_instance, _debug_messenger, nullptr);
   }
+  _image_pool.reset();
+  _geometry_arena.reset();
+  _frame_ring.reset();
+  _upload_batcher.reset();
+  _gpu_profiler.reset();
+  _shader_cache.reset();
   vmaDestroyAllocator(_vma_allocator);
   vkDestroyCommandPool(_device, _command_pool, nullptr);
+  for (auto &[thread_id, pool] : _thread_pools) {
+    vkDestroyCommandPool(_device, pool, nullptr);
+  }
   vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr);
   _swapchain_packet.Destroy(_device);
   vkDestroySurfaceKHR(_instance, _surface, nullptr);
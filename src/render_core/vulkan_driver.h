@@ -7,24 +7,88 @@
 #include <cassert>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "vulkan/vulkan_core.h"
 
 namespace rdc {
+class FrameRing;
+class GeometryArena;
+class GpuProfiler;
+class ImagePool;
+class ShaderCache;
+class UploadBatcher;
 
 void AssertVkResult(const VkResult &result);
 void AssertVkResult(const VkResult &result, const char *message);
+
+// work done by one submitted frame
+struct FrameCounters {
+  // staged for the gpu, texture uploads and geometry writes
+  VkDeviceSize uploaded_bytes = 0;
+  // draw commands recorded, an indirect draw counts once
+  uint32_t draw_calls = 0;
+};
+
+struct MemoryHeapStats {
+  VkMemoryHeapFlags flags = 0;
+  VkDeviceSize size = 0;
+  // without VK_EXT_memory_budget both are estimates derived from the heap
+  // size and this process' allocations
+  VkDeviceSize budget = 0;
+  VkDeviceSize usage = 0;
+  // vulkan memory blocks vma holds and the allocations placed in them
+  VkDeviceSize block_bytes = 0;
+  VkDeviceSize allocation_bytes = 0;
+  uint32_t block_count = 0;
+  uint32_t allocation_count = 0;
+};
 struct VulkanDriverConfig {
   std::vector<const char *> instance_extensions;
   std::vector<const char *> instance_layers;
   std::vector<const char *> device_extensions;
   uint32_t initial_height;
   uint32_t initial_width;
+  // how many frames the cpu may record ahead of the gpu
+  uint32_t frames_in_flight = 2;
+  // staging memory shared by all batched uploads
+  VkDeviceSize upload_ring_size = VkDeviceSize{64} << 20;
+  // per frame in flight, for uniforms and other data rewritten every frame
+  VkDeviceSize frame_ring_size = VkDeviceSize{8} << 20;
+  // initial size of the shared mesh buffers, they grow on demand
+  VkDeviceSize geometry_vertex_capacity = VkDeviceSize{8} << 20;
+  VkDeviceSize geometry_index_capacity = VkDeviceSize{4} << 20;
+  // no surface or swapchain, rendering goes to offscreen images only.
+  // create_surface_callback is ignored and any vulkan device is accepted
+  bool headless = false;
+  // shader binaries and pipeline cache data are kept below this directory,
+  // empty disables the disk cache
+  std::string shader_cache_dir = "shader_cache";
   std::function<VkResult(VkInstance instance, VkSurfaceKHR &surface)>
       create_surface_callback;
 };
 
+// thread safety: the driver is created and destroyed on the main thread
+// while nothing renders. frames are recorded and submitted by one thread,
+// the editor's RenderThread or the exporter's main thread. in the editor
+// it alone acquires, recreates and invalidates the swapchain. the main
+// thread reaches the renderer only through RenderThread::Post and otherwise
+// sticks to the list below. any thread may
+//  - call the getters, HCreateSimpleSampler, HCreateBuffer and the other
+//    helpers that only create objects, vma and vkCreate* are thread safe
+//  - record one-time command buffers, each thread allocates them from a
+//    command pool of its own
+//  - submit or present through QueueSubmit and QueuePresent, which serialize
+//    access to the queues. never call vkQueueSubmit on a driver queue
+//  - upload through the UploadBatcher
+// GetCommandPool, the frame counters and the per-frame rings belong to the
+// thread that records frames
 class VulkanDriver {
   VkInstance _instance = VK_NULL_HANDLE;
   VkDebugUtilsMessengerEXT _debug_messenger = VK_NULL_HANDLE;
@@ -34,7 +98,12 @@ class VulkanDriver {
     VkQueue graphics_queue = VK_NULL_HANDLE;
     uint32_t present_queue_family_index = UINT32_MAX;
     VkQueue present_queue = VK_NULL_HANDLE;
+    // a transfer only family when the device has one, else graphics
+    uint32_t transfer_queue_family_index = UINT32_MAX;
+    VkQueue transfer_queue = VK_NULL_HANDLE;
   } _queue_packet;
+  // graphics and transfer family, referenced by concurrent image create infos
+  uint32_t _upload_queue_families[2] = {};
   VkDevice _device = VK_NULL_HANDLE;
   VkPhysicalDevice _physical_device = VK_NULL_HANDLE;
   VkSurfaceKHR _surface = VK_NULL_HANDLE;
@@ -59,10 +128,35 @@ class VulkanDriver {
 
     std::vector<VkSurfaceFormatKHR> formats;
     std::vector<VkPresentModeKHR> present_modes;
-    VkSurfaceCapabilitiesKHR capabilities;
+    VkSurfaceCapabilitiesKHR capabilities = {};
 
   } _swapchain_packet;
   VkCommandPool _command_pool = VK_NULL_HANDLE;
+  // graphics family pools of the threads that recorded one-time commands
+  mutable std::mutex _thread_pools_mutex;
+  mutable std::unordered_map<std::thread::id, VkCommandPool> _thread_pools;
+  // queues are externally synchronized and may share one handle, a single
+  // lock covers all of them
+  mutable std::mutex _queue_mutex;
+  std::unique_ptr<UploadBatcher> _upload_batcher;
+  std::unique_ptr<FrameRing> _frame_ring;
+  std::unique_ptr<GeometryArena> _geometry_arena;
+  std::unique_ptr<ImagePool> _image_pool;
+  std::unique_ptr<ShaderCache> _shader_cache;
+  std::unique_ptr<GpuProfiler> _gpu_profiler;
+
+  // descriptor indexing plus multi draw indirect are enabled
+  bool _supports_bindless = false;
+  bool _supports_memory_budget = false;
+  bool _headless = false;
+  FrameCounters _frame_counters;
+  FrameCounters _last_frame_counters;
+  // upload totals when the current frame began recording
+  VkDeviceSize _frame_staged_bytes = 0;
+
+  uint32_t _frames_in_flight = 2;
+  uint32_t _current_frame_index = 0;
+  uint64_t _frame_number = 0;
 
   void CreateSwapchain(const VkExtent2D &extent);
 
@@ -87,6 +181,11 @@ class VulkanDriver {
   const VkExtent2D &GetSwapchainExtent() const {
     return _swapchain_packet.extent;
   }
+  // swapchain images can be the destination of copies and blits
+  bool SwapchainSupportsTransferDst() const {
+    return (_swapchain_packet.capabilities.supportedUsageFlags &
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+  }
 
   uint32_t GetCurrentSwapchainImageIndex() const {
     return _swapchain_packet.current_image_index;
@@ -106,6 +205,8 @@ class VulkanDriver {
     return result;
   };
 
+  // the swapchain state is not synchronized, only the thread that renders
+  // may mark and recreate it
   void MarkSwapchainInvalid() { _swapchain_packet.is_valid = false; }
   void RecreateSwapchain(const VkExtent2D &extent);
 
@@ -119,15 +220,64 @@ class VulkanDriver {
   const uint32_t &GetPresentQueueFamilyIndex() const {
     return _queue_packet.present_queue_family_index;
   }
+  const VkQueue &GetTransferQueue() const {
+    return _queue_packet.transfer_queue;
+  }
+  const uint32_t &GetTransferQueueFamilyIndex() const {
+    return _queue_packet.transfer_queue_family_index;
+  }
+  bool SupportsBindless() const { return _supports_bindless; }
+  bool SupportsMemoryBudget() const { return _supports_memory_budget; }
+  // budget, usage and vma statistics of every memory heap
+  std::vector<MemoryHeapStats> QueryMemoryHeaps() const;
+  void CountDrawCalls(uint32_t count) { _frame_counters.draw_calls += count; }
+  // counters of the last frame passed to AdvanceFrame
+  const FrameCounters &GetLastFrameCounters() const {
+    return _last_frame_counters;
+  }
+  // no swapchain exists, present queue and swapchain getters are unusable
+  bool IsHeadless() const { return _headless; }
+  bool HasDedicatedTransferQueue() const {
+    return _queue_packet.transfer_queue_family_index !=
+           _queue_packet.graphics_queue_family_index;
+  }
 
   const VkDevice &GetDevice() const { return _device; }
+  // for the frame recording thread only
   const VkCommandPool &GetCommandPool() const { return _command_pool; }
+  // graphics family pool of the calling thread, created on first use
+  VkCommandPool GetThreadCommandPool() const;
   const VmaAllocator &GetVmaAllocator() const { return _vma_allocator; }
   const VkInstance &GetInstance() const { return _instance; }
   const VkPhysicalDevice &GetPhysicalDevice() const { return _physical_device; }
   const VkDescriptorPool &GetDescriptorPool() const { return _descriptor_pool; }
+  UploadBatcher *GetUploadBatcher() const { return _upload_batcher.get(); }
+  FrameRing *GetFrameRing() const { return _frame_ring.get(); }
+  GeometryArena *GetGeometryArena() const { return _geometry_arena.get(); }
+  ImagePool *GetImagePool() const { return _image_pool.get(); }
+  ShaderCache *GetShaderCache() const { return _shader_cache.get(); }
+  GpuProfiler *GetGpuProfiler() const { return _gpu_profiler.get(); }
+
+  /// frames
+  uint32_t GetFramesInFlight() const { return _frames_in_flight; }
+  // index of the per-frame resources the cpu is recording into
+  uint32_t GetCurrentFrameIndex() const { return _current_frame_index; }
+  // monotonic count of frames submitted since startup
+  uint64_t GetFrameNumber() const { return _frame_number; }
+  // call once the current frame's fence has signaled, recycles what that
+  // frame slot used before
+  void BeginFrame();
+  void AdvanceFrame();
+  // the only way to submit to or present on the driver's queues, safe from
+  // any thread
+  VkResult QueueSubmit(VkQueue queue, uint32_t submit_count,
+                       const VkSubmitInfo *submits, VkFence fence) const;
+  VkResult QueuePresent(VkQueue queue,
+                        const VkPresentInfoKHR &present_info) const;
   // helpers
   VkSampler HCreateSimpleSampler() const;
+  // one-time command buffers come from the calling thread's pool and must be
+  // ended on the thread that began them
   VkCommandBuffer HBeginOneTimeCommandBuffer() const;
   void HEndOneTimeCommandBuffer(const VkCommandBuffer &command_buffer,
                                 const VkQueue &submit_queue) const;
@@ -164,6 +314,12 @@ class VulkanDriver {
   void HCreateBuffer(uint32_t size, VkBufferUsageFlags usage,
                      VmaMemoryUsage vma_flags, VkBuffer &buffer,
                      VmaAllocation &allocation) const;
+  // share images written by the upload batcher between the graphics and
+  // transfer families, keeps them exclusive when both are the same
+  void HSetUploadSharingMode(VkImageCreateInfo &image_info) const;
+  // whether optimal tiling images of format can be downsampled with a linear
+  // filtered vkCmdBlitImage
+  bool HSupportsLinearBlit(VkFormat format) const;
   ~VulkanDriver();
 
   // global vulkan
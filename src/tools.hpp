@@ -1,9 +1,21 @@
 #ifndef TOOLS_HPP_
 #define TOOLS_HPP_
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cassert>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
 template <typename Func, typename Object, typename... Args>
   requires std::is_void_v<
       std::invoke_result_t<Func, Object *, Args...>>  // 限定返回类型为 void
@@ -140,4 +152,139 @@ class LazyVector {
   }
 };
 
+class ThreadPool : public NoCopyable {
+  std::vector<std::thread> _workers;
+  std::deque<std::function<void()>> _tasks;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  bool _stopping = false;
+
+  void WorkerLoop() {
+    WAIFU_TRACE_THREAD_NAME("worker");
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock lock(_mutex);
+        _condition.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+        if (_stopping && _tasks.empty()) {
+          return;
+        }
+        task = std::move(_tasks.front());
+        _tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+ public:
+  explicit ThreadPool(
+      size_t thread_count = std::max(1u, std::thread::hardware_concurrency())) {
+    for (size_t i = 0; i < thread_count; ++i) {
+      _workers.emplace_back([this]() { WorkerLoop(); });
+    }
+  }
+  ~ThreadPool() override {
+    {
+      std::lock_guard lock(_mutex);
+      _stopping = true;
+    }
+    _condition.notify_all();
+    for (auto &worker : _workers) {
+      worker.join();
+    }
+  }
+
+  size_t GetThreadCount() const { return _workers.size(); }
+
+  template <typename Func>
+  auto Submit(Func &&func) -> std::future<std::invoke_result_t<Func>> {
+    using Result = std::invoke_result_t<Func>;
+    auto task =
+        std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+    auto future = task->get_future();
+    {
+      std::lock_guard lock(_mutex);
+      _tasks.emplace_back([task]() { (*task)(); });
+    }
+    _condition.notify_one();
+    return future;
+  }
+
+  // run func(i) for every i in [0, count), the calling thread helps so it is
+  // safe to call from inside a pool task. returns once every call finished
+  template <typename Func>
+  void ParallelFor(size_t count, Func &&func) {
+    struct State {
+      std::atomic_size_t next = 0;
+      std::atomic_size_t done = 0;
+      std::mutex mutex;
+      std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    auto run = [state, count, &func]() {
+      size_t index;
+      while ((index = state->next.fetch_add(1)) < count) {
+        func(index);
+        if (state->done.fetch_add(1) + 1 == count) {
+          std::lock_guard lock(state->mutex);
+          state->finished.notify_all();
+        }
+      }
+    };
+    size_t const helpers = std::min(count, _workers.size());
+    for (size_t i = 0; i + 1 < helpers; ++i) {
+      // helpers that start after all work is taken return immediately, they
+      // never touch func
+      Submit(run);
+    }
+    run();
+    std::unique_lock lock(state->mutex);
+    state->finished.wait(lock,
+                         [&state, count]() { return state->done == count; });
+  }
+
+  static ThreadPool *GetGlobal() {
+    static ThreadPool pool;
+    return &pool;
+  }
+};
+
+// hands the latest value from one producer thread to one consumer thread
+// without locks. the producer fills GetWriteSlot and publishes it, values the
+// consumer never acquired are overwritten. slots are reused, so values keep
+// their allocations and must be rewritten completely
+template <typename T>
+class TripleBuffer : public NoCopyable {
+  static constexpr uint8_t kIndexMask = 3;
+  // set while the middle slot holds a value the consumer has not acquired
+  static constexpr uint8_t kFresh = 4;
+  std::array<T, 3> _slots;
+  std::atomic_uint8_t _middle = 1;
+  // owned by the producer and the consumer
+  uint8_t _write = 0;
+  uint8_t _read = 2;
+
+ public:
+  T &GetWriteSlot() { return _slots[_write]; }
+  void Publish() {
+    _write = _middle.exchange(_write | kFresh, std::memory_order_acq_rel) &
+             kIndexMask;
+  }
+  // the last published value was not acquired yet
+  bool IsPending() const {
+    return (_middle.load(std::memory_order_relaxed) & kFresh) != 0;
+  }
+
+  // true when a value was published since the last acquire, the read slot
+  // then holds it until the next acquire
+  bool Acquire() {
+    if (!IsPending()) {
+      return false;
+    }
+    _read = _middle.exchange(_read, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+  T &GetReadSlot() { return _slots[_read]; }
+};
+
 #endif  // TOOLS_HPP_
@@ -0,0 +1,197 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+// cpu scope tracing, enabled by building with WAIFU_ENABLE_TRACE. every
+// thread records into its own ring buffer without locking, the newest
+// events of all threads can be dumped in the chrome trace event format and
+// opened in chrome://tracing or ui.perfetto.dev
+//
+//   WAIFU_TRACE_SCOPE("name");       string literal, until the end of scope
+//   WAIFU_TRACE_FUNCTION();          the enclosing function
+//   WAIFU_TRACE_THREAD_NAME("name"); label of the calling thread
+//   WAIFU_TRACE_DUMP(path);          true when the json file was written
+//
+// without WAIFU_ENABLE_TRACE the macros expand to nothing
+
+#ifdef WAIFU_ENABLE_TRACE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+struct Event {
+  const char *name = nullptr;
+  int64_t begin_ns = 0;
+  int64_t end_ns = 0;
+};
+
+// written by its thread only, read by Dump. the writer never waits, a
+// reader drops whatever may have been overwritten while it copied
+class ThreadBuffer {
+ public:
+  static constexpr size_t kCapacity = size_t{1} << 16;
+
+  explicit ThreadBuffer(uint32_t thread_id) : _thread_id(thread_id) {}
+
+  void Push(const Event &event) {
+    uint64_t const head = _head.load(std::memory_order_relaxed);
+    _events[head % kCapacity] = event;
+    _head.store(head + 1, std::memory_order_release);
+  }
+  void CopyTo(std::vector<Event> &out) const {
+    uint64_t const head = _head.load(std::memory_order_acquire);
+    uint64_t const first = head > kCapacity ? head - kCapacity : 0;
+    size_t const begin = out.size();
+    for (uint64_t i = first; i < head; ++i) {
+      out.push_back(_events[i % kCapacity]);
+    }
+    // entries below the new head minus capacity were reused meanwhile
+    uint64_t const after = _head.load(std::memory_order_acquire);
+    uint64_t const valid = after > kCapacity ? after - kCapacity : 0;
+    if (valid > first) {
+      auto const torn = std::min<uint64_t>(valid - first, head - first);
+      out.erase(out.begin() + begin, out.begin() + begin + torn);
+    }
+  }
+  uint32_t GetThreadId() const { return _thread_id; }
+  void SetName(const char *name) { _name.store(name); }
+  const char *GetName() const { return _name.load(); }
+
+ private:
+  std::array<Event, kCapacity> _events;
+  std::atomic_uint64_t _head = 0;
+  std::atomic<const char *> _name = nullptr;
+  uint32_t _thread_id;
+};
+
+class Registry {
+  std::mutex _mutex;
+  // kept after their thread exits so its events can still be dumped
+  std::vector<std::shared_ptr<ThreadBuffer>> _buffers;
+  std::chrono::steady_clock::time_point _epoch =
+      std::chrono::steady_clock::now();
+
+ public:
+  static Registry *Get() {
+    static Registry registry;
+    return &registry;
+  }
+
+  int64_t Now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - _epoch)
+        .count();
+  }
+
+  // the calling thread's buffer, registered on first use
+  ThreadBuffer *Local() {
+    thread_local ThreadBuffer *local = nullptr;
+    if (!local) {
+      std::lock_guard lock(_mutex);
+      _buffers.push_back(std::make_shared<ThreadBuffer>(
+          static_cast<uint32_t>(_buffers.size() + 1)));
+      local = _buffers.back().get();
+    }
+    return local;
+  }
+
+  bool DumpChromeJson(const std::string &path) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+      std::lock_guard lock(_mutex);
+      buffers = _buffers;
+    }
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+      return false;
+    }
+    auto write_string = [&file](const char *text) {
+      file << '"';
+      for (; *text; ++text) {
+        if (*text == '"' || *text == '\\') {
+          file << '\\';
+        }
+        file << *text;
+      }
+      file << '"';
+    };
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<Event> events;
+    for (const auto &buffer : buffers) {
+      auto const tid = buffer->GetThreadId();
+      if (const char *name = buffer->GetName()) {
+        file << (first ? "" : ",")
+             << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":"
+             << tid << ",\"args\":{\"name\":";
+        write_string(name);
+        file << "}}";
+        first = false;
+      }
+      events.clear();
+      buffer->CopyTo(events);
+      for (const auto &event : events) {
+        file << (first ? "" : ",") << "\n{\"name\":";
+        write_string(event.name);
+        // microseconds, fractions keep nested short scopes apart
+        file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+             << ",\"ts\":" << static_cast<double>(event.begin_ns) / 1000.0
+             << ",\"dur\":"
+             << static_cast<double>(event.end_ns - event.begin_ns) / 1000.0
+             << "}";
+        first = false;
+      }
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+  }
+};
+
+class Scope {
+  const char *_name;
+  int64_t _begin_ns;
+
+ public:
+  explicit Scope(const char *name)
+      : _name(name), _begin_ns(Registry::Get()->Now()) {}
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  ~Scope() {
+    auto *registry = Registry::Get();
+    registry->Local()->Push({_name, _begin_ns, registry->Now()});
+  }
+};
+
+}  // namespace trace
+
+#define WAIFU_TRACE_CONCAT_INNER(a, b) a##b
+#define WAIFU_TRACE_CONCAT(a, b) WAIFU_TRACE_CONCAT_INNER(a, b)
+#define WAIFU_TRACE_SCOPE(name) \
+  ::trace::Scope const WAIFU_TRACE_CONCAT(waifu_trace_scope_, __COUNTER__)(name)
+#define WAIFU_TRACE_FUNCTION() WAIFU_TRACE_SCOPE(__func__)
+#define WAIFU_TRACE_THREAD_NAME(name) \
+  ::trace::Registry::Get()->Local()->SetName(name)
+#define WAIFU_TRACE_DUMP(path) ::trace::Registry::Get()->DumpChromeJson(path)
+
+#else
+
+#define WAIFU_TRACE_SCOPE(name) static_cast<void>(0)
+#define WAIFU_TRACE_FUNCTION() static_cast<void>(0)
+#define WAIFU_TRACE_THREAD_NAME(name) static_cast<void>(0)
+#define WAIFU_TRACE_DUMP(path) (static_cast<void>(path), false)
+
+#endif  // WAIFU_ENABLE_TRACE
+
+#endif  // TRACE_HPP_